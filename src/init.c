@@ -1,6 +1,25 @@
 #include "../include/ufos.h"
 #include "ufo_empty.h"
 #include "ufo_operators.h"
+#include "ufo_lazy.h"
+#include "ufo_fused.h"
+#include "ufo_packed.h"
+#include "ufo_reductions.h"
+#include "ufo_scans.h"
+#include "ufo_select.h"
+#include "ufo_which.h"
+#include "ufo_tabulate.h"
+#include "ufo_sort.h"
+#include "ufo_unique.h"
+#include "ufo_match.h"
+#include "ufo_join.h"
+#include "ufo_group.h"
+#include "ufo_quantile.h"
+#include "ufo_rolling.h"
+#include "ufo_shift.h"
+#include "ufo_chunks.h"
+#include "ufo_simd.h"
+#include "ufo_threads.h"
 #include "ufo_coerce.h"
 #include "ufo_mutate.h"
 
@@ -32,6 +51,71 @@ static const R_CallMethodDef CallEntries[] = {
 	{"rel_result",				(DL_FUNC) &ufo_rel_result,					3},
 	{"log_result",				(DL_FUNC) &ufo_log_result,					3},
 	{"neg_result",				(DL_FUNC) &ufo_neg_result,					2},
+	{"not_result",				(DL_FUNC) &ufo_not_result,					2},
+	{"math_result",				(DL_FUNC) &ufo_math_result,					2},
+	{"abs_result",				(DL_FUNC) &ufo_abs_result,					2},
+
+	// Native chunked operators.
+	{"binary",					(DL_FUNC) &ufo_binary,						5},
+	{"unary",					(DL_FUNC) &ufo_unary,						4},
+	{"chunk_size",				(DL_FUNC) &ufo_chunk_size,					3},
+
+	// Lazy operator results.
+	{"lazy_binary_result",		(DL_FUNC) &ufo_lazy_binary_result,			4},
+	{"lazy_unary_result",		(DL_FUNC) &ufo_lazy_unary_result,			3},
+
+	// Fused expressions.
+	{"fused",					(DL_FUNC) &ufo_fused,						3},
+	{"fused_quantify",			(DL_FUNC) &ufo_fused_quantify,				4},
+
+	// Packed logical results.
+	{"packed_binary",			(DL_FUNC) &ufo_packed_binary,				4},
+	{"packed_unary",			(DL_FUNC) &ufo_packed_unary,				3},
+	{"is_packed",				(DL_FUNC) &ufo_is_packed,					1},
+
+	// Reductions.
+	{"reduce",					(DL_FUNC) &ufo_reduce,						4},
+
+	// Prefix scans.
+	{"scan",					(DL_FUNC) &ufo_scan,						4},
+
+	// Elementwise selection.
+	{"ifelse",					(DL_FUNC) &ufo_ifelse,						5},
+	{"pminmax",					(DL_FUNC) &ufo_pminmax,						6},
+
+	// Searching.
+	{"which",					(DL_FUNC) &ufo_which,						3},
+
+	// Counting.
+	{"tabulate",				(DL_FUNC) &ufo_tabulate,					4},
+
+	// Sorting.
+	{"sort",					(DL_FUNC) &ufo_sort,						6},
+	{"order",					(DL_FUNC) &ufo_order,						6},
+
+	// Hashing.
+	{"unique",					(DL_FUNC) &ufo_unique,						3},
+	{"duplicated",				(DL_FUNC) &ufo_duplicated,					3},
+	{"any_duplicated",			(DL_FUNC) &ufo_any_duplicated,				2},
+	{"match",					(DL_FUNC) &ufo_match,						5},
+	{"in",						(DL_FUNC) &ufo_in,							4},
+	{"join_indices",			(DL_FUNC) &ufo_join_indices,				5},
+
+	// Grouped aggregation.
+	{"group_aggregate",			(DL_FUNC) &ufo_group_aggregate,				7},
+
+	// Quantiles.
+	{"quantile",				(DL_FUNC) &ufo_quantile,					5},
+
+	// Rolling windows.
+	{"roll",					(DL_FUNC) &ufo_roll,						6},
+
+	// Differences and shifts.
+	{"diff",					(DL_FUNC) &ufo_diff,						5},
+	{"shift",					(DL_FUNC) &ufo_shift,						5},
+
+	// Diagnostics.
+	{"simd_instruction_set",	(DL_FUNC) &ufo_simd_instruction_set_sexp,	0},
 
 	// Subsetting operators.
 	{"subset",					(DL_FUNC) &ufo_subset,						3},
@@ -50,6 +134,9 @@ void attribute_visible R_init_ufooperators(DllInfo *dll) {
     R_useDynamicSymbols(dll, FALSE);
     R_forceSymbols(dll, TRUE); // causes failure to lookup the ufo_get_chunk symbol
 
+	// Select vectorized kernels for this CPU.
+	ufo_simd_initialize();
+
 	// Export useful functions for use by other packages in C.
 	R_RegisterCCallable("ufos", "get_chunk",          (DL_FUNC) &ufo_get_chunk);
 	R_RegisterCCallable("ufos", "subset",             (DL_FUNC) &ufo_subset);
@@ -61,6 +148,15 @@ void attribute_visible R_init_ufooperators(DllInfo *dll) {
 	R_RegisterCCallable("ufos", "ufo_rel_result",     (DL_FUNC) &ufo_rel_result);
 	R_RegisterCCallable("ufos", "ufo_log_result",     (DL_FUNC) &ufo_log_result);
 	R_RegisterCCallable("ufos", "ufo_neg_result	",    (DL_FUNC) &ufo_neg_result);
+	R_RegisterCCallable("ufos", "ufo_not_result",     (DL_FUNC) &ufo_not_result);
+	R_RegisterCCallable("ufos", "ufo_binary",         (DL_FUNC) &ufo_binary);
+	R_RegisterCCallable("ufos", "ufo_unary",          (DL_FUNC) &ufo_unary);
+	R_RegisterCCallable("ufos", "ufo_lazy_binary_result", (DL_FUNC) &ufo_lazy_binary_result);
+	R_RegisterCCallable("ufos", "ufo_lazy_unary_result",  (DL_FUNC) &ufo_lazy_unary_result);
+	R_RegisterCCallable("ufos", "ufo_fused",          (DL_FUNC) &ufo_fused);
+	R_RegisterCCallable("ufos", "ufo_match",          (DL_FUNC) &ufo_match);
+	R_RegisterCCallable("ufos", "ufo_in",             (DL_FUNC) &ufo_in);
+	R_RegisterCCallable("ufos", "ufo_join_indices",   (DL_FUNC) &ufo_join_indices);
 	R_RegisterCCallable("ufos", "element_as_integer", (DL_FUNC) &element_as_integer);
 	R_RegisterCCallable("ufos", "element_as_real",    (DL_FUNC) &element_as_real);   
 	R_RegisterCCallable("ufos", "element_as_complex", (DL_FUNC) &element_as_complex);
@@ -96,3 +192,9 @@ void attribute_visible R_init_ufooperators(DllInfo *dll) {
 }
 
 
+
+// Called when the package is unloaded. Name follows the pattern:
+// R_unload_<package_name>
+void attribute_visible R_unload_ufooperators(DllInfo *dll) {
+	ufo_threads_shutdown();
+}
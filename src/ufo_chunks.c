@@ -0,0 +1,342 @@
+#include "ufo_chunks.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+#include "safety_first.h"
+#include "helpers.h"
+#include "ufo_kernels.h"
+#include "ufo_threads.h"
+
+#define MIN(x, y) (x >= y ? y : x)
+#define MAX(x, y) (x >= y ? x : y)
+
+ufo_operand_t ufo_operand_from(SEXP vector) {
+	ufo_operand_t operand;
+	operand.sexp           = vector;
+	operand.type           = TYPEOF(vector);
+	operand.length         = XLENGTH(vector);
+	operand.element_size   = __get_element_size(operand.type);
+	operand.data           = DATAPTR_OR_NULL(vector);
+	operand.scalar         = false;
+	operand.tiles          = NULL;
+	operand.tiles_malloced = false;
+	return operand;
+}
+
+ufo_chunk_indices_t ufo_calculate_chunk_indices(R_xlen_t operand_length, R_xlen_t start, R_xlen_t length) {
+	ufo_chunk_indices_t indices;
+	indices.beginning = start % operand_length;
+
+	R_xlen_t expected_ending = indices.beginning + length;
+	indices.ending        = MIN(expected_ending, operand_length);
+	indices.has_runoff    = expected_ending > operand_length;
+	indices.runoff_ending = indices.has_runoff ? expected_ending - operand_length : 0;
+	return indices;
+}
+
+// How many elements of a vector that has no data pointer are copied out of it
+// at a time, before they are converted to the working type.
+#define GATHER_PIECE_LENGTH 512
+
+void ufo_repeat_period(void *target, R_xlen_t period, R_xlen_t length, size_t element_size) {
+	unsigned char *bytes = (unsigned char *) target;
+	for (R_xlen_t filled = period; filled < length;) {
+		R_xlen_t copied = MIN(filled, length - filled);
+		memcpy(bytes + filled * element_size, bytes, copied * element_size);
+		filled += copied;
+	}
+}
+
+// Copies a contiguous region of an atomic vector, without wrapping around,
+// in the vector's own type. Vectors without a data pointer are asked for the
+// region through the R API.
+static void __copy_contiguous(SEXP vector, const void *data, R_xlen_t start, R_xlen_t length, void *target) {
+	size_t element_size = __get_element_size(TYPEOF(vector));
+	if (data != NULL) {
+		memcpy(target, (const unsigned char *) data + start * element_size, length * element_size);
+		return;
+	}
+
+	switch (TYPEOF(vector)) {
+	case LGLSXP:  LOGICAL_GET_REGION(vector, start, length, (int *) target);      return;
+	case INTSXP:  INTEGER_GET_REGION(vector, start, length, (int *) target);      return;
+	case REALSXP: REAL_GET_REGION   (vector, start, length, (double *) target);   return;
+	case CPLXSXP: COMPLEX_GET_REGION(vector, start, length, (Rcomplex *) target); return;
+	case RAWSXP:  RAW_GET_REGION    (vector, start, length, (Rbyte *) target);    return;
+	default:      Rf_error("Cannot copy a region of a vector of type %s", type2char(TYPEOF(vector)));
+	}
+}
+
+void ufo_copy_region(SEXP vector, R_xlen_t start, R_xlen_t length, void *target) {
+	R_xlen_t vector_length = XLENGTH(vector);
+	make_sure(vector_length > 0, "Cannot copy a region of an empty vector");
+
+	const void *data = DATAPTR_OR_NULL(vector);
+	size_t element_size = __get_element_size(TYPEOF(vector));
+	unsigned char *bytes = (unsigned char *) target;
+
+	// At most two segments: up to the end of the vector, then from its start.
+	R_xlen_t period = MIN(length, vector_length);
+	ufo_chunk_indices_t indices = ufo_calculate_chunk_indices(vector_length, start, period);
+	R_xlen_t segment = indices.ending - indices.beginning;
+	__copy_contiguous(vector, data, indices.beginning, segment, bytes);
+	if (indices.has_runoff) {
+		__copy_contiguous(vector, data, 0, indices.runoff_ending, bytes + segment * element_size);
+	}
+
+	ufo_repeat_period(target, period, length, element_size);
+}
+
+// Copies a contiguous segment of the operand into the target, converting it
+// to the working type along the way.
+static void __convert_segment(ufo_operand_t operand, R_xlen_t start, R_xlen_t length,
+                              SEXPTYPE working_type, unsigned char *target) {
+	if (operand.data != NULL) {
+		ufo_convert_elements(operand.type, (const unsigned char *) operand.data + start * operand.element_size,
+		                     working_type, target, length);
+		return;
+	}
+
+	// Only reachable from R's thread, see ufo_operand_region.
+	size_t working_element_size = ufo_working_type_element_size(working_type);
+	Rcomplex piece[GATHER_PIECE_LENGTH]; // big enough for any operand type
+	for (R_xlen_t done = 0; done < length; done += GATHER_PIECE_LENGTH) {
+		R_xlen_t piece_length = MIN(GATHER_PIECE_LENGTH, length - done);
+		__copy_contiguous(operand.sexp, NULL, start + done, piece_length, piece);
+		ufo_convert_elements(operand.type, piece, working_type,
+		                     target + done * working_element_size, piece_length);
+	}
+}
+
+// Single elements and tiles are only worth it when the operand is recycled
+// at all. Tiles take up to two chunks' worth of memory, so operands longer
+// than a chunk are read straight from their data instead.
+void ufo_operand_prepare(ufo_operand_t *operand, SEXPTYPE working_type,
+                         R_xlen_t result_length, R_xlen_t chunk_length, bool persistent) {
+	make_sure(operand->length > 0, "Cannot prepare an empty operand");
+
+	if (operand->length >= result_length) {
+		return;
+	}
+
+	if (operand->length == 1) {
+		__convert_segment(*operand, 0, 1, working_type, (unsigned char *) &operand->value);
+		operand->scalar = true;
+		return;
+	}
+
+	if (operand->length > chunk_length) {
+		return;
+	}
+
+	// Any chunk starting inside the first copy ends before the last one does.
+	R_xlen_t tiles_length = chunk_length + operand->length;
+	size_t working_element_size = ufo_working_type_element_size(working_type);
+	if (persistent) {
+		operand->tiles = malloc(tiles_length * working_element_size);
+		if (operand->tiles == NULL) {
+			Rf_error("Cannot allocate %li elements to tile an operand", tiles_length);
+		}
+		operand->tiles_malloced = true;
+	} else {
+		operand->tiles = R_alloc(tiles_length, working_element_size);
+	}
+
+	__convert_segment(*operand, 0, operand->length, working_type, operand->tiles);
+	ufo_repeat_period(operand->tiles, operand->length, tiles_length, working_element_size);
+}
+
+void ufo_operand_release(ufo_operand_t *operand) {
+	if (operand->tiles_malloced) {
+		free(operand->tiles);
+	}
+	operand->tiles = NULL;
+	operand->tiles_malloced = false;
+}
+
+bool ufo_operand_needs_r(const ufo_operand_t *operand) {
+	return operand->data == NULL && !operand->scalar && operand->tiles == NULL;
+}
+
+ufo_region_t ufo_operand_region(const ufo_operand_t *operand, SEXPTYPE working_type,
+                                R_xlen_t start, R_xlen_t length, void *scratch) {
+	ufo_region_t region = { .data = scratch, .broadcast = false };
+
+	if (operand->scalar) {
+		region.data = &operand->value;
+		region.broadcast = true;
+		return region;
+	}
+
+	size_t working_element_size = ufo_working_type_element_size(working_type);
+
+	if (operand->tiles != NULL) {
+		region.data = (const unsigned char *) operand->tiles + (start % operand->length) * working_element_size;
+		return region;
+	}
+
+	R_xlen_t period = MIN(length, operand->length);
+	ufo_chunk_indices_t indices = ufo_calculate_chunk_indices(operand->length, start, period);
+
+	if (operand->data != NULL
+	    && !indices.has_runoff
+	    && period == length
+	    && ufo_same_representation(operand->type, working_type)) {
+		region.data = (const unsigned char *) operand->data + indices.beginning * operand->element_size;
+		return region;
+	}
+
+	// Convert at most one period of the operand (in at most two segments),
+	// then repeat it for short operands.
+	unsigned char *target = (unsigned char *) scratch;
+	R_xlen_t segment = indices.ending - indices.beginning;
+	__convert_segment(*operand, indices.beginning, segment, working_type, target);
+	if (indices.has_runoff) {
+		__convert_segment(*operand, 0, indices.runoff_ending, working_type,
+		                  target + segment * working_element_size);
+	}
+
+	ufo_repeat_period(scratch, period, length, working_element_size);
+	return region;
+}
+
+//-----------------------------------------------------------------------------
+// Chunk planning
+//-----------------------------------------------------------------------------
+
+// UFOs that come from elsewhere were made with the default load count, since
+// the core does not say what a UFO's load count is.
+#define UFO_DEFAULT_MIN_LOAD_COUNT 0
+
+// Used if the core's low watermark is not set as an option.
+#define UFO_DEFAULT_LOW_WATER_MARK_MB 1024
+
+// Load counts are powers of two by default, so their least common multiple is
+// just the largest of them. Odd load counts could make it grow out of hand,
+// in which case only the result's load units are respected.
+#define UFO_MAX_ALIGNMENT (((R_xlen_t) 1) << 32)
+
+static R_xlen_t __greatest_common_divisor(R_xlen_t a, R_xlen_t b) {
+	while (b != 0) {
+		R_xlen_t remainder = a % b;
+		a = b;
+		b = remainder;
+	}
+	return a;
+}
+
+static R_xlen_t __least_common_multiple(R_xlen_t a, R_xlen_t b) {
+	R_xlen_t multiple = a / __greatest_common_divisor(a, b);
+	if (multiple > UFO_MAX_ALIGNMENT / b) {
+		return 0;
+	}
+	return multiple * b;
+}
+
+static R_xlen_t __chunk_size_from_option(void) {
+	SEXP option = GetOption1(install("ufooperators.chunk_size"));
+	if (option == R_NilValue) {
+		return 0;
+	}
+
+	double chunk_size = asReal(option);
+	if (ISNAN(chunk_size) || chunk_size < 1) {
+		Rf_warning("Option ufooperators.chunk_size should be a positive number, planning chunks instead");
+		return 0;
+	}
+	return (R_xlen_t) chunk_size;
+}
+
+static double __low_water_mark_bytes(void) {
+	SEXP option = GetOption1(install("ufos.low_water_mark_mb"));
+	double megabytes = option == R_NilValue ? NA_REAL : asReal(option);
+	if (ISNAN(megabytes) || megabytes <= 0) {
+		megabytes = UFO_DEFAULT_LOW_WATER_MARK_MB;
+	}
+	return megabytes * 1024 * 1024;
+}
+
+static bool __is_ufo(SEXP vector) {
+	is_ufo_t is_ufo = (is_ufo_t) R_GetCCallable("ufos", "is_ufo");
+	return asLogical(is_ufo(vector)) == TRUE;
+}
+
+R_xlen_t ufo_plan_chunk_size(const SEXP *inputs, int number_of_inputs,
+                             size_t result_element_size, int32_t result_min_load_count,
+                             R_xlen_t result_length) {
+	R_xlen_t chunk_size = __chunk_size_from_option();
+	if (chunk_size > 0) {
+		return chunk_size;
+	}
+
+	// The result is a UFO, so its load units are always respected.
+	size_t bytes_per_element = result_element_size;
+	R_xlen_t result_alignment = result_element_size == 0 ? 1
+		: __select_min_load_count(result_min_load_count, result_element_size);
+	R_xlen_t alignment = result_alignment;
+
+	for (int i = 0; i < number_of_inputs; i++) {
+		SEXPTYPE type = TYPEOF(inputs[i]);
+		if (type != LGLSXP && type != INTSXP && type != REALSXP && type != CPLXSXP && type != RAWSXP && type != STRSXP) {
+			continue;
+		}
+		size_t element_size = __get_element_size(type);
+		bytes_per_element += element_size;
+		if (XLENGTH(inputs[i]) > 1 && __is_ufo(inputs[i])) {
+			alignment = __least_common_multiple(alignment, __select_min_load_count(UFO_DEFAULT_MIN_LOAD_COUNT, element_size));
+			if (alignment == 0) {
+				alignment = result_alignment;
+				break;
+			}
+		}
+	}
+	bytes_per_element = bytes_per_element == 0 ? sizeof(double) : bytes_per_element;
+
+	// Every thread has a chunk of every vector in flight, and all of that
+	// should fit below the low watermark with room to spare, so that the core
+	// does not evict what a chunk is still working on.
+	int threads = ufo_threads_from_option();
+	double budget = __low_water_mark_bytes() / (2.0 * threads);
+	R_xlen_t units = (R_xlen_t) (budget / bytes_per_element) / alignment;
+
+	// There should also be enough chunks to go around the threads.
+	R_xlen_t result_units = (result_length + alignment - 1) / alignment;
+	R_xlen_t units_per_thread = (result_units + threads - 1) / threads;
+	units = MIN(units, units_per_thread);
+
+	units = MAX(units, 1);
+	chunk_size = units * alignment;
+	if (chunk_size > result_length) {
+		chunk_size = MAX(result_length, 1);
+	}
+	return chunk_size;
+}
+
+// Reports the chunk size that operators with these inputs and result would use.
+SEXP ufo_chunk_size(SEXP/*VECSXP*/ inputs, SEXP result, SEXP/*INTSXP*/ min_load_count) {
+	make_sure(TYPEOF(inputs) == VECSXP, "Inputs must be a list of vectors");
+
+	R_xlen_t number_of_inputs = XLENGTH(inputs);
+	SEXP *vectors = (SEXP *) R_alloc(number_of_inputs, sizeof(SEXP));
+	R_xlen_t result_length = 0;
+	for (R_xlen_t i = 0; i < number_of_inputs; i++) {
+		vectors[i] = VECTOR_ELT(inputs, i);
+		result_length = MAX(result_length, XLENGTH(vectors[i]));
+	}
+
+	size_t result_element_size = 0;
+	if (result != R_NilValue) {
+		result_length = XLENGTH(result);
+		result_element_size = __get_element_size(TYPEOF(result));
+	}
+
+	R_xlen_t chunk_size = ufo_plan_chunk_size(vectors, (int) number_of_inputs, result_element_size,
+	                                          __extract_int_or_die(min_load_count), result_length);
+	return ScalarReal((double) chunk_size);
+}
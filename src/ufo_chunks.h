@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdbool.h>
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+#include "ufo_kernels.h"
+
+// A vector taking part in a chunked computation. Operands are recycled to the
+// length of the result, the same way R recycles arguments of operators.
+typedef struct {
+	SEXP        sexp;
+	SEXPTYPE    type;
+	R_xlen_t    length;
+	size_t      element_size;
+	const void *data;   // NULL if the elements are only reachable through
+	                    // the R API (e.g. ALTREP compact sequences)
+
+	// Filled in by ufo_operand_prepare for operands shorter than the result.
+	bool        scalar;       // `value` holds the only element, converted
+	Rcomplex    value;        // big enough for any working type
+	void       *tiles;        // copies of the whole operand, back to back
+	bool        tiles_malloced;
+} ufo_operand_t;
+
+ufo_operand_t ufo_operand_from(SEXP vector);
+
+// Gets a recycled operand ready to be read in chunks of at most `chunk_length`
+// elements of a result of `result_length` elements. Single elements are
+// converted to the working type once and broadcast by the kernels. Short
+// operands are converted once and tiled, so that any chunk is a contiguous
+// run of the tiles, instead of being replicated for every chunk. The tiles
+// live until the end of the .Call, or until ufo_operand_release if
+// `persistent` is set.
+//
+// Must be called on R's thread.
+void ufo_operand_prepare(ufo_operand_t *operand, SEXPTYPE working_type,
+                         R_xlen_t result_length, R_xlen_t chunk_length, bool persistent);
+void ufo_operand_release(ufo_operand_t *operand);
+
+// Whether regions of the operand can only be read through the R API, which
+// keeps the computation on R's thread.
+bool ufo_operand_needs_r(const ufo_operand_t *operand);
+
+// Where the elements for [start, start + length) of the result come from in
+// an operand of `operand_length` elements recycled to the result's length:
+// operand[beginning, ending) followed by operand[0, runoff_ending) if the
+// chunk runs off the end of the operand. Indices are 0-based and the ends
+// are exclusive. `length` must not exceed `operand_length`.
+typedef struct {
+	R_xlen_t beginning;
+	R_xlen_t ending;
+	bool     has_runoff;
+	R_xlen_t runoff_ending;
+} ufo_chunk_indices_t;
+
+ufo_chunk_indices_t ufo_calculate_chunk_indices(R_xlen_t operand_length, R_xlen_t start, R_xlen_t length);
+
+// Fills target[period, length) by repeating target[0, period) over and over,
+// doubling the size of each copy.
+void ufo_repeat_period(void *target, R_xlen_t period, R_xlen_t length, size_t element_size);
+
+// Copies `length` elements of an atomic vector, starting at (recycled) index
+// `start`, into `target` without changing their type. Copies contiguous
+// segments instead of single elements: at most two for the first period of
+// the vector, and then the period is repeated for short vectors.
+void ufo_copy_region(SEXP vector, R_xlen_t start, R_xlen_t length, void *target);
+
+// Returns `length` elements of the operand starting at (recycled) index
+// `start`, represented as `working_type`. The region points directly into the
+// operand or its tiles when possible, is a broadcast of the operand's single
+// element for scalars, and otherwise the elements are copied into `scratch`,
+// which must fit `length` elements of the working type.
+//
+// Only operands for which ufo_operand_needs_r is true are read through the R
+// API, so this is safe to call outside of R's thread for all other operands.
+ufo_region_t ufo_operand_region(const ufo_operand_t *operand, SEXPTYPE working_type,
+                                R_xlen_t start, R_xlen_t length, void *scratch);
+
+// Picks the number of elements per chunk for a computation that reads
+// `inputs` and writes a result of `result_length` elements of
+// `result_element_size` bytes (0 if unknown), created with
+// `result_min_load_count`.
+//
+// The UFO core populates and evicts a UFO's memory in load units of
+// min_load_count elements, so chunk boundaries are aligned to the load units
+// of every UFO involved: a chunk that straddles a unit makes both chunks
+// fault the same unit in. Within that, chunks are as large as fits into the
+// memory the core is willing to keep around (ufos.low_water_mark_mb) with one
+// chunk per thread in flight. The `ufooperators.chunk_size` option overrides
+// the choice.
+R_xlen_t ufo_plan_chunk_size(const SEXP *inputs, int number_of_inputs,
+                             size_t result_element_size, int32_t result_min_load_count,
+                             R_xlen_t result_length);
+
+SEXP ufo_chunk_size(SEXP/*VECSXP*/ inputs, SEXP result, SEXP/*INTSXP*/ min_load_count);
@@ -0,0 +1,479 @@
+#include "ufo_fused.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+#include "safety_first.h"
+#include "helpers.h"
+#include "ufo_empty.h"
+#include "ufo_operators.h"
+#include "ufo_kernels.h"
+#include "ufo_chunks.h"
+#include "ufo_threads.h"
+
+#define MAX(x, y) (x >= y ? x : y)
+#define MIN(x, y) (x >= y ? y : x)
+
+// One node of the flattened expression tree. Nodes are stored in post-order,
+// so children are always evaluated before their parents and the root is last.
+typedef struct {
+	int            arity;        // 0 for leaves
+	int            children[2];
+	ufo_operator_t operator;
+	SEXPTYPE       working_type;
+	SEXPTYPE       result_type;  // for leaves, the type of the vector
+	R_xlen_t       length;
+	ufo_operand_t  operand;      // leaves only
+	void          *values;       // values of the current chunk (inner nodes)
+	void          *scratch[2];   // children converted to the working type
+} fused_node_t;
+
+static inline bool __is_operator_node(SEXP tree) {
+	return TYPEOF(tree) == VECSXP
+		&& (XLENGTH(tree) == 2 || XLENGTH(tree) == 3)
+		&& TYPEOF(VECTOR_ELT(tree, 0)) == STRSXP
+		&& XLENGTH(VECTOR_ELT(tree, 0)) == 1;
+}
+
+static int __count_nodes(SEXP tree) {
+	if (!__is_operator_node(tree)) {
+		return 1;
+	}
+	int count = 1;
+	for (R_xlen_t i = 1; i < XLENGTH(tree); i++) {
+		count += __count_nodes(VECTOR_ELT(tree, i));
+	}
+	return count;
+}
+
+static inline bool __is_unary_operator(ufo_operator_t operator) {
+	return operator == UFO_OP_ADD || operator == UFO_OP_SUBTRACT || operator == UFO_OP_NOT
+		|| ufo_operator_is_math(operator);
+}
+
+// Fills in the nodes for the tree in post-order and returns the index of the
+// tree's root, or -1 if the tree cannot be fused.
+//
+// Intermediate values are computed at the same indices as the final result,
+// which gives the same answer as evaluating operator by operator only if each
+// operand's length divides the length of the node it belongs to. Otherwise
+// (and for empty operands) R's recycling rules have to be applied step by
+// step, so the tree is not fused.
+static int __flatten(SEXP tree, fused_node_t *nodes, int *count) {
+	if (!__is_operator_node(tree)) {
+		switch (TYPEOF(tree)) {
+		case LGLSXP: case INTSXP: case REALSXP: case CPLXSXP: break;
+		default: return -1;
+		}
+		if (XLENGTH(tree) == 0) {
+			return -1;
+		}
+		fused_node_t *leaf = &nodes[*count];
+		leaf->arity = 0;
+		leaf->operand = ufo_operand_from(tree);
+		leaf->result_type = leaf->operand.type;
+		leaf->length = leaf->operand.length;
+		return (*count)++;
+	}
+
+	int arity = XLENGTH(tree) - 1;
+	ufo_operator_t operator = __extract_operator_or_die(VECTOR_ELT(tree, 0));
+
+	int children[2] = { -1, -1 };
+	for (int i = 0; i < arity; i++) {
+		children[i] = __flatten(VECTOR_ELT(tree, i + 1), nodes, count);
+		if (children[i] < 0) {
+			return -1;
+		}
+	}
+
+	fused_node_t *node = &nodes[*count];
+	node->arity = arity;
+	node->children[0] = children[0];
+	node->children[1] = children[1];
+
+	if (arity == 1) {
+		if (!__is_unary_operator(operator)) {
+			return -1;
+		}
+		node->operator = ufo_as_unary_operator(operator);
+		node->working_type = ufo_unary_working_type(node->operator, nodes[children[0]].result_type);
+		node->length = nodes[children[0]].length;
+	} else {
+		node->operator = operator;
+		node->working_type = ufo_binary_working_type(operator, nodes[children[0]].result_type,
+		                                                       nodes[children[1]].result_type);
+		node->length = MAX(nodes[children[0]].length, nodes[children[1]].length);
+	}
+
+	if (node->working_type == NILSXP) {
+		return -1;
+	}
+	node->result_type = ufo_operator_result_type(node->operator, node->working_type);
+
+	for (int i = 0; i < arity; i++) {
+		if (node->length % nodes[children[i]].length != 0) {
+			return -1;
+		}
+	}
+
+	return (*count)++;
+}
+
+// Values of a node's child for the current chunk, as the node's working type.
+// Unary kernels do not broadcast, so scalar leaves are spread out for them.
+static ufo_region_t __child_values(fused_node_t *nodes, fused_node_t *node, int which,
+                                   R_xlen_t start, R_xlen_t length) {
+	fused_node_t *child = &nodes[node->children[which]];
+	void *scratch = node->scratch[which];
+
+	if (child->arity == 0) {
+		ufo_region_t region = ufo_operand_region(&child->operand, node->working_type, start, length, scratch);
+		if (region.broadcast && node->arity == 1) {
+			size_t working_element_size = ufo_working_type_element_size(node->working_type);
+			memcpy(scratch, region.data, working_element_size);
+			ufo_repeat_period(scratch, 1, length, working_element_size);
+			region.data = scratch;
+			region.broadcast = false;
+		}
+		return region;
+	}
+
+	ufo_region_t region = { .data = child->values, .broadcast = false };
+	if (!ufo_same_representation(child->result_type, node->working_type)) {
+		ufo_convert_elements(child->result_type, child->values, node->working_type, scratch, length);
+		region.data = scratch;
+	}
+	return region;
+}
+
+typedef enum {
+	UFO_QUANTIFY_ANY,
+	UFO_QUANTIFY_ALL,
+	UFO_QUANTIFY_ANY_NA,
+} ufo_quantifier_t;
+
+typedef struct {
+	const char       *name;
+	ufo_quantifier_t  quantifier;
+} quantifier_name_t;
+
+static const quantifier_name_t __quantifier_names[] = {
+	{ "any",   UFO_QUANTIFY_ANY    },
+	{ "all",   UFO_QUANTIFY_ALL    },
+	{ "anyNA", UFO_QUANTIFY_ANY_NA },
+	{ NULL,    0                   },
+};
+
+static ufo_quantifier_t __extract_quantifier_or_die(SEXP/*STRSXP*/ quantifier) {
+	if (TYPEOF(quantifier) != STRSXP || XLENGTH(quantifier) != 1) {
+		Rf_error("Invalid quantifier: expecting a single string, but found %s",
+		         type2char(TYPEOF(quantifier)));
+	}
+
+	const char *name = CHAR(STRING_ELT(quantifier, 0));
+	for (const quantifier_name_t *entry = __quantifier_names; entry->name != NULL; entry++) {
+		if (strcmp(entry->name, name) == 0) {
+			return entry->quantifier;
+		}
+	}
+
+	Rf_error("Unknown quantifier: %s", name);
+	return 0; // Mollifies linters.
+}
+
+// Every worker gets its own copy of the nodes, so that they do not share
+// buffers.
+typedef struct {
+	fused_node_t        *nodes;          // number_of_nodes per worker
+	int                  number_of_nodes;
+	int                  threads;
+	R_xlen_t             length;
+	R_xlen_t             chunk_size;
+	unsigned char       *result_data;    // NULL when the result is only quantified
+	size_t               result_element_size;
+	ufo_kernel_status_t *statuses;       // one per worker
+
+	ufo_quantifier_t     quantifier;
+	int                  decided;        // set (atomically) by the chunk that
+	                                     // decides the answer
+	bool                *missing;        // one per worker: saw an NA
+} fused_job_t;
+
+// Computes every inner node for the chunk. The root's values end up in
+// root->values.
+static void __compute_fused_nodes(fused_node_t *nodes, int number_of_nodes,
+                                  R_xlen_t start, R_xlen_t length, ufo_kernel_status_t *status) {
+	for (int i = 0; i < number_of_nodes; i++) {
+		fused_node_t *node = &nodes[i];
+		if (node->arity == 0) {
+			continue;
+		}
+
+		ufo_region_t x = __child_values(nodes, node, 0, start, length);
+		if (node->arity == 1) {
+			ufo_unary_kernel(node->operator, node->working_type, x.data,
+			                 node->values, length, status);
+		} else {
+			ufo_region_t y = __child_values(nodes, node, 1, start, length);
+			ufo_binary_kernel(node->operator, node->working_type, x, y,
+			                  node->values, length, status);
+		}
+	}
+}
+
+static void __compute_fused_chunk(void *context, int worker, R_xlen_t start, R_xlen_t length) {
+	fused_job_t *job = (fused_job_t *) context;
+	fused_node_t *nodes = job->nodes + worker * job->number_of_nodes;
+	fused_node_t *root = &nodes[job->number_of_nodes - 1];
+
+	root->values = job->result_data + start * job->result_element_size;
+	__compute_fused_nodes(nodes, job->number_of_nodes, start, length, &job->statuses[worker]);
+}
+
+// Returns true if the chunk decides the answer on its own: a TRUE for any and
+// anyNA, a FALSE for all.
+static bool __quantify_values(ufo_quantifier_t quantifier, SEXPTYPE type, const void *values,
+                              R_xlen_t length, bool *missing) {
+	if (quantifier != UFO_QUANTIFY_ANY_NA) {
+		const int *logicals = (const int *) values;
+		int decisive = quantifier == UFO_QUANTIFY_ANY ? TRUE : FALSE;
+		for (R_xlen_t i = 0; i < length; i++) {
+			if (logicals[i] == decisive) return true;
+			if (logicals[i] == NA_LOGICAL) *missing = true;
+		}
+		return false;
+	}
+
+	switch (type) {
+	case LGLSXP:
+	case INTSXP: {
+		const int *integers = (const int *) values;
+		for (R_xlen_t i = 0; i < length; i++) {
+			if (integers[i] == NA_INTEGER) return true;
+		}
+		return false;
+	}
+	case REALSXP: {
+		const double *reals = (const double *) values;
+		for (R_xlen_t i = 0; i < length; i++) {
+			if (ISNAN(reals[i])) return true;
+		}
+		return false;
+	}
+	case CPLXSXP: {
+		const Rcomplex *complexes = (const Rcomplex *) values;
+		for (R_xlen_t i = 0; i < length; i++) {
+			if (ISNAN(complexes[i].r) || ISNAN(complexes[i].i)) return true;
+		}
+		return false;
+	}
+	default:
+		return false;
+	}
+}
+
+// Chunks are handed out in order, so once one of them decides the answer, the
+// chunks after it are skipped without being read, and their pages are never
+// faulted in.
+static void __quantify_fused_chunk(void *context, int worker, R_xlen_t start, R_xlen_t length) {
+	fused_job_t *job = (fused_job_t *) context;
+	if (__atomic_load_n(&job->decided, __ATOMIC_RELAXED)) {
+		return;
+	}
+
+	fused_node_t *nodes = job->nodes + worker * job->number_of_nodes;
+	fused_node_t *root = &nodes[job->number_of_nodes - 1];
+
+	const void *values;
+	if (root->arity == 0) {
+		values = ufo_operand_region(&root->operand, root->result_type, start, length, root->scratch[0]).data;
+	} else {
+		__compute_fused_nodes(nodes, job->number_of_nodes, start, length, &job->statuses[worker]);
+		values = root->values;
+	}
+
+	if (__quantify_values(job->quantifier, root->result_type, values, length, &job->missing[worker])) {
+		__atomic_store_n(&job->decided, 1, __ATOMIC_RELAXED);
+	}
+}
+
+// Flattens the tree and sets up the job: chunk size, threads, and per worker
+// copies of the nodes with their buffers. When `quantify`, nothing is written
+// into a result, so the root gets a buffer of its own, and the root may also
+// be a single leaf. Returns false if the tree cannot be fused.
+static bool __prepare_fused_job(SEXP tree, bool quantify, int32_t min_load_count,
+                                SEXP/*REALSXP*/ chunk_size_sexp, fused_job_t *job) {
+	R_xlen_t chunk_size = chunk_size_sexp == R_NilValue ? 0 : __extract_R_xlen_t_or_die(chunk_size_sexp);
+	make_sure(chunk_size_sexp == R_NilValue || chunk_size > 0, "Chunk size must be positive, but is %li", chunk_size);
+
+	if (!quantify && !__is_operator_node(tree)) {
+		return false;
+	}
+
+	int number_of_nodes = __count_nodes(tree);
+	fused_node_t *template = (fused_node_t *) R_alloc(number_of_nodes, sizeof(fused_node_t));
+
+	int count = 0;
+	int root_index = __flatten(tree, template, &count);
+	if (root_index < 0) {
+		return false;
+	}
+	make_sure(root_index == number_of_nodes - 1, "Expression root must be the last node");
+
+	fused_node_t *root = &template[root_index];
+	R_xlen_t result_length = root->length;
+	size_t result_element_size = quantify ? 0 : __get_element_size(root->result_type);
+
+	if (chunk_size_sexp == R_NilValue) {
+		SEXP *leaves = (SEXP *) R_alloc(number_of_nodes, sizeof(SEXP));
+		int number_of_leaves = 0;
+		for (int i = 0; i < number_of_nodes; i++) {
+			if (template[i].arity == 0) {
+				leaves[number_of_leaves++] = template[i].operand.sexp;
+			}
+		}
+		chunk_size = ufo_plan_chunk_size(leaves, number_of_leaves, result_element_size,
+		                                 min_load_count, result_length);
+	}
+
+	R_xlen_t scratch_length = MIN(chunk_size, result_length);
+
+	// Leaves are read at the root's indices, so they are prepared for
+	// recycling to the root's length, as the working type of their parent.
+	// Leaves that can still only be read through the R API keep the
+	// computation on R's thread.
+	int threads = ufo_threads_from_option();
+	if (root->arity == 0) {
+		ufo_operand_prepare(&root->operand, root->result_type, result_length, scratch_length, false);
+		if (ufo_operand_needs_r(&root->operand)) {
+			threads = 1;
+		}
+	}
+	for (int i = 0; i < number_of_nodes; i++) {
+		fused_node_t *node = &template[i];
+		if (node->arity == 0) {
+			continue;
+		}
+		for (int j = 0; j < node->arity; j++) {
+			fused_node_t *child = &template[node->children[j]];
+			if (child->arity != 0) {
+				continue;
+			}
+			ufo_operand_prepare(&child->operand, node->working_type, result_length, scratch_length, false);
+			if (ufo_operand_needs_r(&child->operand)) {
+				threads = 1;
+			}
+		}
+	}
+
+	job->number_of_nodes = number_of_nodes;
+	job->threads = threads;
+	job->length = result_length;
+	job->chunk_size = chunk_size;
+	job->result_data = NULL;
+	job->result_element_size = result_element_size;
+	job->nodes = (fused_node_t *) R_alloc(threads * number_of_nodes, sizeof(fused_node_t));
+	job->statuses = (ufo_kernel_status_t *) R_alloc(threads, sizeof(ufo_kernel_status_t));
+
+	for (int worker = 0; worker < threads; worker++) {
+		job->statuses[worker].integer_overflow = false;
+		job->statuses[worker].lost_accuracy = false;
+		job->statuses[worker].nan_produced = false;
+
+		for (int i = 0; i < number_of_nodes; i++) {
+			fused_node_t *node = &job->nodes[worker * number_of_nodes + i];
+			*node = template[i];
+			if (node->arity == 0) {
+				if (i == root_index) {
+					node->scratch[0] = R_alloc(scratch_length, ufo_working_type_element_size(node->result_type));
+				}
+				continue;
+			}
+			size_t working_element_size = ufo_working_type_element_size(node->working_type);
+			for (int j = 0; j < node->arity; j++) {
+				node->scratch[j] = R_alloc(scratch_length, working_element_size);
+			}
+			if (i != root_index || quantify) {
+				node->values = R_alloc(scratch_length, __get_element_size(node->result_type));
+			}
+		}
+	}
+
+	return true;
+}
+
+static void __report_fused_statuses(fused_job_t *job) {
+	ufo_kernel_status_t status = { .integer_overflow = false, .lost_accuracy = false, .nan_produced = false };
+	for (int worker = 0; worker < job->threads; worker++) {
+		status.integer_overflow |= job->statuses[worker].integer_overflow;
+		status.lost_accuracy    |= job->statuses[worker].lost_accuracy;
+		status.nan_produced     |= job->statuses[worker].nan_produced;
+	}
+	ufo_kernel_status_report(status);
+}
+
+// A NULL chunk size lets ufo_plan_chunk_size pick one from the leaves.
+SEXP ufo_fused(SEXP/*VECSXP*/ tree, SEXP/*INTSXP*/ min_load_count, SEXP/*REALSXP*/ chunk_size_sexp) {
+	fused_job_t job;
+	if (!__prepare_fused_job(tree, false, __extract_int_or_die(min_load_count), chunk_size_sexp, &job)) {
+		return R_NilValue;
+	}
+
+	fused_node_t *root = &job.nodes[job.number_of_nodes - 1];
+	SEXP result = PROTECT(ufo_empty(root->result_type, job.length, false,
+	                                __extract_int_or_die(min_load_count)));
+	job.result_data = (unsigned char *) DATAPTR(result);
+
+	ufo_parallel_for(job.length, job.chunk_size, job.threads, &__compute_fused_chunk, &job);
+	__report_fused_statuses(&job);
+
+	UNPROTECT(1);
+	return result;
+}
+
+SEXP ufo_fused_quantify(SEXP/*STRSXP*/ quantifier, SEXP tree, SEXP/*LGLSXP*/ na_rm_sexp, SEXP/*REALSXP*/ chunk_size_sexp) {
+	fused_job_t job;
+	job.quantifier = __extract_quantifier_or_die(quantifier);
+	bool na_rm = __extract_boolean_or_die(na_rm_sexp);
+
+	if (!__prepare_fused_job(tree, true, 0, chunk_size_sexp, &job)) {
+		return R_NilValue;
+	}
+
+	// any and all take logicals only, base R coerces (and warns about)
+	// anything else.
+	fused_node_t *root = &job.nodes[job.number_of_nodes - 1];
+	if (job.quantifier != UFO_QUANTIFY_ANY_NA && root->result_type != LGLSXP) {
+		return R_NilValue;
+	}
+
+	job.decided = 0;
+	job.missing = (bool *) R_alloc(job.threads, sizeof(bool));
+	for (int worker = 0; worker < job.threads; worker++) {
+		job.missing[worker] = false;
+	}
+
+	ufo_parallel_for(job.length, job.chunk_size, job.threads, &__quantify_fused_chunk, &job);
+	__report_fused_statuses(&job);
+
+	if (job.decided) {
+		return ScalarLogical(job.quantifier == UFO_QUANTIFY_ALL ? FALSE : TRUE);
+	}
+	if (job.quantifier == UFO_QUANTIFY_ANY_NA) {
+		return ScalarLogical(FALSE);
+	}
+
+	bool missing = false;
+	for (int worker = 0; worker < job.threads; worker++) {
+		missing |= job.missing[worker];
+	}
+	if (missing && !na_rm) {
+		return ScalarLogical(NA_LOGICAL);
+	}
+	return ScalarLogical(job.quantifier == UFO_QUANTIFY_ALL ? TRUE : FALSE);
+}
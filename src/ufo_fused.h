@@ -0,0 +1,29 @@
+#pragma once
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+// Evaluates a whole expression of operators in a single chunked pass, without
+// materializing intermediate vectors.
+//
+// The expression is a tree built by `ufo_expr` in R: operator nodes are lists
+// whose first element is the operator's symbol (eg. "+") followed by one or
+// two operand trees, and leaves are numeric vectors. If `chunk_size` is NULL,
+// it is planned from the leaves and the result (see ufo_plan_chunk_size).
+//
+// Returns the result or NULL if the expression cannot be fused, in which case
+// the caller should evaluate it operator by operator.
+SEXP ufo_fused(SEXP/*VECSXP*/ tree, SEXP/*INTSXP*/ min_load_count, SEXP/*REALSXP*/ chunk_size);
+
+// Answers "any", "all" or "anyNA" for the result of an expression tree (or a
+// single vector), like base R does, without materializing the result. Chunks
+// are evaluated in order and evaluation stops at the first chunk that decides
+// the answer (a TRUE for any and anyNA, a FALSE for all), so the pages of the
+// operands beyond it are never read. Since the rest of the expression is not
+// evaluated, warnings (eg. integer overflow) are only reported for the chunks
+// that were. If `chunk_size` is NULL, it is planned from the leaves.
+//
+// Returns NULL if the expression cannot be fused or, for any and all, does
+// not produce logicals, in which case the caller should use base R.
+SEXP ufo_fused_quantify(SEXP/*STRSXP*/ quantifier, SEXP tree, SEXP/*LGLSXP*/ na_rm, SEXP/*REALSXP*/ chunk_size);
@@ -0,0 +1,374 @@
+#include "ufo_group.h"
+
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+#include "safety_first.h"
+#include "helpers.h"
+#include "ufo_empty.h"
+#include "ufo_chunks.h"
+#include "ufo_threads.h"
+#include "ufo_reductions.h"
+#include "ufo_hash.h"
+
+#define MIN(x, y) (x >= y ? y : x)
+
+typedef enum {
+	UFO_GROUP_SUM,
+	UFO_GROUP_MEAN,
+	UFO_GROUP_COUNT,
+} ufo_group_aggregate_t;
+
+typedef struct {
+	const char             *name;
+	ufo_group_aggregate_t   aggregate;
+} group_aggregate_name_t;
+
+static const group_aggregate_name_t __group_aggregate_names[] = {
+	{ "sum",   UFO_GROUP_SUM   },
+	{ "mean",  UFO_GROUP_MEAN  },
+	{ "count", UFO_GROUP_COUNT },
+	{ NULL,    0               },
+};
+
+static ufo_group_aggregate_t __extract_group_aggregate_or_die(SEXP/*STRSXP*/ aggregate) {
+	if (TYPEOF(aggregate) != STRSXP || XLENGTH(aggregate) != 1) {
+		Rf_error("Invalid group aggregate: expecting a single string, but found %s",
+		         type2char(TYPEOF(aggregate)));
+	}
+
+	const char *name = CHAR(STRING_ELT(aggregate, 0));
+	for (const group_aggregate_name_t *entry = __group_aggregate_names; entry->name != NULL; entry++) {
+		if (strcmp(entry->name, name) == 0) {
+			return entry->aggregate;
+		}
+	}
+
+	Rf_error("Unknown group aggregate: %s", name);
+	return 0; // Mollifies linters.
+}
+
+//-----------------------------------------------------------------------------
+// Group states
+//-----------------------------------------------------------------------------
+
+// The aggregate of one group, as far as one worker has seen it. Sums are
+// kept the way ufo_reduce keeps them: integers exactly in 64 bits, doubles
+// compensated in long double. All zeros is an empty group, so states start
+// out in zero-populated UFOs.
+typedef struct {
+	R_xlen_t     size;           // keys
+	R_xlen_t     count;          // values that are neither NA nor NaN
+	bool         has_na;
+	bool         has_nan;        // NaN that are not NA, doubles only
+	bool         overflow;       // of the integer sum
+	int64_t      integer_sum;
+	long double  sum;
+	long double  compensation;
+} group_state_t;
+
+static inline void __aggregate_integer(group_state_t *state, int value) {
+	if (value == NA_INTEGER) {
+		state->has_na = true;
+		return;
+	}
+	state->count++;
+	state->overflow |= __builtin_add_overflow(state->integer_sum, (int64_t) value, &state->integer_sum);
+}
+
+static inline void __aggregate_double(group_state_t *state, double value) {
+	if (ISNAN(value)) {
+		if (R_IsNA(value)) state->has_na = true;
+		else               state->has_nan = true;
+		return;
+	}
+	state->count++;
+	ufo_add_compensated(&state->sum, &state->compensation, value);
+}
+
+static void __merge_states(group_state_t *total, const group_state_t *state) {
+	total->size     += state->size;
+	total->count    += state->count;
+	total->has_na   |= state->has_na;
+	total->has_nan  |= state->has_nan;
+	total->overflow |= state->overflow
+	                || __builtin_add_overflow(total->integer_sum, state->integer_sum, &total->integer_sum);
+	ufo_add_compensated(&total->sum, &total->compensation, state->sum);
+	total->compensation += state->compensation;
+}
+
+//-----------------------------------------------------------------------------
+// Chunked aggregation
+//-----------------------------------------------------------------------------
+
+typedef struct {
+	ufo_group_aggregate_t   aggregate;
+	bool                    dense;
+	int64_t                 offset;
+	const ufo_hash_t       *hash;          // groups unless dense
+	R_xlen_t                groups;
+	ufo_key_source_t        keys;
+	SEXPTYPE                working_type;  // of the values
+	ufo_operand_t           values;
+	group_state_t          *states;        // groups per worker
+	unsigned char          *scratch;
+	size_t                  scratch_size;  // bytes of scratch per worker
+} group_job_t;
+
+// The (0-based) group of a key, or -1 if it has none.
+static inline R_xlen_t __group_of(const group_job_t *job, const void *keys, R_xlen_t i) {
+	if (job->dense) {
+		int key = ((const int *) keys)[i];
+		if (key == NA_INTEGER) return -1;
+		int64_t bin = (int64_t) key - job->offset;
+		return bin >= 1 && bin <= job->groups ? (R_xlen_t) bin - 1 : -1;
+	}
+	const ufo_hash_slot_t *slot = ufo_hash_find(job->hash, ufo_key_at(job->hash->type, keys, i));
+	return slot == NULL ? -1 : slot->group;
+}
+
+static void __group_chunk(void *context, int worker, R_xlen_t start, R_xlen_t length) {
+	group_job_t *job = (group_job_t *) context;
+	group_state_t *states = job->states + worker * job->groups;
+
+	const void *keys = ufo_key_source_region(&job->keys, worker, start, length);
+	const void *values = NULL;
+	if (job->aggregate != UFO_GROUP_COUNT) {
+		values = ufo_operand_region(&job->values, job->working_type, start, length,
+		                            job->scratch + worker * job->scratch_size).data;
+	}
+
+	for (R_xlen_t i = 0; i < length; i++) {
+		R_xlen_t group = __group_of(job, keys, i);
+		if (group < 0) {
+			continue;
+		}
+		group_state_t *state = &states[group];
+		state->size++;
+		if (values == NULL) {
+			continue;
+		}
+		if (job->working_type == INTSXP) {
+			__aggregate_integer(state, ((const int *) values)[i]);
+		} else {
+			__aggregate_double(state, ((const double *) values)[i]);
+		}
+	}
+}
+
+static bool __key_is_na(SEXPTYPE type, ufo_key_t key) {
+	switch (type) {
+	case LGLSXP:
+	case INTSXP:  return key.integer == NA_INTEGER;
+	case REALSXP: return R_IsNA(key.real);
+	case CPLXSXP: return R_IsNA(key.complex.r) || R_IsNA(key.complex.i);
+	default:      return key.string == NA_STRING;
+	}
+}
+
+// Numbers the groups in the order their keys first occur.
+static void __find_groups(ufo_hash_t *hash, SEXP keys, R_xlen_t chunk_size) {
+	R_xlen_t length = XLENGTH(keys);
+	ufo_key_source_t source = ufo_key_source(keys, hash->type, MIN(chunk_size, length), 1);
+	for (R_xlen_t start = 0; start < length; start += chunk_size) {
+		R_xlen_t chunk_length = MIN(chunk_size, length - start);
+		const void *region = ufo_key_source_region(&source, 0, start, chunk_length);
+		for (R_xlen_t i = 0; i < chunk_length; i++) {
+			ufo_key_t key = ufo_key_at(hash->type, region, i);
+			if (!__key_is_na(hash->type, key)) {
+				bool added;
+				ufo_hash_add(hash, key, start + i + 1, &added);
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Results
+//-----------------------------------------------------------------------------
+
+static SEXP __group_keys(const ufo_hash_t *hash) {
+	SEXP keys = PROTECT(allocVector(hash->type, hash->count));
+	for (R_xlen_t i = 0; i < hash->size; i++) {
+		const ufo_hash_slot_t *slot = &hash->slots[i];
+		if (slot->index == 0) {
+			continue;
+		}
+		switch (hash->type) {
+		case LGLSXP:  LOGICAL(keys)[slot->group] = slot->key.integer; break;
+		case INTSXP:  INTEGER(keys)[slot->group] = slot->key.integer; break;
+		case REALSXP: REAL(keys)[slot->group]    = slot->key.real;    break;
+		case CPLXSXP: COMPLEX(keys)[slot->group] = slot->key.complex; break;
+		default:      SET_STRING_ELT(keys, slot->group, slot->key.string);
+		}
+	}
+	UNPROTECT(1);
+	return keys;
+}
+
+static SEXP __group_sizes(const group_state_t *states, R_xlen_t groups) {
+	bool fits = true;
+	for (R_xlen_t group = 0; group < groups; group++) {
+		fits &= states[group].size <= INT_MAX;
+	}
+
+	SEXP sizes = PROTECT(allocVector(fits ? INTSXP : REALSXP, groups));
+	for (R_xlen_t group = 0; group < groups; group++) {
+		if (fits) INTEGER(sizes)[group] = (int) states[group].size;
+		else      REAL(sizes)[group]    = (double) states[group].size;
+	}
+	UNPROTECT(1);
+	return sizes;
+}
+
+// Sums and means of the groups, like ufo_reduce's.
+static SEXP __group_values(ufo_group_aggregate_t aggregate, SEXPTYPE working_type, const group_state_t *states,
+                           R_xlen_t groups, bool na_rm) {
+	bool integer_sums = aggregate == UFO_GROUP_SUM && working_type == INTSXP;
+	SEXP values = PROTECT(allocVector(integer_sums ? INTSXP : REALSXP, groups));
+
+	bool overflow = false;
+	for (R_xlen_t group = 0; group < groups; group++) {
+		const group_state_t *state = &states[group];
+		bool missing = !na_rm && (state->has_na || state->has_nan);
+		double missing_value = state->has_na ? NA_REAL : R_NaN;
+
+		if (integer_sums) {
+			bool overflows = state->overflow || state->integer_sum > INT_MAX || state->integer_sum < -INT_MAX;
+			overflow |= !missing && overflows;
+			INTEGER(values)[group] = missing || overflows ? NA_INTEGER : (int) state->integer_sum;
+		} else if (missing) {
+			REAL(values)[group] = missing_value;
+		} else if (aggregate == UFO_GROUP_SUM) {
+			REAL(values)[group] = (double) ufo_compensated_total(state->sum, state->compensation);
+		} else if (state->count == 0) {
+			REAL(values)[group] = R_NaN;
+		} else if (working_type == INTSXP) {
+			REAL(values)[group] = (double) ((long double) state->integer_sum / state->count);
+		} else {
+			REAL(values)[group] = (double) (ufo_compensated_total(state->sum, state->compensation) / state->count);
+		}
+	}
+
+	if (overflow) {
+		Rf_warning("integer overflow - use sum(as.numeric(.))");
+	}
+	UNPROTECT(1);
+	return values;
+}
+
+static SEXP __group_result(SEXP keys, SEXP values, SEXP sizes) {
+	SEXP result = PROTECT(allocVector(VECSXP, 3));
+	SEXP names = PROTECT(allocVector(STRSXP, 3));
+	SET_VECTOR_ELT(result, 0, keys);
+	SET_VECTOR_ELT(result, 1, values);
+	SET_VECTOR_ELT(result, 2, sizes);
+	SET_STRING_ELT(names, 0, mkChar("keys"));
+	SET_STRING_ELT(names, 1, mkChar("values"));
+	SET_STRING_ELT(names, 2, mkChar("sizes"));
+	setAttrib(result, R_NamesSymbol, names);
+	UNPROTECT(2);
+	return result;
+}
+
+SEXP ufo_group_aggregate(SEXP/*STRSXP*/ aggregate_sexp, SEXP keys, SEXP values, SEXP/*REALSXP*/ offset_sexp,
+                         SEXP/*INTSXP*/ nbins_sexp, SEXP/*LGLSXP*/ na_rm_sexp, SEXP/*REALSXP*/ chunk_size_sexp) {
+	group_job_t job;
+	job.aggregate = __extract_group_aggregate_or_die(aggregate_sexp);
+	job.offset = (int64_t) __extract_R_xlen_t_or_die(offset_sexp);
+	int nbins = __extract_int_or_die(nbins_sexp);
+	make_sure(nbins == NA_INTEGER || nbins >= 0, "Number of bins must be non-negative, but is %i", nbins);
+	bool na_rm = __extract_boolean_or_die(na_rm_sexp);
+	R_xlen_t chunk_size = chunk_size_sexp == R_NilValue ? 0 : __extract_R_xlen_t_or_die(chunk_size_sexp);
+	make_sure(chunk_size_sexp == R_NilValue || chunk_size > 0, "Chunk size must be positive, but is %li", chunk_size);
+
+	job.dense = nbins != NA_INTEGER;
+	SEXPTYPE key_type = job.dense ? INTSXP : ufo_key_type(TYPEOF(keys), TYPEOF(keys));
+	if (key_type == NILSXP || (job.dense && TYPEOF(keys) != INTSXP && TYPEOF(keys) != LGLSXP)) {
+		return R_NilValue;
+	}
+
+	R_xlen_t length = XLENGTH(keys);
+	if (job.aggregate != UFO_GROUP_COUNT) {
+		switch (TYPEOF(values)) {
+		case LGLSXP:
+		case INTSXP:  job.working_type = INTSXP;  break;
+		case REALSXP: job.working_type = REALSXP; break;
+		default:      return R_NilValue;
+		}
+		make_sure(XLENGTH(values) == length, "Keys and values must have the same length, but have %li and %li",
+		          length, XLENGTH(values));
+	}
+
+	if (chunk_size_sexp == R_NilValue) {
+		chunk_size = ufo_plan_chunk_size(&keys, 1, 0, 0, length == 0 ? 1 : length);
+	}
+	R_xlen_t chunk_length = MIN(chunk_size, length);
+
+	// Dense keys are their own groups, so only other keys need a hash table.
+	ufo_hash_t hash;
+	job.hash = NULL;
+	if (job.dense) {
+		job.groups = nbins;
+	} else {
+		hash = ufo_hash_new(key_type, 0, 0);
+		// Empty keys have no groups, and nothing to read them from.
+		if (length > 0) {
+			__find_groups(&hash, keys, chunk_size);
+		}
+		job.groups = hash.count;
+		job.hash = &hash;
+	}
+
+	int threads = ufo_threads_from_option();
+	if (length > 0) {
+		job.keys = ufo_key_source(keys, key_type, chunk_length, threads);
+		threads = ufo_key_source_needs_r(&job.keys) ? 1 : threads;
+		if (job.aggregate != UFO_GROUP_COUNT) {
+			job.values = ufo_operand_from(values);
+			ufo_operand_prepare(&job.values, job.working_type, length, chunk_length, false);
+			threads = ufo_operand_needs_r(&job.values) ? 1 : threads;
+		}
+	}
+
+	// States per thread only pay off while there are fewer of them than
+	// elements in the chunks aggregated into them.
+	if (job.groups > chunk_length) {
+		threads = 1;
+	}
+
+	// One state to spare, so that the UFO is never empty.
+	SEXP states = PROTECT(ufo_empty(RAWSXP, (threads * job.groups + 1) * sizeof(group_state_t), false, 0));
+	job.states = (group_state_t *) DATAPTR(states);
+	job.scratch_size = job.aggregate == UFO_GROUP_COUNT ? 0 : chunk_length * ufo_working_type_element_size(job.working_type);
+	job.scratch = (unsigned char *) R_alloc(threads, job.scratch_size);
+
+	if (length > 0) {
+		ufo_parallel_for(length, chunk_size, threads, &__group_chunk, &job);
+	}
+
+	for (R_xlen_t group = 0; group < job.groups; group++) {
+		for (int worker = 1; worker < threads; worker++) {
+			__merge_states(&job.states[group], &job.states[worker * job.groups + group]);
+		}
+	}
+
+	SEXP group_keys = PROTECT(job.dense ? R_NilValue : __group_keys(&hash));
+	SEXP sizes = PROTECT(__group_sizes(job.states, job.groups));
+	SEXP group_values = PROTECT(job.aggregate == UFO_GROUP_COUNT
+	                            ? sizes : __group_values(job.aggregate, job.working_type, job.states, job.groups, na_rm));
+	SEXP result = __group_result(group_keys, group_values, sizes);
+
+	UNPROTECT(4); // results and states, which are above the hash
+	if (!job.dense) {
+		ufo_hash_free(&hash);
+	}
+	return result;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+// Sums, means or counts (`aggregate`: "sum", "mean" or "count") the values
+// of a logical, integer or double vector per group of equal keys, without
+// splitting the values into per-group copies. Sums and means treat NAs like
+// base R's sum and mean (dropping them if `na_rm`); counts do not read the
+// values, which may be NULL. Elements with NA keys do not belong to any
+// group.
+//
+// Keys and values are streamed together in chunks on `ufooperators.threads`
+// threads, each of which aggregates into group states of its own, and the
+// states are merged at the end. The states live in a UFO rather than on R's
+// heap. Groups are found either
+//  - in a dense array, if `nbins` is not NA: integer (or factor) keys k go
+//    into group k - `offset` if that is between 1 and nbins, like
+//    ufo_tabulate, or
+//  - in a hash table (ufo_hash) of the keys (logical, integer, double,
+//    complex or string), which a first pass over the keys fills on R's
+//    thread, numbering groups in the order their keys first occur.
+// If `chunk_size` is NULL, it is planned from the keys (see
+// ufo_plan_chunk_size).
+//
+// Returns a list of the keys of the groups (NULL for dense groups, which are
+// the bins), the aggregated values, and the sizes of the groups (the number of
+// keys in each). Dense groups include the empty bins. Returns NULL for keys or
+// values of other types, which the caller should hand over to base R.
+SEXP ufo_group_aggregate(SEXP/*STRSXP*/ aggregate, SEXP keys, SEXP values, SEXP/*REALSXP*/ offset,
+                         SEXP/*INTSXP*/ nbins, SEXP/*LGLSXP*/ na_rm, SEXP/*REALSXP*/ chunk_size);
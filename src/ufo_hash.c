@@ -0,0 +1,222 @@
+#include "ufo_hash.h"
+
+#include <string.h>
+
+#include "safety_first.h"
+#include "helpers.h"
+#include "ufo_empty.h"
+#include "rash.h"
+
+//-----------------------------------------------------------------------------
+// Keys
+//-----------------------------------------------------------------------------
+
+// Mirrors requal from unique.c.
+static inline bool __reals_equal(double a, double b) {
+	if (!ISNAN(a) && !ISNAN(b)) return a == b;
+	if (R_IsNA(a) && R_IsNA(b)) return true;
+	if (R_IsNaN(a) && R_IsNaN(b)) return true;
+	return false;
+}
+
+// Mirrors cplx_eq from unique.c: a complex number with an NA part is NA.
+static inline bool __complexes_equal(Rcomplex a, Rcomplex b) {
+	bool a_is_na = R_IsNA(a.r) || R_IsNA(a.i);
+	bool b_is_na = R_IsNA(b.r) || R_IsNA(b.i);
+	if (a_is_na || b_is_na) return a_is_na && b_is_na;
+	return __reals_equal(a.r, b.r) && __reals_equal(a.i, b.i);
+}
+
+bool ufo_keys_equal(SEXPTYPE type, ufo_key_t a, ufo_key_t b) {
+	switch (type) {
+	case LGLSXP:
+	case INTSXP:  return a.integer == b.integer;
+	case REALSXP: return __reals_equal(a.real, b.real);
+	case CPLXSXP: return __complexes_equal(a.complex, b.complex);
+	case STRSXP:  return strings_are_equal(a.string, b.string);
+	default:      Rf_error("Cannot compare keys of type %s", type2char(type));
+	}
+	return false; // Mollifies linters.
+}
+
+// Equal doubles have equal bits once -0 is 0 and all NAs and NaNs are the
+// same NA or NaN (mirrors rhash from unique.c).
+static inline uint64_t __real_bits(double value) {
+	if (value == 0)          value = 0;
+	else if (R_IsNA(value))  value = NA_REAL;
+	else if (R_IsNaN(value)) value = R_NaN;
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+uint64_t ufo_key_hash(SEXPTYPE type, ufo_key_t key) {
+	switch (type) {
+	case LGLSXP:
+	case INTSXP:
+		return (uint64_t) (uint32_t) key.integer;
+	case REALSXP:
+		return __real_bits(key.real);
+	case CPLXSXP:
+		if (R_IsNA(key.complex.r) || R_IsNA(key.complex.i)) {
+			return __real_bits(NA_REAL);
+		}
+		return __real_bits(key.complex.r) ^ (__real_bits(key.complex.i) * 31);
+	case STRSXP: {
+		// Hashed by their contents, so that strings from different vectors
+		// hash the same regardless of their encoding or caching.
+		examined_string_t string;
+		string.sexp = key.string;
+		string.type = CHARSXP;
+		string.length = XLENGTH(key.string);
+		string.uses_bytes = false;
+		string.uses_utf8 = true;
+		string.uses_cache = false;
+		return (uint64_t) generate_string_hash(string, 32);
+	}
+	default:
+		Rf_error("Cannot hash keys of type %s", type2char(type));
+	}
+	return 0; // Mollifies linters.
+}
+
+static inline int __key_rank(SEXPTYPE type) {
+	switch (type) {
+	case LGLSXP:  return 0;
+	case INTSXP:  return 1;
+	case REALSXP: return 2;
+	case CPLXSXP: return 3;
+	default:      return -1;
+	}
+}
+
+SEXPTYPE ufo_key_type(SEXPTYPE a, SEXPTYPE b) {
+	if (a == STRSXP && b == STRSXP) {
+		return STRSXP;
+	}
+	if (__key_rank(a) < 0 || __key_rank(b) < 0) {
+		return NILSXP;
+	}
+	return __key_rank(a) >= __key_rank(b) ? a : b;
+}
+
+ufo_key_source_t ufo_key_source(SEXP vector, SEXPTYPE type, R_xlen_t chunk_length, int threads) {
+	ufo_key_source_t source;
+	source.sexp = vector;
+	source.type = type;
+	source.length = XLENGTH(vector);
+	source.scratch = NULL;
+	source.scratch_size = 0;
+
+	if (type != STRSXP) {
+		source.operand = ufo_operand_from(vector);
+		ufo_operand_prepare(&source.operand, type, source.length, chunk_length, false);
+		source.scratch_size = chunk_length * ufo_working_type_element_size(type);
+		source.scratch = (unsigned char *) R_alloc(threads, source.scratch_size);
+	}
+	return source;
+}
+
+bool ufo_key_source_needs_r(const ufo_key_source_t *source) {
+	return source->type == STRSXP || ufo_operand_needs_r(&source->operand);
+}
+
+const void *ufo_key_source_region(const ufo_key_source_t *source, int worker, R_xlen_t start, R_xlen_t length) {
+	if (source->type == STRSXP) {
+		return ((const SEXP *) DATAPTR_RO(source->sexp)) + start;
+	}
+	return ufo_operand_region(&source->operand, source->type, start, length,
+	                          source->scratch + worker * source->scratch_size).data;
+}
+
+//-----------------------------------------------------------------------------
+// ufo_hash
+//-----------------------------------------------------------------------------
+
+#define UFO_HASH_MIN_BITS 10
+
+// Fibonacci hashing: the top bits of the product depend on all of the key.
+static inline R_xlen_t __scatter(uint64_t hash, int bits) {
+	return (R_xlen_t) ((hash * UINT64_C(0x9E3779B97F4A7C15)) >> (64 - bits));
+}
+
+static void __allocate_slots(ufo_hash_t *hash, int bits) {
+	hash->bits = bits;
+	hash->size = (R_xlen_t) 1 << bits;
+	hash->table = ufo_empty(RAWSXP, hash->size * sizeof(ufo_hash_slot_t), false, hash->min_load_count);
+	hash->slots = (ufo_hash_slot_t *) DATAPTR(hash->table);
+}
+
+ufo_hash_t ufo_hash_new(SEXPTYPE type, R_xlen_t expected_count, int32_t min_load_count) {
+	ufo_hash_t hash;
+	hash.type = type;
+	hash.count = 0;
+	hash.min_load_count = min_load_count;
+
+	// At most half full.
+	int bits = UFO_HASH_MIN_BITS;
+	while (((R_xlen_t) 1 << bits) < 2 * expected_count) {
+		bits++;
+	}
+
+	__allocate_slots(&hash, bits);
+	PROTECT_WITH_INDEX(hash.table, &hash.protect_index);
+	return hash;
+}
+
+void ufo_hash_free(ufo_hash_t *hash) {
+	UNPROTECT(1);
+}
+
+static inline ufo_hash_slot_t *__probe(const ufo_hash_t *hash, ufo_key_t key) {
+	R_xlen_t mask = hash->size - 1;
+	for (R_xlen_t i = __scatter(ufo_key_hash(hash->type, key), hash->bits);; i = (i + 1) & mask) {
+		ufo_hash_slot_t *slot = &hash->slots[i];
+		if (slot->index == 0 || ufo_keys_equal(hash->type, slot->key, key)) {
+			return slot;
+		}
+	}
+}
+
+// Doubles the table and moves the slots over, keeping their groups. The old
+// table stays protected until then, since comparing strings may allocate.
+static void __grow(ufo_hash_t *hash) {
+	PROTECT(hash->table);
+	ufo_hash_slot_t *old_slots = hash->slots;
+	R_xlen_t old_size = hash->size;
+
+	__allocate_slots(hash, hash->bits + 1);
+	REPROTECT(hash->table, hash->protect_index);
+
+	for (R_xlen_t i = 0; i < old_size; i++) {
+		if (old_slots[i].index != 0) {
+			*__probe(hash, old_slots[i].key) = old_slots[i];
+		}
+	}
+
+	UNPROTECT(1);
+}
+
+ufo_hash_slot_t *ufo_hash_add(ufo_hash_t *hash, ufo_key_t key, R_xlen_t index, bool *added) {
+	ufo_hash_slot_t *slot = __probe(hash, key);
+	if (slot->index != 0) {
+		*added = false;
+		return slot;
+	}
+
+	if (2 * (hash->count + 1) > hash->size) {
+		__grow(hash);
+		slot = __probe(hash, key);
+	}
+
+	slot->index = index;
+	slot->group = hash->count++;
+	slot->key = key;
+	*added = true;
+	return slot;
+}
+
+ufo_hash_slot_t *ufo_hash_find(const ufo_hash_t *hash, ufo_key_t key) {
+	ufo_hash_slot_t *slot = __probe(hash, key);
+	return slot->index == 0 ? NULL : slot;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+#include "ufo_chunks.h"
+
+//-----------------------------------------------------------------------------
+// Keys: elements of logical, integer, double, complex and string vectors,
+// compared the way base R's unique and match compare them (unique.c): NA
+// equals NA and NaN equals NaN but not NA, -0 equals 0, and strings are
+// compared by their contents.
+//-----------------------------------------------------------------------------
+
+typedef union {
+	int       integer;   // and logicals
+	double    real;
+	Rcomplex  complex;
+	SEXP      string;    // CHARSXP
+} ufo_key_t;
+
+bool     ufo_keys_equal(SEXPTYPE type, ufo_key_t a, ufo_key_t b);
+uint64_t ufo_key_hash  (SEXPTYPE type, ufo_key_t key);
+
+// The type that keys of vectors of type a and b are compared as, or NILSXP if
+// there is none (eg. strings and numbers).
+SEXPTYPE ufo_key_type(SEXPTYPE a, SEXPTYPE b);
+
+static inline ufo_key_t ufo_key_at(SEXPTYPE type, const void *keys, R_xlen_t i) {
+	ufo_key_t key;
+	switch (type) {
+	case LGLSXP:
+	case INTSXP:  key.integer = ((const int *) keys)[i];      break;
+	case REALSXP: key.real    = ((const double *) keys)[i];   break;
+	case CPLXSXP: key.complex = ((const Rcomplex *) keys)[i]; break;
+	default:      key.string  = ((const SEXP *) keys)[i];     break;
+	}
+	return key;
+}
+
+// A vector read as keys of `type`, a chunk at a time. Numbers are converted
+// to `type` as ufo_operand_region does, so chunks are at most `chunk_length`
+// elements long, and each of `threads` workers gets scratch of its own.
+typedef struct {
+	SEXP            sexp;
+	SEXPTYPE        type;
+	R_xlen_t        length;
+	ufo_operand_t   operand;        // numbers only
+	unsigned char  *scratch;
+	size_t          scratch_size;   // bytes of scratch per worker
+} ufo_key_source_t;
+
+ufo_key_source_t ufo_key_source(SEXP vector, SEXPTYPE type, R_xlen_t chunk_length, int threads);
+
+// Whether keys can only be read on R's thread: strings, and numbers for which
+// ufo_operand_needs_r is true.
+bool ufo_key_source_needs_r(const ufo_key_source_t *source);
+
+// Keys start to start + length - 1, to be read with ufo_key_at.
+const void *ufo_key_source_region(const ufo_key_source_t *source, int worker, R_xlen_t start, R_xlen_t length);
+
+//-----------------------------------------------------------------------------
+// ufo_hash: an open-addressing hash table of distinct keys. The slots live in
+// a raw UFO, outside of R's heap, where the UFO core can write them out under
+// memory pressure. The table grows as keys are added, so it only takes room
+// for the keys that are distinct.
+//
+// Every key remembers where it was first added from (index) and is numbered
+// in the order keys were added (group), which callers use to address per-key
+// state of their own.
+//-----------------------------------------------------------------------------
+
+typedef struct {
+	R_xlen_t   index;    // 1-based, 0 if the slot is empty
+	R_xlen_t   group;    // 0-based
+	ufo_key_t  key;
+} ufo_hash_slot_t;
+
+typedef struct {
+	SEXPTYPE          type;
+	SEXP/*RAWSXP*/    table;
+	PROTECT_INDEX     protect_index;
+	ufo_hash_slot_t  *slots;
+	R_xlen_t          size;     // a power of two
+	int               bits;     // log2(size)
+	R_xlen_t          count;
+	int32_t           min_load_count;
+} ufo_hash_t;
+
+// Creates a table with room for `expected_count` keys before it needs to
+// grow. The table is protected until ufo_hash_free is called, so, like rash,
+// new tables and frees must be nested.
+ufo_hash_t       ufo_hash_new (SEXPTYPE type, R_xlen_t expected_count, int32_t min_load_count);
+void             ufo_hash_free(ufo_hash_t *hash);
+
+// Adds a key found at (1-based) `index` unless it is already there. Returns
+// the key's slot and sets `added` if it is new. Adding may move the slots, so
+// the slot is only valid until the next key is added.
+ufo_hash_slot_t *ufo_hash_add (ufo_hash_t *hash, ufo_key_t key, R_xlen_t index, bool *added);
+
+// Returns the key's slot, or NULL if the key is not in the table.
+ufo_hash_slot_t *ufo_hash_find(const ufo_hash_t *hash, ufo_key_t key);
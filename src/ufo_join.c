@@ -0,0 +1,312 @@
+#include "ufo_join.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+#include "safety_first.h"
+#include "helpers.h"
+#include "ufo_empty.h"
+#include "ufo_chunks.h"
+#include "ufo_threads.h"
+#include "ufo_hash.h"
+
+#define MIN(x, y) (x >= y ? y : x)
+
+//-----------------------------------------------------------------------------
+// Join types
+//-----------------------------------------------------------------------------
+
+typedef enum {
+	UFO_INNER_JOIN,
+	UFO_LEFT_JOIN,
+} ufo_join_type_t;
+
+typedef struct {
+	const char       *name;
+	ufo_join_type_t   type;
+} join_type_name_t;
+
+static const join_type_name_t __join_type_names[] = {
+	{ "inner", UFO_INNER_JOIN },
+	{ "left",  UFO_LEFT_JOIN  },
+	{ NULL,    0              },
+};
+
+static ufo_join_type_t __extract_join_type_or_die(SEXP/*STRSXP*/ type) {
+	if (TYPEOF(type) != STRSXP || XLENGTH(type) != 1) {
+		Rf_error("Invalid join type: expecting a single string, but found %s",
+		         type2char(TYPEOF(type)));
+	}
+
+	const char *name = CHAR(STRING_ELT(type, 0));
+	for (const join_type_name_t *entry = __join_type_names; entry->name != NULL; entry++) {
+		if (strcmp(entry->name, name) == 0) {
+			return entry->type;
+		}
+	}
+
+	Rf_error("Unknown join type: %s", name);
+	return 0; // Mollifies linters.
+}
+
+//-----------------------------------------------------------------------------
+// Build side: distinct keys, each with a chain of the elements it occurs at
+//-----------------------------------------------------------------------------
+
+typedef struct {
+	ufo_hash_t      hash;
+	R_xlen_t        length;
+	R_xlen_t       *next;          // per element: the next (1-based) element
+	                               // with the same key, 0 at the end
+	R_xlen_t       *sizes;         // per key: the length of its chain
+	unsigned char  *matched;       // per key: whether the probes matched it
+} join_table_t;
+
+// Reads the build side twice: first into the hash, and then, once the number
+// of keys is known, into the chains. The hash remembers the first element of
+// every chain. The chains live in raw UFOs, which are zero-populated. They
+// stay on the protection stack for the caller to pop: two entries, also when
+// the build side is empty.
+static void __build(join_table_t *table, SEXP keys, SEXPTYPE type, R_xlen_t chunk_size,
+                    int32_t min_load_count) {
+	table->length = XLENGTH(keys);
+	table->hash = ufo_hash_new(type, 0, min_load_count);
+	if (table->length == 0) {
+		PROTECT(R_NilValue);
+		PROTECT(R_NilValue);
+		table->next = NULL;
+		table->sizes = NULL;
+		table->matched = NULL;
+		return;
+	}
+
+	ufo_key_source_t source = ufo_key_source(keys, type, MIN(chunk_size, table->length), 1);
+	for (R_xlen_t start = 0; start < table->length; start += chunk_size) {
+		R_xlen_t length = MIN(chunk_size, table->length - start);
+		const void *region = ufo_key_source_region(&source, 0, start, length);
+		for (R_xlen_t i = 0; i < length; i++) {
+			bool added;
+			ufo_hash_add(&table->hash, ufo_key_at(type, region, i), start + i + 1, &added);
+		}
+	}
+
+	R_xlen_t count = table->hash.count;
+	SEXP next = PROTECT(ufo_empty(RAWSXP, table->length * sizeof(R_xlen_t), false, min_load_count));
+	SEXP per_key = PROTECT(ufo_empty(RAWSXP, count * (2 * sizeof(R_xlen_t) + 1), false, min_load_count));
+	table->next = (R_xlen_t *) DATAPTR(next);
+	table->sizes = (R_xlen_t *) DATAPTR(per_key);
+	R_xlen_t *tails = table->sizes + count;
+	table->matched = (unsigned char *) (tails + count);
+
+	for (R_xlen_t start = 0; start < table->length; start += chunk_size) {
+		R_xlen_t length = MIN(chunk_size, table->length - start);
+		const void *region = ufo_key_source_region(&source, 0, start, length);
+		for (R_xlen_t i = 0; i < length; i++) {
+			R_xlen_t group = ufo_hash_find(&table->hash, ufo_key_at(type, region, i))->group;
+			if (tails[group] != 0) {
+				table->next[tails[group] - 1] = start + i + 1;
+			}
+			tails[group] = start + i + 1;
+			table->sizes[group]++;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Probe side
+//-----------------------------------------------------------------------------
+
+typedef struct {
+	join_table_t      *table;
+	ufo_key_source_t   probes;
+	R_xlen_t           chunk_size;
+	bool               keep_unmatched;   // left join probing the left
+	bool               mark_matched;     // left join built on the left
+	bool               counting;         // first pass, otherwise writing pairs
+	R_xlen_t          *offsets;          // one per chunk: counts, then offsets
+	bool               long_indices;
+	void              *probe_indices;
+	void              *build_indices;
+} join_job_t;
+
+// Writes a 1-based index, or NA for 0.
+static inline void __set_index(void *indices, bool long_indices, R_xlen_t i, R_xlen_t index) {
+	if (long_indices) {
+		((double *) indices)[i] = index == 0 ? NA_REAL : (double) index;
+	} else {
+		((int *) indices)[i] = index == 0 ? NA_INTEGER : (int) index;
+	}
+}
+
+static void __join_chunk(void *context, int worker, R_xlen_t start, R_xlen_t length) {
+	join_job_t *job = (join_job_t *) context;
+	join_table_t *table = job->table;
+	R_xlen_t chunk = start / job->chunk_size;
+	const void *keys = ufo_key_source_region(&job->probes, worker, start, length);
+
+	if (job->counting) {
+		R_xlen_t count = 0;
+		for (R_xlen_t i = 0; i < length; i++) {
+			const ufo_hash_slot_t *slot = ufo_hash_find(&table->hash, ufo_key_at(table->hash.type, keys, i));
+			if (slot == NULL) {
+				count += job->keep_unmatched;
+				continue;
+			}
+			count += table->sizes[slot->group];
+			if (job->mark_matched) {
+				__atomic_store_n(&table->matched[slot->group], 1, __ATOMIC_RELAXED);
+			}
+		}
+		job->offsets[chunk] = count;
+		return;
+	}
+
+	R_xlen_t offset = job->offsets[chunk];
+	for (R_xlen_t i = 0; i < length; i++) {
+		const ufo_hash_slot_t *slot = ufo_hash_find(&table->hash, ufo_key_at(table->hash.type, keys, i));
+		if (slot == NULL) {
+			if (job->keep_unmatched) {
+				__set_index(job->probe_indices, job->long_indices, offset, start + i + 1);
+				__set_index(job->build_indices, job->long_indices, offset, 0);
+				offset++;
+			}
+			continue;
+		}
+		for (R_xlen_t element = slot->index; element != 0; element = table->next[element - 1]) {
+			__set_index(job->probe_indices, job->long_indices, offset, start + i + 1);
+			__set_index(job->build_indices, job->long_indices, offset, element);
+			offset++;
+		}
+	}
+}
+
+// Counts the build elements whose keys no probe matched.
+static R_xlen_t __count_unmatched(const join_table_t *table) {
+	R_xlen_t count = 0;
+	for (R_xlen_t i = 0; i < table->hash.size; i++) {
+		const ufo_hash_slot_t *slot = &table->hash.slots[i];
+		if (slot->index != 0 && !table->matched[slot->group]) {
+			count += table->sizes[slot->group];
+		}
+	}
+	return count;
+}
+
+// Appends the build elements whose keys no probe matched, in their order,
+// paired with NA.
+static void __write_unmatched(const join_job_t *job, SEXP keys, R_xlen_t offset) {
+	const join_table_t *table = job->table;
+	ufo_key_source_t source = ufo_key_source(keys, table->hash.type, MIN(job->chunk_size, table->length), 1);
+	for (R_xlen_t start = 0; start < table->length; start += job->chunk_size) {
+		R_xlen_t length = MIN(job->chunk_size, table->length - start);
+		const void *region = ufo_key_source_region(&source, 0, start, length);
+		for (R_xlen_t i = 0; i < length; i++) {
+			R_xlen_t group = ufo_hash_find(&table->hash, ufo_key_at(table->hash.type, region, i))->group;
+			if (!table->matched[group]) {
+				__set_index(job->build_indices, job->long_indices, offset, start + i + 1);
+				__set_index(job->probe_indices, job->long_indices, offset, 0);
+				offset++;
+			}
+		}
+	}
+}
+
+static SEXP __join_result(SEXP left_indices, SEXP right_indices) {
+	SEXP result = PROTECT(allocVector(VECSXP, 2));
+	SEXP names = PROTECT(allocVector(STRSXP, 2));
+	SET_VECTOR_ELT(result, 0, left_indices);
+	SET_VECTOR_ELT(result, 1, right_indices);
+	SET_STRING_ELT(names, 0, mkChar("left"));
+	SET_STRING_ELT(names, 1, mkChar("right"));
+	setAttrib(result, R_NamesSymbol, names);
+	UNPROTECT(2);
+	return result;
+}
+
+SEXP ufo_join_indices(SEXP left, SEXP right, SEXP/*STRSXP*/ type_sexp, SEXP/*INTSXP*/ min_load_count_sexp,
+                      SEXP/*REALSXP*/ chunk_size_sexp) {
+	ufo_join_type_t join_type = __extract_join_type_or_die(type_sexp);
+	int32_t min_load_count = __extract_int_or_die(min_load_count_sexp);
+	R_xlen_t chunk_size = chunk_size_sexp == R_NilValue ? 0 : __extract_R_xlen_t_or_die(chunk_size_sexp);
+	make_sure(chunk_size_sexp == R_NilValue || chunk_size > 0, "Chunk size must be positive, but is %li", chunk_size);
+
+	SEXPTYPE key_type = ufo_key_type(TYPEOF(left), TYPEOF(right));
+	if (key_type == NILSXP) {
+		return R_NilValue;
+	}
+
+	// Build on the shorter side and probe with the longer one.
+	bool build_on_left = XLENGTH(left) < XLENGTH(right);
+	SEXP build = build_on_left ? left : right;
+	SEXP probe = build_on_left ? right : left;
+	R_xlen_t probe_length = XLENGTH(probe);
+
+	if (chunk_size_sexp == R_NilValue) {
+		chunk_size = ufo_plan_chunk_size(&probe, 1, 0, min_load_count, probe_length == 0 ? 1 : probe_length);
+	}
+
+	join_table_t table;
+	__build(&table, build, key_type, chunk_size, min_load_count);
+
+	join_job_t job;
+	job.table = &table;
+	job.chunk_size = chunk_size;
+	job.keep_unmatched = join_type == UFO_LEFT_JOIN && !build_on_left;
+	job.mark_matched = join_type == UFO_LEFT_JOIN && build_on_left && table.length > 0;
+	job.long_indices = XLENGTH(left) > R_SHORT_LEN_MAX || XLENGTH(right) > R_SHORT_LEN_MAX;
+
+	R_xlen_t count = 0;
+	R_xlen_t number_of_chunks = (probe_length + chunk_size - 1) / chunk_size;
+	int threads = ufo_threads_from_option();
+	if (probe_length > 0) {
+		job.probes = ufo_key_source(probe, key_type, MIN(chunk_size, probe_length), threads);
+		if (ufo_key_source_needs_r(&job.probes)) {
+			threads = 1;
+		}
+		job.offsets = (R_xlen_t *) R_alloc(number_of_chunks, sizeof(R_xlen_t));
+
+		job.counting = true;
+		ufo_parallel_for(probe_length, chunk_size, threads, &__join_chunk, &job);
+
+		for (R_xlen_t chunk = 0; chunk < number_of_chunks; chunk++) {
+			R_xlen_t chunk_count = job.offsets[chunk];
+			job.offsets[chunk] = count;
+			count += chunk_count;
+		}
+	}
+
+	R_xlen_t unmatched = 0;
+	if (job.mark_matched) {
+		unmatched = __count_unmatched(&table);
+	}
+
+	SEXPTYPE index_type = job.long_indices ? REALSXP : INTSXP;
+	SEXP left_indices, right_indices;
+	if (count + unmatched == 0) {
+		left_indices = PROTECT(allocVector(index_type, 0));
+		right_indices = PROTECT(allocVector(index_type, 0));
+	} else {
+		left_indices = PROTECT(ufo_empty(index_type, count + unmatched, false, min_load_count));
+		right_indices = PROTECT(ufo_empty(index_type, count + unmatched, false, min_load_count));
+		job.probe_indices = DATAPTR(build_on_left ? right_indices : left_indices);
+		job.build_indices = DATAPTR(build_on_left ? left_indices : right_indices);
+
+		if (count > 0) {
+			job.counting = false;
+			ufo_parallel_for(probe_length, chunk_size, threads, &__join_chunk, &job);
+		}
+		if (unmatched > 0) {
+			__write_unmatched(&job, build, count);
+		}
+	}
+
+	SEXP result = __join_result(left_indices, right_indices);
+
+	UNPROTECT(4); // indices and chains, which are above the hash
+	ufo_hash_free(&table.hash);
+	return result;
+}
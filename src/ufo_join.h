@@ -0,0 +1,31 @@
+#pragma once
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+// Joins two key vectors (logical, integer, double, complex or string) and
+// returns the pairs of (1-based) indices of their matching elements, as a
+// list of two UFOs, `left` and `right`, suitable for subsetting either side.
+// Keys are compared the way base R's match compares them (see ufo_hash.h),
+// so NA keys match each other like they do in base R's merge.
+//
+// `type` is "inner", for only the matching pairs, or "left", which also
+// keeps every left element without a match, paired with NA.
+//
+// The shorter side is read into a hash table (ufo_hash) with a chain of the
+// elements of every key, all of which live in UFOs rather than on R's heap.
+// The longer side is streamed against it in chunks, on `ufooperators.threads`
+// threads unless its keys can only be read through the R API (eg. strings):
+// a first pass counts the pairs of every chunk and a second writes them. The
+// pairs follow the order of the longer side, and for every one of its elements
+// the matching elements of the shorter side come in their order. In a left
+// join built on the left, the unmatched left elements follow at the end, in
+// their order. Indices are integers, or doubles if either side is a long
+// vector. If `chunk_size` is NULL, it is planned from the longer side (see
+// ufo_plan_chunk_size).
+//
+// Returns NULL if the keys have no common type here (eg. numbers and strings),
+// which the caller should hand over to base R.
+SEXP ufo_join_indices(SEXP left, SEXP right, SEXP/*STRSXP*/ type, SEXP/*INTSXP*/ min_load_count,
+                      SEXP/*REALSXP*/ chunk_size);
@@ -0,0 +1,585 @@
+#include "ufo_kernels.h"
+
+#include <math.h>
+#include <float.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+#include <Rmath.h>
+
+#include "safety_first.h"
+#include "ufo_simd.h"
+
+// Mirrors R_INT_MIN from arithmetic.c: INT_MIN is taken by NA_INTEGER.
+#define UFO_INT_MIN (-INT_MAX)
+
+//-----------------------------------------------------------------------------
+// Operator lookup and bookkeeping
+//-----------------------------------------------------------------------------
+
+typedef struct {
+	const char     *symbol;
+	ufo_operator_t  operator;
+} operator_symbol_t;
+
+static const operator_symbol_t __operator_symbols[] = {
+	{"+",       UFO_OP_ADD},
+	{"-",       UFO_OP_SUBTRACT},
+	{"*",       UFO_OP_MULTIPLY},
+	{"/",       UFO_OP_DIVIDE},
+	{"^",       UFO_OP_POWER},
+	{"%%",      UFO_OP_MODULO},
+	{"%/%",     UFO_OP_INT_DIVIDE},
+	{"<",       UFO_OP_LESS},
+	{"<=",      UFO_OP_LESS_EQUAL},
+	{">",       UFO_OP_GREATER},
+	{">=",      UFO_OP_GREATER_EQUAL},
+	{"==",      UFO_OP_EQUAL},
+	{"!=",      UFO_OP_UNEQUAL},
+	{"&",       UFO_OP_AND},
+	{"|",       UFO_OP_OR},
+	{"!",       UFO_OP_NOT},
+	{"sqrt",    UFO_OP_SQRT},
+	{"exp",     UFO_OP_EXP},
+	{"log",     UFO_OP_LOG},
+	{"abs",     UFO_OP_ABS},
+	{"sign",    UFO_OP_SIGN},
+	{"floor",   UFO_OP_FLOOR},
+	{"ceiling", UFO_OP_CEILING},
+	{"trunc",   UFO_OP_TRUNC},
+	{"round",   UFO_OP_ROUND},
+	{NULL,      0},
+};
+
+// Binary symbols and Math functions only: the unary operators are told apart
+// by the caller.
+ufo_operator_t __extract_operator_or_die(SEXP/*STRSXP*/ operator) {
+	if (TYPEOF(operator) != STRSXP || XLENGTH(operator) != 1) {
+		Rf_error("Invalid operator: expecting a single string, but found %s",
+		         type2char(TYPEOF(operator)));
+	}
+
+	const char *symbol = CHAR(STRING_ELT(operator, 0));
+	for (const operator_symbol_t *entry = __operator_symbols; entry->symbol != NULL; entry++) {
+		if (strcmp(entry->symbol, symbol) == 0) {
+			return entry->operator;
+		}
+	}
+
+	Rf_error("Unknown operator: %s", symbol);
+	return 0; // Mollifies linters.
+}
+
+bool ufo_operator_is_arithmetic(ufo_operator_t operator) {
+	switch (operator) {
+	case UFO_OP_ADD:
+	case UFO_OP_SUBTRACT:
+	case UFO_OP_MULTIPLY:
+	case UFO_OP_DIVIDE:
+	case UFO_OP_POWER:
+	case UFO_OP_MODULO:
+	case UFO_OP_INT_DIVIDE:
+	case UFO_OP_PLUS:
+	case UFO_OP_MINUS:
+		return true;
+	default:
+		// Math functions compute numbers too.
+		return ufo_operator_is_math(operator);
+	}
+}
+
+bool ufo_operator_is_math(ufo_operator_t operator) {
+	switch (operator) {
+	case UFO_OP_SQRT:
+	case UFO_OP_EXP:
+	case UFO_OP_LOG:
+	case UFO_OP_ABS:
+	case UFO_OP_SIGN:
+	case UFO_OP_FLOOR:
+	case UFO_OP_CEILING:
+	case UFO_OP_TRUNC:
+	case UFO_OP_ROUND:
+		return true;
+	default:
+		return false;
+	}
+}
+
+void ufo_kernel_status_report(ufo_kernel_status_t status) {
+	if (status.integer_overflow) {
+		Rf_warning("NAs produced by integer overflow");
+	}
+	if (status.lost_accuracy) {
+		Rf_warning("probable complete loss of accuracy in modulus");
+	}
+	if (status.nan_produced) {
+		Rf_warning("NaNs produced");
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Conversions between working types (mirror coerceVector)
+//-----------------------------------------------------------------------------
+
+size_t ufo_working_type_element_size(SEXPTYPE type) {
+	switch (type) {
+	case LGLSXP:  return sizeof(int);
+	case INTSXP:  return sizeof(int);
+	case REALSXP: return sizeof(double);
+	case CPLXSXP: return sizeof(Rcomplex);
+	default:      Rf_error("Not a working type: %s", type2char(type));
+	}
+	return 0; // Mollifies linters.
+}
+
+// Logicals are stored as ints, so they can be used as integers without
+// conversion. The reverse is not true: 5L is not TRUE.
+bool ufo_same_representation(SEXPTYPE from, SEXPTYPE to) {
+	return from == to || (from == LGLSXP && to == INTSXP);
+}
+
+static inline double __integer_as_real(int value) {
+	return value == NA_INTEGER ? NA_REAL : (double) value;
+}
+
+static inline Rcomplex __integer_as_complex(int value) {
+	Rcomplex result;
+	result.r = value == NA_INTEGER ? NA_REAL : (double) value;
+	result.i = value == NA_INTEGER ? NA_REAL : 0;
+	return result;
+}
+
+static inline Rcomplex __real_as_complex(double value) {
+	Rcomplex result;
+	result.r = value;
+	result.i = 0;
+	return result;
+}
+
+static inline int __integer_as_logical(int value) {
+	return value == NA_INTEGER ? NA_LOGICAL : value != 0;
+}
+
+static inline int __real_as_logical(double value) {
+	return ISNAN(value) ? NA_LOGICAL : value != 0;
+}
+
+static inline int __complex_as_logical(Rcomplex value) {
+	return (ISNAN(value.r) || ISNAN(value.i)) ? NA_LOGICAL : (value.r != 0 || value.i != 0);
+}
+
+void ufo_convert_elements(SEXPTYPE from_type, const void *source, SEXPTYPE to_type, void *target, R_xlen_t length) {
+	if (ufo_same_representation(from_type, to_type)) {
+		memcpy(target, source, length * ufo_working_type_element_size(to_type));
+		return;
+	}
+
+	switch (to_type) {
+	case LGLSXP: {
+		int *out = (int *) target;
+		switch (from_type) {
+		case INTSXP:  for (R_xlen_t i = 0; i < length; i++) out[i] = __integer_as_logical(((const int *) source)[i]);      return;
+		case REALSXP: for (R_xlen_t i = 0; i < length; i++) out[i] = __real_as_logical(((const double *) source)[i]);      return;
+		case CPLXSXP: for (R_xlen_t i = 0; i < length; i++) out[i] = __complex_as_logical(((const Rcomplex *) source)[i]); return;
+		}
+		break;
+	}
+	case REALSXP: {
+		double *out = (double *) target;
+		switch (from_type) {
+		case LGLSXP:
+		case INTSXP:  for (R_xlen_t i = 0; i < length; i++) out[i] = __integer_as_real(((const int *) source)[i]); return;
+		}
+		break;
+	}
+	case CPLXSXP: {
+		Rcomplex *out = (Rcomplex *) target;
+		switch (from_type) {
+		case LGLSXP:
+		case INTSXP:  for (R_xlen_t i = 0; i < length; i++) out[i] = __integer_as_complex(((const int *) source)[i]); return;
+		case REALSXP: for (R_xlen_t i = 0; i < length; i++) out[i] = __real_as_complex(((const double *) source)[i]); return;
+		}
+		break;
+	}}
+
+	Rf_error("Cannot convert %s to %s", type2char(from_type), type2char(to_type));
+}
+
+//-----------------------------------------------------------------------------
+// Element operations (mirror arithmetic.c, relop.c, and logic.c)
+//-----------------------------------------------------------------------------
+
+static inline int __integer_plus(int x, int y, bool *overflow) {
+	if (x == NA_INTEGER || y == NA_INTEGER) return NA_INTEGER;
+	int64_t z = (int64_t) x + (int64_t) y;
+	if (z > INT_MAX || z < UFO_INT_MIN) {
+		*overflow = true;
+		return NA_INTEGER;
+	}
+	return (int) z;
+}
+
+static inline int __integer_minus(int x, int y, bool *overflow) {
+	if (x == NA_INTEGER || y == NA_INTEGER) return NA_INTEGER;
+	int64_t z = (int64_t) x - (int64_t) y;
+	if (z > INT_MAX || z < UFO_INT_MIN) {
+		*overflow = true;
+		return NA_INTEGER;
+	}
+	return (int) z;
+}
+
+static inline int __integer_times(int x, int y, bool *overflow) {
+	if (x == NA_INTEGER || y == NA_INTEGER) return NA_INTEGER;
+	int64_t z = (int64_t) x * (int64_t) y;
+	if (z > INT_MAX || z < UFO_INT_MIN) {
+		*overflow = true;
+		return NA_INTEGER;
+	}
+	return (int) z;
+}
+
+// Mirrors myfmod from arithmetic.c.
+static inline double __real_modulo(double x, double y, bool *lost_accuracy) {
+	if (y == 0.0) return R_NaN;
+	if (fabs(y) * DBL_EPSILON > 1 && R_FINITE(x) && fabs(x) <= fabs(y)) {
+		return (fabs(x) == fabs(y)) ? 0
+		     : ((x < 0 && y > 0) || (y < 0 && x > 0)) ? x + y
+		     : x;
+	}
+	double q = x / y;
+	if (R_FINITE(q) && (fabs(q) * DBL_EPSILON > 1)) {
+		*lost_accuracy = true;
+	}
+	long double tmp = (long double) x - floor(q) * (long double) y;
+	return (double) (tmp - floorl(tmp / y) * y);
+}
+
+// Mirrors myfloor from arithmetic.c.
+static inline double __real_int_divide(double x, double y) {
+	double q = x / y;
+	if (y == 0.0 || fabs(q) * DBL_EPSILON > 1 || !R_FINITE(q)) {
+		return q;
+	}
+	if (fabs(q) < 1) {
+		return (q < 0) ? -1
+		     : ((x < 0 && y > 0) || (x > 0 && y < 0)) ? -1
+		     : 0;
+	}
+	long double tmp = (long double) x - floor(q) * (long double) y;
+	return (double) (floor(q) + floorl(tmp / y));
+}
+
+static inline int __integer_modulo(int x, int y, bool *lost_accuracy) {
+	if (x == NA_INTEGER || y == NA_INTEGER || y == 0) return NA_INTEGER;
+	return (x >= 0 && y > 0) ? x % y : (int) __real_modulo((double) x, (double) y, lost_accuracy);
+}
+
+static inline int __integer_int_divide(int x, int y) {
+	if (x == NA_INTEGER || y == NA_INTEGER || y == 0) return NA_INTEGER;
+	return (int) floor((double) x / (double) y);
+}
+
+// Mirrors R_POW from arithmetic.c.
+static inline double __real_power(double x, double y) {
+	return y == 2.0 ? x * x : R_pow(x, y);
+}
+
+static inline Rcomplex __complex_times(Rcomplex x, Rcomplex y) {
+	Rcomplex result;
+	result.r = x.r * y.r - x.i * y.i;
+	result.i = x.r * y.i + x.i * y.r;
+	return result;
+}
+
+// Mirrors complex_div from complex.c.
+static inline Rcomplex __complex_divide(Rcomplex x, Rcomplex y) {
+	Rcomplex result;
+	double ratio, denominator;
+	double abs_real      = y.r < 0 ? -y.r : y.r;
+	double abs_imaginary = y.i < 0 ? -y.i : y.i;
+	if (abs_real <= abs_imaginary) {
+		ratio = y.r / y.i;
+		denominator = y.i * (1 + ratio * ratio);
+		result.r = (x.r * ratio + x.i) / denominator;
+		result.i = (x.i * ratio - x.r) / denominator;
+	} else {
+		ratio = y.i / y.r;
+		denominator = y.r * (1 + ratio * ratio);
+		result.r = (x.r + x.i * ratio) / denominator;
+		result.i = (x.i - x.r * ratio) / denominator;
+	}
+	return result;
+}
+
+static inline int __complex_equal(Rcomplex x, Rcomplex y) {
+	if (ISNAN(x.r) || ISNAN(x.i) || ISNAN(y.r) || ISNAN(y.i)) return NA_LOGICAL;
+	return x.r == y.r && x.i == y.i;
+}
+
+static inline int __logical_and(int x, int y) {
+	if (x == 0 || y == 0) return 0;
+	if (x == NA_LOGICAL || y == NA_LOGICAL) return NA_LOGICAL;
+	return 1;
+}
+
+static inline int __logical_or(int x, int y) {
+	if ((x != NA_LOGICAL && x) || (y != NA_LOGICAL && y)) return 1;
+	if (x == 0 && y == 0) return 0;
+	return NA_LOGICAL;
+}
+
+//-----------------------------------------------------------------------------
+// Binary kernels: target holds `length` elements, and so do x and y unless
+// their stride is 0, in which case their single element is broadcast
+//-----------------------------------------------------------------------------
+
+#define __INTEGER_COMPARISON(comparison) \
+	for (R_xlen_t i = 0; i < length; i++) { \
+		out[i] = (x[i * xs] == NA_INTEGER || y[i * ys] == NA_INTEGER) ? NA_LOGICAL : (x[i * xs] comparison y[i * ys]); \
+	}
+
+#define __REAL_COMPARISON(comparison) \
+	for (R_xlen_t i = 0; i < length; i++) { \
+		out[i] = (ISNAN(x[i * xs]) || ISNAN(y[i * ys])) ? NA_LOGICAL : (x[i * xs] comparison y[i * ys]); \
+	}
+
+static void __logical_binary_kernel(ufo_operator_t operator,
+                                    const int *restrict x, R_xlen_t xs,
+                                    const int *restrict y, R_xlen_t ys, int *restrict out,
+                                    R_xlen_t length, ufo_kernel_status_t *status) {
+	switch (operator) {
+	case UFO_OP_AND: for (R_xlen_t i = 0; i < length; i++) out[i] = __logical_and(x[i * xs], y[i * ys]); return;
+	case UFO_OP_OR:  for (R_xlen_t i = 0; i < length; i++) out[i] = __logical_or (x[i * xs], y[i * ys]); return;
+	default:         Rf_error("Operator %i is not supported for logical vectors", operator);
+	}
+}
+
+static void __integer_binary_kernel(ufo_operator_t operator,
+                                    const int *restrict x, R_xlen_t xs,
+                                    const int *restrict y, R_xlen_t ys, int *restrict out,
+                                    R_xlen_t length, ufo_kernel_status_t *status) {
+	bool overflow = false;
+	bool lost_accuracy = false;
+
+	switch (operator) {
+	case UFO_OP_ADD:           for (R_xlen_t i = 0; i < length; i++) out[i] = __integer_plus (x[i * xs], y[i * ys], &overflow);            break;
+	case UFO_OP_SUBTRACT:      for (R_xlen_t i = 0; i < length; i++) out[i] = __integer_minus(x[i * xs], y[i * ys], &overflow);            break;
+	case UFO_OP_MULTIPLY:      for (R_xlen_t i = 0; i < length; i++) out[i] = __integer_times(x[i * xs], y[i * ys], &overflow);            break;
+	case UFO_OP_MODULO:        for (R_xlen_t i = 0; i < length; i++) out[i] = __integer_modulo(x[i * xs], y[i * ys], &lost_accuracy);      break;
+	case UFO_OP_INT_DIVIDE:    for (R_xlen_t i = 0; i < length; i++) out[i] = __integer_int_divide(x[i * xs], y[i * ys]);                  break;
+	case UFO_OP_LESS:          __INTEGER_COMPARISON(<);  break;
+	case UFO_OP_LESS_EQUAL:    __INTEGER_COMPARISON(<=); break;
+	case UFO_OP_GREATER:       __INTEGER_COMPARISON(>);  break;
+	case UFO_OP_GREATER_EQUAL: __INTEGER_COMPARISON(>=); break;
+	case UFO_OP_EQUAL:         __INTEGER_COMPARISON(==); break;
+	case UFO_OP_UNEQUAL:       __INTEGER_COMPARISON(!=); break;
+	default:                   Rf_error("Operator %i is not supported for integer vectors", operator);
+	}
+
+	status->integer_overflow |= overflow;
+	status->lost_accuracy    |= lost_accuracy;
+}
+
+static void __real_binary_kernel(ufo_operator_t operator,
+                                 const double *restrict x, R_xlen_t xs,
+                                 const double *restrict y, R_xlen_t ys, void *restrict target,
+                                 R_xlen_t length, ufo_kernel_status_t *status) {
+	bool lost_accuracy = false;
+	double *restrict result = (double *) target;
+	int    *restrict out    = (int *)    target;
+
+	switch (operator) {
+	case UFO_OP_ADD:           for (R_xlen_t i = 0; i < length; i++) result[i] = x[i * xs] + y[i * ys];                                break;
+	case UFO_OP_SUBTRACT:      for (R_xlen_t i = 0; i < length; i++) result[i] = x[i * xs] - y[i * ys];                                break;
+	case UFO_OP_MULTIPLY:      for (R_xlen_t i = 0; i < length; i++) result[i] = x[i * xs] * y[i * ys];                                break;
+	case UFO_OP_DIVIDE:        for (R_xlen_t i = 0; i < length; i++) result[i] = x[i * xs] / y[i * ys];                                break;
+	case UFO_OP_POWER:         for (R_xlen_t i = 0; i < length; i++) result[i] = __real_power(x[i * xs], y[i * ys]);                   break;
+	case UFO_OP_MODULO:        for (R_xlen_t i = 0; i < length; i++) result[i] = __real_modulo(x[i * xs], y[i * ys], &lost_accuracy);  break;
+	case UFO_OP_INT_DIVIDE:    for (R_xlen_t i = 0; i < length; i++) result[i] = __real_int_divide(x[i * xs], y[i * ys]);              break;
+	case UFO_OP_LESS:          __REAL_COMPARISON(<);  break;
+	case UFO_OP_LESS_EQUAL:    __REAL_COMPARISON(<=); break;
+	case UFO_OP_GREATER:       __REAL_COMPARISON(>);  break;
+	case UFO_OP_GREATER_EQUAL: __REAL_COMPARISON(>=); break;
+	case UFO_OP_EQUAL:         __REAL_COMPARISON(==); break;
+	case UFO_OP_UNEQUAL:       __REAL_COMPARISON(!=); break;
+	default:                   Rf_error("Operator %i is not supported for double vectors", operator);
+	}
+
+	status->lost_accuracy |= lost_accuracy;
+}
+
+static void __complex_binary_kernel(ufo_operator_t operator,
+                                    const Rcomplex *restrict x, R_xlen_t xs,
+                                    const Rcomplex *restrict y, R_xlen_t ys, void *restrict target,
+                                    R_xlen_t length, ufo_kernel_status_t *status) {
+	Rcomplex *restrict result = (Rcomplex *) target;
+	int      *restrict out    = (int *)      target;
+
+	switch (operator) {
+	case UFO_OP_ADD:
+		for (R_xlen_t i = 0; i < length; i++) {
+			result[i].r = x[i * xs].r + y[i * ys].r;
+			result[i].i = x[i * xs].i + y[i * ys].i;
+		}
+		return;
+	case UFO_OP_SUBTRACT:
+		for (R_xlen_t i = 0; i < length; i++) {
+			result[i].r = x[i * xs].r - y[i * ys].r;
+			result[i].i = x[i * xs].i - y[i * ys].i;
+		}
+		return;
+	case UFO_OP_MULTIPLY: for (R_xlen_t i = 0; i < length; i++) result[i] = __complex_times (x[i * xs], y[i * ys]);  return;
+	case UFO_OP_DIVIDE:   for (R_xlen_t i = 0; i < length; i++) result[i] = __complex_divide(x[i * xs], y[i * ys]);  return;
+	case UFO_OP_EQUAL:    for (R_xlen_t i = 0; i < length; i++) out[i] = __complex_equal(x[i * xs], y[i * ys]);      return;
+	case UFO_OP_UNEQUAL:
+		for (R_xlen_t i = 0; i < length; i++) {
+			int equal = __complex_equal(x[i * xs], y[i * ys]);
+			out[i] = equal == NA_LOGICAL ? NA_LOGICAL : !equal;
+		}
+		return;
+	default:
+		Rf_error("Operator %i is not supported for complex vectors", operator);
+	}
+}
+
+void ufo_binary_kernel(ufo_operator_t operator, SEXPTYPE working_type,
+                       ufo_region_t x, ufo_region_t y, void *target,
+                       R_xlen_t length, ufo_kernel_status_t *status) {
+
+	// Vectorized kernels take care of as much as they can, the scalar kernels
+	// below finish off the remainder. Broadcast operands stay where they are.
+	R_xlen_t done = ufo_simd_binary_kernel(operator, working_type, x, y, target, length, status);
+	if (done > 0) {
+		size_t working_element_size = ufo_working_type_element_size(working_type);
+		size_t result_element_size  = ufo_operator_is_arithmetic(operator) ? working_element_size : sizeof(int);
+		if (!x.broadcast) x.data = (const unsigned char *) x.data + done * working_element_size;
+		if (!y.broadcast) y.data = (const unsigned char *) y.data + done * working_element_size;
+		target = (unsigned char *) target + done * result_element_size;
+		length -= done;
+	}
+
+	R_xlen_t xs = x.broadcast ? 0 : 1;
+	R_xlen_t ys = y.broadcast ? 0 : 1;
+
+	switch (working_type) {
+	case LGLSXP:  __logical_binary_kernel(operator, (const int *)      x.data, xs, (const int *)      y.data, ys, (int *) target, length, status); return;
+	case INTSXP:  __integer_binary_kernel(operator, (const int *)      x.data, xs, (const int *)      y.data, ys, (int *) target, length, status); return;
+	case REALSXP: __real_binary_kernel   (operator, (const double *)   x.data, xs, (const double *)   y.data, ys, target,         length, status); return;
+	case CPLXSXP: __complex_binary_kernel(operator, (const Rcomplex *) x.data, xs, (const Rcomplex *) y.data, ys, target,         length, status); return;
+	default:      Rf_error("No binary kernel for working type %s", type2char(working_type));
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Math kernels: functions of the Math group, with R's NA and NaN semantics
+//-----------------------------------------------------------------------------
+
+// Only abs and round keep integers as integers; the others work on doubles.
+static void __integer_math_kernel(ufo_operator_t operator, const int *x, int *out, R_xlen_t length) {
+	switch (operator) {
+	case UFO_OP_ABS:   for (R_xlen_t i = 0; i < length; i++) out[i] = x[i] == NA_INTEGER ? NA_INTEGER : abs(x[i]);  return;
+	case UFO_OP_ROUND: memcpy(out, x, length * sizeof(int));                                                        return;
+	default:           Rf_error("No integer math kernel for operator %i", operator);
+	}
+}
+
+static inline double __real_sign(double x) {
+	if (ISNAN(x)) return x;
+	return x > 0 ? 1 : (x < 0 ? -1 : 0);
+}
+
+// round() without digits rounds half to even, like nearbyint in the default
+// rounding mode.
+static void __real_math_kernel(ufo_operator_t operator, const double *x, double *out,
+                               R_xlen_t length, ufo_kernel_status_t *status) {
+	switch (operator) {
+	case UFO_OP_SQRT:    for (R_xlen_t i = 0; i < length; i++) out[i] = sqrt(x[i]);         break;
+	case UFO_OP_EXP:     for (R_xlen_t i = 0; i < length; i++) out[i] = exp(x[i]);          break;
+	case UFO_OP_LOG:     for (R_xlen_t i = 0; i < length; i++) out[i] = log(x[i]);          break;
+	case UFO_OP_ABS:     for (R_xlen_t i = 0; i < length; i++) out[i] = fabs(x[i]);         break;
+	case UFO_OP_SIGN:    for (R_xlen_t i = 0; i < length; i++) out[i] = __real_sign(x[i]);  break;
+	case UFO_OP_FLOOR:   for (R_xlen_t i = 0; i < length; i++) out[i] = floor(x[i]);        break;
+	case UFO_OP_CEILING: for (R_xlen_t i = 0; i < length; i++) out[i] = ceil(x[i]);         break;
+	case UFO_OP_TRUNC:   for (R_xlen_t i = 0; i < length; i++) out[i] = trunc(x[i]);        break;
+	case UFO_OP_ROUND:   for (R_xlen_t i = 0; i < length; i++) out[i] = nearbyint(x[i]);    break;
+	default:             Rf_error("No real math kernel for operator %i", operator);
+	}
+
+	// R warns when sqrt or log turn a number into NaN.
+	if (operator == UFO_OP_SQRT || operator == UFO_OP_LOG) {
+		for (R_xlen_t i = 0; i < length; i++) {
+			if (ISNAN(out[i]) && !ISNAN(x[i])) {
+				status->nan_produced = true;
+				break;
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Unary kernels: x and target both hold `length` elements
+//-----------------------------------------------------------------------------
+
+void ufo_unary_kernel(ufo_operator_t operator, SEXPTYPE working_type,
+                      const void *x, void *target,
+                      R_xlen_t length, ufo_kernel_status_t *status) {
+
+	if (operator == UFO_OP_PLUS) {
+		memcpy(target, x, length * ufo_working_type_element_size(working_type));
+		return;
+	}
+
+	if (operator == UFO_OP_NOT && working_type == LGLSXP) {
+		const int *in = (const int *) x;
+		int *out = (int *) target;
+		for (R_xlen_t i = 0; i < length; i++) {
+			out[i] = in[i] == NA_LOGICAL ? NA_LOGICAL : !in[i];
+		}
+		return;
+	}
+
+	if (operator == UFO_OP_MINUS) {
+		switch (working_type) {
+		case INTSXP: {
+			const int *in = (const int *) x;
+			int *out = (int *) target;
+			for (R_xlen_t i = 0; i < length; i++) {
+				out[i] = in[i] == NA_INTEGER ? NA_INTEGER : -in[i];
+			}
+			return;
+		}
+		case REALSXP: {
+			const double *in = (const double *) x;
+			double *out = (double *) target;
+			for (R_xlen_t i = 0; i < length; i++) {
+				out[i] = -in[i];
+			}
+			return;
+		}
+		case CPLXSXP: {
+			const Rcomplex *in = (const Rcomplex *) x;
+			Rcomplex *out = (Rcomplex *) target;
+			for (R_xlen_t i = 0; i < length; i++) {
+				out[i].r = -in[i].r;
+				out[i].i = -in[i].i;
+			}
+			return;
+		}}
+	}
+
+	if (ufo_operator_is_math(operator)) {
+		switch (working_type) {
+		case INTSXP:  __integer_math_kernel(operator, (const int *) x, (int *) target, length);               return;
+		case REALSXP: __real_math_kernel(operator, (const double *) x, (double *) target, length, status);   return;
+		default:      break;
+		}
+	}
+
+	Rf_error("No unary kernel for operator %i and working type %s",
+	         operator, type2char(working_type));
+}
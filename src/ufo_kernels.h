@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdbool.h>
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+// Operators that can be computed natively, without going through R.
+typedef enum {
+	UFO_OP_ADD,
+	UFO_OP_SUBTRACT,
+	UFO_OP_MULTIPLY,
+	UFO_OP_DIVIDE,
+	UFO_OP_POWER,
+	UFO_OP_MODULO,
+	UFO_OP_INT_DIVIDE,
+	UFO_OP_LESS,
+	UFO_OP_LESS_EQUAL,
+	UFO_OP_GREATER,
+	UFO_OP_GREATER_EQUAL,
+	UFO_OP_EQUAL,
+	UFO_OP_UNEQUAL,
+	UFO_OP_AND,
+	UFO_OP_OR,
+	UFO_OP_PLUS,
+	UFO_OP_MINUS,
+	UFO_OP_NOT,
+
+	// Functions of the Math group, which are unary.
+	UFO_OP_SQRT,
+	UFO_OP_EXP,
+	UFO_OP_LOG,
+	UFO_OP_ABS,
+	UFO_OP_SIGN,
+	UFO_OP_FLOOR,
+	UFO_OP_CEILING,
+	UFO_OP_TRUNC,
+	UFO_OP_ROUND,
+} ufo_operator_t;
+
+// Things that happened inside a kernel that R would warn about. Kernels do not
+// call into R, so the caller reports these once the computation is done.
+typedef struct {
+	bool integer_overflow;
+	bool lost_accuracy;
+	bool nan_produced;
+} ufo_kernel_status_t;
+
+// The elements of one operand that a kernel works on. A broadcast region is a
+// single element that stands for all `length` of them, which is how scalar
+// operands (eg. `x * 2`) are passed without replicating them.
+typedef struct {
+	const void *data;
+	bool        broadcast;
+} ufo_region_t;
+
+ufo_operator_t __extract_operator_or_die(SEXP/*STRSXP*/ operator);
+bool           ufo_operator_is_arithmetic(ufo_operator_t operator);
+bool           ufo_operator_is_math(ufo_operator_t operator);
+void           ufo_kernel_status_report(ufo_kernel_status_t status);
+
+size_t ufo_working_type_element_size(SEXPTYPE type);
+bool   ufo_same_representation(SEXPTYPE from, SEXPTYPE to);
+void   ufo_convert_elements(SEXPTYPE from_type, const void *source, SEXPTYPE to_type, void *target, R_xlen_t length);
+
+void ufo_binary_kernel(ufo_operator_t operator, SEXPTYPE working_type,
+                       ufo_region_t x, ufo_region_t y, void *target,
+                       R_xlen_t length, ufo_kernel_status_t *status);
+void ufo_unary_kernel (ufo_operator_t operator, SEXPTYPE working_type,
+                       const void *x, void *target,
+                       R_xlen_t length, ufo_kernel_status_t *status);
@@ -0,0 +1,261 @@
+#include "ufo_lazy.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+#include "../include/ufos.h"
+
+#include "safety_first.h"
+#include "helpers.h"
+#include "ufo_operators.h"
+#include "ufo_kernels.h"
+#include "ufo_chunks.h"
+
+#define MIN(x, y) (x >= y ? y : x)
+
+// How many elements are handed to a kernel at a time when populating. Keeps
+// the scratch buffers small regardless of how much the core asks for.
+#define LAZY_PIECE_LENGTH 4096
+
+typedef struct {
+	ufo_operator_t operator;
+	bool           unary;
+	SEXPTYPE       working_type;
+	size_t         result_element_size;
+	ufo_operand_t  x;
+	ufo_operand_t  y;   // unused for unary operators
+} lazy_data_t;
+
+// Runs on the UFO core's thread, so this cannot touch the R API. That is why
+// the constructors only accept operands that ufo_operand_region can read
+// without calling R. Operands that are themselves
+// UFOs are faulted in from here as a matter of course.
+//
+// Kernels report integer overflow and lost accuracy through the status, but
+// there is nobody to warn at this point, so these conditions are silently
+// turned into NAs.
+static int32_t __populate_lazy(void* user_data, uintptr_t start, uintptr_t end, unsigned char* target) {
+	lazy_data_t *data = (lazy_data_t *) user_data;
+	size_t working_element_size = ufo_working_type_element_size(data->working_type);
+
+	void *x_scratch = malloc(LAZY_PIECE_LENGTH * working_element_size);
+	void *y_scratch = malloc(LAZY_PIECE_LENGTH * working_element_size);
+	if (x_scratch == NULL || y_scratch == NULL) {
+		free(x_scratch);
+		free(y_scratch);
+		return 1;
+	}
+
+	ufo_kernel_status_t status = { .integer_overflow = false, .lost_accuracy = false, .nan_produced = false };
+
+	for (R_xlen_t offset = (R_xlen_t) start; offset < (R_xlen_t) end; offset += LAZY_PIECE_LENGTH) {
+		R_xlen_t length = MIN(LAZY_PIECE_LENGTH, (R_xlen_t) end - offset);
+		unsigned char *piece_target = target + (offset - (R_xlen_t) start) * data->result_element_size;
+
+		ufo_region_t x_region = ufo_operand_region(&data->x, data->working_type, offset, length, x_scratch);
+		if (data->unary) {
+			ufo_unary_kernel(data->operator, data->working_type, x_region.data,
+			                 piece_target, length, &status);
+		} else {
+			ufo_region_t y_region = ufo_operand_region(&data->y, data->working_type, offset, length, y_scratch);
+			ufo_binary_kernel(data->operator, data->working_type, x_region, y_region,
+			                  piece_target, length, &status);
+		}
+	}
+
+	free(x_scratch);
+	free(y_scratch);
+	return 0;
+}
+
+// The operands have to outlive the result and must not change under it, so
+// they are kept alive by the result and marked as not mutable, which makes R
+// copy them instead of modifying them in place. The mark cannot be taken back
+// once the result is gone, so every later assignment into the operand copies
+// all of it into R's heap. Operands that ufo_operand_prepare has already
+// copied (scalars and tiles) are not read again and are left alone.
+static bool __operand_is_held(const ufo_operand_t *operand) {
+	return !operand->scalar && operand->tiles == NULL;
+}
+
+static void __hold_operand(const ufo_operand_t *operand) {
+	if (__operand_is_held(operand)) {
+		R_PreserveObject(operand->sexp);
+		MARK_NOT_MUTABLE(operand->sexp);
+	}
+}
+
+// Called when the result is garbage collected. Releasing objects from the
+// precious list does not allocate, so it is safe to do here.
+static void __destroy_lazy(void* user_data) {
+	lazy_data_t *data = (lazy_data_t *) user_data;
+	if (__operand_is_held(&data->x)) {
+		R_ReleaseObject(data->x.sexp);
+	}
+	ufo_operand_release(&data->x);
+	if (!data->unary) {
+		if (__operand_is_held(&data->y)) {
+			R_ReleaseObject(data->y.sexp);
+		}
+		ufo_operand_release(&data->y);
+	}
+	free(data);
+}
+
+static void __release_operands(lazy_data_t *data) {
+	ufo_operand_release(&data->x);
+	if (!data->unary) {
+		ufo_operand_release(&data->y);
+	}
+}
+
+typedef struct {
+	ufo_new_t      ufo_new;
+	ufo_source_t  *source;
+} lazy_construction_t;
+
+static SEXP __construct_lazy(void *context) {
+	lazy_construction_t *construction = (lazy_construction_t *) context;
+	return construction->ufo_new(construction->source);
+}
+
+// Until ufo_new returns, nothing owns the source, so it is freed if ufo_new
+// raises an error.
+static void __discard_lazy(void *context, Rboolean jump) {
+	if (!jump) {
+		return;
+	}
+	lazy_construction_t *construction = (lazy_construction_t *) context;
+	lazy_data_t *data = (lazy_data_t *) construction->source->data;
+	__release_operands(data);
+	free(data);
+	free(construction->source);
+}
+
+static SEXP __lazy_result(lazy_data_t *template, SEXPTYPE result_type, R_xlen_t size, int32_t min_load_count) {
+	lazy_construction_t construction;
+	construction.ufo_new = (ufo_new_t) R_GetCCallable("ufos", "ufo_new");
+
+	ufo_source_t* source = (ufo_source_t*) malloc(sizeof(ufo_source_t));
+	if (source == NULL) {
+		__release_operands(template);
+		Rf_error("Cannot allocate ufo_source_t");
+	}
+
+	lazy_data_t *data = (lazy_data_t *) malloc(sizeof(lazy_data_t));
+	if (data == NULL) {
+		free(source);
+		__release_operands(template);
+		Rf_error("Cannot allocate lazy result data");
+	}
+	*data = *template;
+	data->result_element_size = __get_element_size(result_type);
+
+	source->population_function = &__populate_lazy;
+	source->destructor_function = &__destroy_lazy;
+	source->writeback_function = NULL;
+	source->vector_type = (ufo_vector_type_t) result_type;
+	source->element_size = data->result_element_size;
+	source->vector_size = size;
+	source->dimensions = NULL;
+	source->dimensions_length = 0;
+	source->min_load_count = __select_min_load_count(min_load_count, source->element_size);
+	source->read_only = true;
+	source->data = (void*) data;
+	construction.source = source;
+
+	SEXP continuation = PROTECT(R_MakeUnwindCont());
+	SEXP result = R_UnwindProtect(&__construct_lazy, &construction, &__discard_lazy, &construction, continuation);
+	UNPROTECT(1);
+
+	// Only now does the result own the data, whose destructor releases the
+	// operands again.
+	__hold_operand(&data->x);
+	if (!data->unary) {
+		__hold_operand(&data->y);
+	}
+
+	// The result itself is read only.
+	MARK_NOT_MUTABLE(result);
+	return result;
+}
+
+// Whether the operand can still only be read through the R API once it is
+// prepared: ufo_operand_prepare only copies operands that are shorter than
+// the result and no longer than a piece.
+static bool __stays_behind_r(const ufo_operand_t *operand, R_xlen_t size, R_xlen_t piece_length) {
+	return operand->data == NULL && (operand->length >= size || operand->length > piece_length);
+}
+
+SEXP ufo_lazy_binary_result(SEXP/*STRSXP*/ operator_sexp, SEXP x, SEXP y, SEXP/*INTSXP*/ min_load_count) {
+	ufo_operator_t operator = __extract_operator_or_die(operator_sexp);
+
+	SEXPTYPE working_type = ufo_binary_working_type(operator, TYPEOF(x), TYPEOF(y));
+	if (working_type == NILSXP) {
+		return R_NilValue;
+	}
+
+	lazy_data_t data;
+	data.operator     = operator;
+	data.unary        = false;
+	data.working_type = working_type;
+	data.x            = ufo_operand_from(x);
+	data.y            = ufo_operand_from(y);
+
+	R_xlen_t size = ufo_vector_size_to_fit_both(data.x.type, data.y.type, data.x.length, data.y.length);
+	if (size == 0) {
+		return R_NilValue;
+	}
+
+	// Short operands are tiled here, on R's thread, so even ALTREP ones can be
+	// read while populating. Longer ALTREP operands can only be read through
+	// the R API, so they are left to the eager implementation, which warns
+	// about recycling itself.
+	R_xlen_t piece_length = MIN(LAZY_PIECE_LENGTH, size);
+	if (__stays_behind_r(&data.x, size, piece_length) || __stays_behind_r(&data.y, size, piece_length)) {
+		return R_NilValue;
+	}
+
+	// Before any tiles are allocated, since the warning may be turned into an
+	// error.
+	ufo_check_recycling(size, data.x.length, data.y.length);
+
+	ufo_operand_prepare(&data.x, working_type, size, piece_length, true);
+	ufo_operand_prepare(&data.y, working_type, size, piece_length, true);
+	if (ufo_operand_needs_r(&data.x) || ufo_operand_needs_r(&data.y)) {
+		ufo_operand_release(&data.x);
+		ufo_operand_release(&data.y);
+		return R_NilValue;
+	}
+
+	return __lazy_result(&data, ufo_operator_result_type(operator, working_type), size,
+	                     __extract_int_or_die(min_load_count));
+}
+
+SEXP ufo_lazy_unary_result(SEXP/*STRSXP*/ operator_sexp, SEXP x, SEXP/*INTSXP*/ min_load_count) {
+	ufo_operator_t operator = ufo_as_unary_operator(__extract_operator_or_die(operator_sexp));
+
+	SEXPTYPE working_type = ufo_unary_working_type(operator, TYPEOF(x));
+	if (working_type == NILSXP) {
+		return R_NilValue;
+	}
+
+	lazy_data_t data;
+	data.operator     = operator;
+	data.unary        = true;
+	data.working_type = working_type;
+	data.x            = ufo_operand_from(x);
+	data.y            = data.x;
+
+	if (data.x.data == NULL || data.x.length == 0) {
+		return R_NilValue;
+	}
+
+	return __lazy_result(&data, ufo_operator_result_type(operator, working_type), data.x.length,
+	                     __extract_int_or_die(min_load_count));
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+// Lazy operator results: UFOs whose population function computes
+// `x <operator> y` only for the range of elements that is actually touched.
+// Their pages are read only, so under memory pressure they are dropped and
+// recomputed instead of being written back to disk.
+//
+// The constructors return NULL if the operation cannot be computed lazily (see
+// ufo_lazy.c), in which case the caller should compute the result eagerly.
+SEXP ufo_lazy_binary_result(SEXP/*STRSXP*/ operator, SEXP x, SEXP y, SEXP/*INTSXP*/ min_load_count);
+SEXP ufo_lazy_unary_result (SEXP/*STRSXP*/ operator, SEXP x,         SEXP/*INTSXP*/ min_load_count);
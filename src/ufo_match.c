@@ -0,0 +1,119 @@
+#include "ufo_match.h"
+
+#include <stdbool.h>
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+#include "safety_first.h"
+#include "helpers.h"
+#include "ufo_empty.h"
+#include "ufo_chunks.h"
+#include "ufo_threads.h"
+#include "ufo_hash.h"
+
+#define MIN(x, y) (x >= y ? y : x)
+
+typedef struct {
+	const ufo_hash_t  *hash;
+	ufo_key_source_t   x;
+	bool               membership;    // %in%, otherwise match
+	bool               long_indices;
+	int                nomatch;
+	int               *integers;      // logicals for %in%
+	double            *reals;
+} match_job_t;
+
+static void __match_chunk(void *context, int worker, R_xlen_t start, R_xlen_t length) {
+	match_job_t *job = (match_job_t *) context;
+	const void *keys = ufo_key_source_region(&job->x, worker, start, length);
+
+	for (R_xlen_t i = 0; i < length; i++) {
+		const ufo_hash_slot_t *slot = ufo_hash_find(job->hash, ufo_key_at(job->hash->type, keys, i));
+		if (job->membership) {
+			job->integers[start + i] = slot != NULL;
+		} else if (job->long_indices) {
+			job->reals[start + i] = slot != NULL ? (double) slot->index
+			                      : job->nomatch == NA_INTEGER ? NA_REAL : (double) job->nomatch;
+		} else {
+			job->integers[start + i] = slot != NULL ? (int) slot->index : job->nomatch;
+		}
+	}
+}
+
+// Adds the elements of the table in order, so that every key keeps the index
+// of its first occurrence.
+static void __add_table(ufo_hash_t *hash, SEXP table, R_xlen_t chunk_size) {
+	R_xlen_t length = XLENGTH(table);
+	if (length == 0) {
+		return;
+	}
+
+	ufo_key_source_t source = ufo_key_source(table, hash->type, MIN(chunk_size, length), 1);
+	for (R_xlen_t start = 0; start < length; start += chunk_size) {
+		R_xlen_t chunk_length = MIN(chunk_size, length - start);
+		const void *keys = ufo_key_source_region(&source, 0, start, chunk_length);
+		for (R_xlen_t i = 0; i < chunk_length; i++) {
+			bool added;
+			ufo_hash_add(hash, ufo_key_at(hash->type, keys, i), start + i + 1, &added);
+		}
+	}
+}
+
+static SEXP __match(bool membership, SEXP x, SEXP table, int nomatch, int32_t min_load_count,
+                    SEXP/*REALSXP*/ chunk_size_sexp) {
+	R_xlen_t chunk_size = chunk_size_sexp == R_NilValue ? 0 : __extract_R_xlen_t_or_die(chunk_size_sexp);
+	make_sure(chunk_size_sexp == R_NilValue || chunk_size > 0, "Chunk size must be positive, but is %li", chunk_size);
+
+	SEXPTYPE type = ufo_key_type(TYPEOF(x), TYPEOF(table));
+	if (type == NILSXP) {
+		return R_NilValue;
+	}
+
+	match_job_t job;
+	job.membership = membership;
+	job.long_indices = !membership && XLENGTH(table) > R_SHORT_LEN_MAX;
+	job.nomatch = nomatch;
+
+	SEXPTYPE result_type = membership ? LGLSXP : job.long_indices ? REALSXP : INTSXP;
+	R_xlen_t length = XLENGTH(x);
+	if (length == 0) {
+		return allocVector(result_type, 0);
+	}
+
+	if (chunk_size_sexp == R_NilValue) {
+		chunk_size = ufo_plan_chunk_size(&x, 1, job.long_indices ? sizeof(double) : sizeof(int),
+		                                 min_load_count, length);
+	}
+
+	ufo_hash_t hash = ufo_hash_new(type, 0, min_load_count);
+	__add_table(&hash, table, chunk_size);
+	job.hash = &hash;
+
+	int threads = ufo_threads_from_option();
+	job.x = ufo_key_source(x, type, MIN(chunk_size, length), threads);
+	if (ufo_key_source_needs_r(&job.x)) {
+		threads = 1;
+	}
+
+	SEXP result = PROTECT(ufo_empty(result_type, length, false, min_load_count));
+	job.integers = job.long_indices ? NULL : (int *) DATAPTR(result);
+	job.reals    = job.long_indices ? REAL(result) : NULL;
+
+	ufo_parallel_for(length, chunk_size, threads, &__match_chunk, &job);
+
+	UNPROTECT(1); // result, which is above the hash
+	ufo_hash_free(&hash);
+	return result;
+}
+
+SEXP ufo_match(SEXP x, SEXP table, SEXP/*INTSXP*/ nomatch, SEXP/*INTSXP*/ min_load_count,
+               SEXP/*REALSXP*/ chunk_size) {
+	return __match(false, x, table, __extract_int_or_die(nomatch), __extract_int_or_die(min_load_count),
+	               chunk_size);
+}
+
+SEXP ufo_in(SEXP x, SEXP table, SEXP/*INTSXP*/ min_load_count, SEXP/*REALSXP*/ chunk_size) {
+	return __match(true, x, table, NA_INTEGER, __extract_int_or_die(min_load_count), chunk_size);
+}
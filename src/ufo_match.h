@@ -0,0 +1,23 @@
+#pragma once
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+// match and %in% for logical, integer, double, complex and string vectors,
+// like base R's (without incomparables). Elements are compared the way base R
+// compares them (see ufo_hash.h), as the common type of x and table.
+//
+// The table is read once into a hash table (ufo_hash), which lives in a UFO
+// rather than on R's heap. x is then streamed in chunks against it, on
+// `ufooperators.threads` threads unless its keys can only be read through
+// the R API (eg. strings), and the result is written into a new UFO. Match
+// returns integers, or doubles if the table is a long vector; elements
+// without a match are `nomatch`. If `chunk_size` is NULL, it is planned from
+// x (see ufo_plan_chunk_size).
+//
+// Returns NULL if x and table have no common type here (eg. numbers and
+// strings), which the caller should hand over to base R.
+SEXP ufo_match(SEXP x, SEXP table, SEXP/*INTSXP*/ nomatch, SEXP/*INTSXP*/ min_load_count,
+               SEXP/*REALSXP*/ chunk_size);
+SEXP ufo_in   (SEXP x, SEXP table, SEXP/*INTSXP*/ min_load_count, SEXP/*REALSXP*/ chunk_size);
@@ -11,9 +11,16 @@
 #include "ufo_empty.h"
 #include "rash.h"
 #include "ufo_coerce.h"
+#include "ufo_kernels.h"
+#include "ufo_chunks.h"
+#include "ufo_threads.h"
+#include "ufo_packed.h"
 
 #include <assert.h>
 
+#define MAX(x, y) (x >= y ? x : y)
+#define MIN(x, y) (x >= y ? y : x)
+
 //-----------------------------------------------------------------------------
 // Chunked binary and unary operators
 //-----------------------------------------------------------------------------
@@ -24,6 +31,10 @@ R_xlen_t ufo_vector_size_to_fit_both(SEXPTYPE x_type, SEXPTYPE y_type, R_xlen_t
 		return 0;
 	}
 
+	if (x_length == 0 || y_length == 0) {
+		return 0;
+	}
+
 	if ((x_type == REALSXP || x_type == INTSXP || x_type == LGLSXP || x_type == NILSXP || x_type == CPLXSXP || x_type == STRSXP)
 		&& (y_type == REALSXP || y_type == INTSXP || y_type == LGLSXP || y_type == NILSXP || y_type == CPLXSXP  || y_type == STRSXP))  {
 		return x_length >= y_length ? x_length : y_length;
@@ -39,6 +50,10 @@ R_xlen_t ufo_vector_size_to_mod_both(SEXPTYPE x_type, SEXPTYPE y_type, R_xlen_t
 		return 0;
 	}
 
+	if (x_length == 0 || y_length == 0) {
+		return 0;
+	}
+
 	if ((x_type == REALSXP || x_type == INTSXP || x_type == LGLSXP || x_type == NILSXP || x_type == STRSXP)
 		&& (y_type == REALSXP || y_type == INTSXP || y_type == LGLSXP || y_type == NILSXP || y_type == STRSXP))  {
 		return x_length >= y_length ? x_length : y_length;
@@ -88,17 +103,49 @@ SEXPTYPE ufo_vector_type_to_fit_both(SEXPTYPE x, SEXPTYPE y) {
 	return 0; // Mollifies linters.
 }
 
-// Good for: + - *
+// Good for: unary + -
 SEXPTYPE ufo_vector_type_to_neg(SEXPTYPE x) {
 	if (x == REALSXP) 	return REALSXP;
 	if (x == INTSXP) 	return INTSXP;
-	if (x == LGLSXP)	return LGLSXP;
+	if (x == LGLSXP)	return INTSXP;
 	if (x == CPLXSXP)	return CPLXSXP;
 
 	Rf_error("operation is not supported");
 	return 0; // Mollifies linters.
 }
 
+// Good for: unary !
+SEXPTYPE ufo_vector_type_to_not(SEXPTYPE x) {
+	if (x == REALSXP) 	return LGLSXP;
+	if (x == INTSXP) 	return LGLSXP;
+	if (x == LGLSXP)	return LGLSXP;
+
+	Rf_error("operation is not supported");
+	return 0; // Mollifies linters.
+}
+
+// Good for: sqrt exp log sign floor ceiling trunc
+SEXPTYPE ufo_vector_type_to_math(SEXPTYPE x) {
+	if (x == REALSXP) 	return REALSXP;
+	if (x == INTSXP) 	return REALSXP;
+	if (x == LGLSXP)	return REALSXP;
+	if (x == CPLXSXP)	return CPLXSXP;
+
+	Rf_error("non-numeric argument to mathematical function");
+	return 0; // Mollifies linters.
+}
+
+// Good for: abs
+SEXPTYPE ufo_vector_type_to_abs(SEXPTYPE x) {
+	if (x == REALSXP) 	return REALSXP;
+	if (x == INTSXP) 	return INTSXP;
+	if (x == LGLSXP)	return INTSXP;
+	if (x == CPLXSXP)	return REALSXP;
+
+	Rf_error("non-numeric argument to mathematical function");
+	return 0; // Mollifies linters.
+}
+
 // Good for: / ^
 SEXPTYPE ufo_vector_type_to_div_both(SEXPTYPE x, SEXPTYPE y) {
 	if (x == REALSXP || x == INTSXP || x == LGLSXP || x == NILSXP) {
@@ -196,7 +243,7 @@ SEXPTYPE ufo_vector_type_to_rel_both(SEXPTYPE x, SEXPTYPE y) {
 	}
 
 	if (x == STRSXP) {
-		if (y == STRSXP)	return STRSXP;
+		if (y == STRSXP)	return LGLSXP;
 
 		Rf_error("operation is not supported");
 	}
@@ -297,38 +344,299 @@ SEXP ufo_neg_result (SEXP x, SEXP min_load_count) {
 	return ufo_empty(result_type, x_size, false, __extract_int_or_die(min_load_count));
 }
 
-#define MAX(x, y) (x >= y ? x : y)
-#define MIN(x, y) (x >= y ? y : x)
+// Good for: unary !
+SEXP ufo_not_result (SEXP x, SEXP min_load_count) {
+	SEXPTYPE x_type = TYPEOF(x);
+	R_xlen_t x_size = XLENGTH(x);
 
-SEXP uncompact_intrange(R_xlen_t start, R_xlen_t end, R_xlen_t size) {
-	make_sure(start > 0, "Uncompact intrange start must be > 0");
-	make_sure(end >= start, "Uncompact intrange end must be >= start");
+	SEXPTYPE result_type = ufo_vector_type_to_not(x_type);
 
-	R_xlen_t length = end - start + 1;
-	make_sure(size >= length, "Uncompact intrange size must be >= end - start + 1");
+	return ufo_empty(result_type, x_size, false, __extract_int_or_die(min_load_count));
+}
+
+// Good for: sqrt exp log sign floor ceiling trunc
+SEXP ufo_math_result (SEXP x, SEXP min_load_count) {
+	SEXPTYPE x_type = TYPEOF(x);
+	R_xlen_t x_size = XLENGTH(x);
+
+	SEXPTYPE result_type = ufo_vector_type_to_math(x_type);
+
+	return ufo_empty(result_type, x_size, false, __extract_int_or_die(min_load_count));
+}
+
+// Good for: abs
+SEXP ufo_abs_result (SEXP x, SEXP min_load_count) {
+	SEXPTYPE x_type = TYPEOF(x);
+	R_xlen_t x_size = XLENGTH(x);
+
+	SEXPTYPE result_type = ufo_vector_type_to_abs(x_type);
+
+	return ufo_empty(result_type, x_size, false, __extract_int_or_die(min_load_count));
+}
+
+static inline bool __is_numeric_type(SEXPTYPE type) {
+	return type == LGLSXP || type == INTSXP || type == REALSXP || type == CPLXSXP;
+}
+
+static inline SEXPTYPE __higher_numeric_type(SEXPTYPE x, SEXPTYPE y) {
+	if (x == CPLXSXP || y == CPLXSXP) return CPLXSXP;
+	if (x == REALSXP || y == REALSXP) return REALSXP;
+	return INTSXP;
+}
 
-	SEXP vector = PROTECT(allocVector(INTSXP, size));
-	for (R_xlen_t i = 0; i < length; i++) {
-		safely_set_integer(vector, i, start + i);
+// The type both operands are converted to before the operator is applied. For
+// arithmetic this is the type of the result, for comparisons it is the more
+// general of the operands' types, and logical operators work on logicals.
+//
+// Returns NILSXP if the operation cannot be computed natively. In that case
+// the caller should fall back on R, which knows how to deal with the
+// remaining cases (or how to produce an appropriate error).
+SEXPTYPE ufo_binary_working_type(ufo_operator_t operator, SEXPTYPE x, SEXPTYPE y) {
+	if (!__is_numeric_type(x) || !__is_numeric_type(y)) {
+		return NILSXP;
+	}
+
+	switch (operator) {
+	case UFO_OP_ADD:
+	case UFO_OP_SUBTRACT:
+	case UFO_OP_MULTIPLY:
+		return ufo_vector_type_to_fit_both(x, y);
+
+	case UFO_OP_DIVIDE:
+		return ufo_vector_type_to_div_both(x, y);
+
+	case UFO_OP_POWER: // Complex powers need R_cpow, which R does not export.
+		return ufo_vector_type_to_div_both(x, y) == CPLXSXP ? NILSXP : REALSXP;
+
+	case UFO_OP_MODULO:
+	case UFO_OP_INT_DIVIDE:
+		if (x == CPLXSXP || y == CPLXSXP) return NILSXP;
+		return ufo_vector_type_to_mod_both(x, y);
+
+	case UFO_OP_LESS:
+	case UFO_OP_LESS_EQUAL:
+	case UFO_OP_GREATER:
+	case UFO_OP_GREATER_EQUAL:
+		if (x == CPLXSXP || y == CPLXSXP) return NILSXP;
+		return __higher_numeric_type(x, y);
+
+	case UFO_OP_EQUAL:
+	case UFO_OP_UNEQUAL:
+		return __higher_numeric_type(x, y);
+
+	case UFO_OP_AND:
+	case UFO_OP_OR:
+		return LGLSXP;
+
+	default:
+		return NILSXP;
 	}
+}
 
-	UNPROTECT(1);
-	return vector;
+// Same as above, for unary operators.
+SEXPTYPE ufo_unary_working_type(ufo_operator_t operator, SEXPTYPE x) {
+	if (!__is_numeric_type(x)) {
+		return NILSXP;
+	}
+
+	switch (operator) {
+	case UFO_OP_PLUS:
+	case UFO_OP_MINUS:
+		return ufo_vector_type_to_neg(x);
+
+	case UFO_OP_NOT:
+		return x == CPLXSXP ? NILSXP : LGLSXP;
+
+	// Complex numbers are left to R.
+	case UFO_OP_ABS:
+	case UFO_OP_ROUND:
+		return x == CPLXSXP ? NILSXP : ufo_vector_type_to_abs(x);
+
+	case UFO_OP_SQRT:
+	case UFO_OP_EXP:
+	case UFO_OP_LOG:
+	case UFO_OP_SIGN:
+	case UFO_OP_FLOOR:
+	case UFO_OP_CEILING:
+	case UFO_OP_TRUNC:
+		return x == CPLXSXP ? NILSXP : REALSXP;
+
+	default:
+		return NILSXP;
+	}
+}
+
+SEXPTYPE ufo_operator_result_type(ufo_operator_t operator, SEXPTYPE working_type) {
+	return ufo_operator_is_arithmetic(operator) ? working_type : LGLSXP;
 }
 
-SEXP uncompact_intrange_fill(SEXP vector, R_xlen_t start, R_xlen_t end) {
-	make_sure(start > 0, "Uncompact intrange start must be > 0");
-	make_sure(end >= start, "Uncompact intrange end must be >= start");
+ufo_operator_t ufo_as_unary_operator(ufo_operator_t operator) {
+	switch (operator) {
+	case UFO_OP_ADD:      return UFO_OP_PLUS;
+	case UFO_OP_SUBTRACT: return UFO_OP_MINUS;
+	case UFO_OP_NOT:      return UFO_OP_NOT;
+	default:
+		if (ufo_operator_is_math(operator)) {
+			return operator;
+		}
+		Rf_error("Not a unary operator");
+	}
+	return 0; // Mollifies linters.
+}
+
+void ufo_check_recycling(R_xlen_t result_length, R_xlen_t x_length, R_xlen_t y_length) {
+	if (result_length % x_length != 0 || result_length % y_length != 0) {
+		Rf_warning("longer object length is not a multiple of shorter object length");
+	}
+}
+
+// A binary or unary operator computed chunk by chunk into a result. Each
+// worker has its own scratch space and status, and the statuses are merged
+// once all chunks are done.
+typedef struct {
+	ufo_operator_t       operator;
+	bool                 unary;
+	SEXPTYPE             working_type;
+	ufo_operand_t        x;
+	ufo_operand_t        y;
+	unsigned char       *result_data;
+	size_t               result_element_size;
+	unsigned char       *x_scratch;
+	unsigned char       *y_scratch;
+	size_t               scratch_size;   // bytes of scratch per worker
+	ufo_kernel_status_t *statuses;       // one per worker
+} operator_job_t;
+
+static void __compute_operator_chunk(void *context, int worker, R_xlen_t start, R_xlen_t length) {
+	operator_job_t *job = (operator_job_t *) context;
+	ufo_kernel_status_t *status = &job->statuses[worker];
+	unsigned char *target = job->result_data + start * job->result_element_size;
+
+	ufo_region_t x_region = ufo_operand_region(&job->x, job->working_type, start, length,
+	                                           job->x_scratch + worker * job->scratch_size);
+	if (job->unary) {
+		ufo_unary_kernel(job->operator, job->working_type, x_region.data, target, length, status);
+		return;
+	}
+
+	ufo_region_t y_region = ufo_operand_region(&job->y, job->working_type, start, length,
+	                                           job->y_scratch + worker * job->scratch_size);
+	ufo_binary_kernel(job->operator, job->working_type, x_region, y_region, target, length, status);
+}
+
+// Runs the job over the whole result and reports what the kernels ran into.
+// Recycled operands are prepared up front, so scalars are broadcast and short
+// operands are tiled once rather than per chunk. Operands that can still only
+// be read through the R API (ALTREP) cannot be read from worker threads, so
+// those jobs run on R's thread only.
+static void __run_operator_job(operator_job_t *job, R_xlen_t result_length, R_xlen_t chunk_size) {
+	R_xlen_t chunk_length = MIN(chunk_size, result_length);
+	ufo_operand_prepare(&job->x, job->working_type, result_length, chunk_length, false);
+	if (!job->unary) {
+		ufo_operand_prepare(&job->y, job->working_type, result_length, chunk_length, false);
+	}
+
+	int threads = ufo_threads_from_option();
+	if (ufo_operand_needs_r(&job->x) || (!job->unary && ufo_operand_needs_r(&job->y))) {
+		threads = 1;
+	}
+
+	size_t working_element_size = ufo_working_type_element_size(job->working_type);
+	job->scratch_size = chunk_length * working_element_size;
+	job->x_scratch = (unsigned char *) R_alloc(threads, job->scratch_size);
+	job->y_scratch = job->unary ? NULL : (unsigned char *) R_alloc(threads, job->scratch_size);
+	job->statuses  = (ufo_kernel_status_t *) R_alloc(threads, sizeof(ufo_kernel_status_t));
+	for (int i = 0; i < threads; i++) {
+		job->statuses[i].integer_overflow = false;
+		job->statuses[i].lost_accuracy = false;
+		job->statuses[i].nan_produced = false;
+	}
+
+	ufo_parallel_for(result_length, chunk_size, threads, &__compute_operator_chunk, job);
+
+	ufo_kernel_status_t status = { .integer_overflow = false, .lost_accuracy = false, .nan_produced = false };
+	for (int i = 0; i < threads; i++) {
+		status.integer_overflow |= job->statuses[i].integer_overflow;
+		status.lost_accuracy    |= job->statuses[i].lost_accuracy;
+		status.nan_produced     |= job->statuses[i].nan_produced;
+	}
+	ufo_kernel_status_report(status);
+}
+
+// Computes `x <operator> y` chunk by chunk, writing directly into `result`,
+// which was previously created by one of the result constructors above.
+// Chunks are computed in parallel if the `ufooperators.threads` option asks
+// for more than one thread.
+//
+// Returns the result or NULL if the operation cannot be computed natively.
+SEXP ufo_binary(SEXP/*STRSXP*/ operator_sexp, SEXP x, SEXP y, SEXP result, SEXP/*REALSXP*/ chunk_size_sexp) {
+	ufo_operator_t operator = __extract_operator_or_die(operator_sexp);
+	R_xlen_t chunk_size     = __extract_R_xlen_t_or_die(chunk_size_sexp);
+	R_xlen_t result_length  = XLENGTH(result);
+
+	SEXPTYPE working_type = ufo_binary_working_type(operator, TYPEOF(x), TYPEOF(y));
+	if (working_type == NILSXP) {
+		return R_NilValue;
+	}
+
+	if (TYPEOF(result) != ufo_operator_result_type(operator, working_type)) {
+		return R_NilValue;
+	}
+
+	if (result_length == 0) {
+		return result;
+	}
+
+	make_sure(chunk_size > 0, "Chunk size must be positive, but is %li", chunk_size);
+
+	operator_job_t job;
+	job.operator            = operator;
+	job.unary               = false;
+	job.working_type        = working_type;
+	job.x                   = ufo_operand_from(x);
+	job.y                   = ufo_operand_from(y);
+	job.result_data         = (unsigned char *) DATAPTR(result);
+	job.result_element_size = __get_element_size(TYPEOF(result));
+
+	ufo_check_recycling(result_length, job.x.length, job.y.length);
+	__run_operator_job(&job, result_length, chunk_size);
+	return result;
+}
 
-	R_xlen_t length = XLENGTH(vector);
-	R_xlen_t fill_length = end - start + 1;
-	make_sure(fill_length <= length, "Uncompact intrange size must be >= end - start + 1");
+// Computes `<operator> x` chunk by chunk, writing directly into `result`.
+//
+// Returns the result or NULL if the operation cannot be computed natively.
+SEXP ufo_unary(SEXP/*STRSXP*/ operator_sexp, SEXP x, SEXP result, SEXP/*REALSXP*/ chunk_size_sexp) {
+	ufo_operator_t operator = ufo_as_unary_operator(__extract_operator_or_die(operator_sexp));
+	R_xlen_t chunk_size     = __extract_R_xlen_t_or_die(chunk_size_sexp);
+	R_xlen_t result_length  = XLENGTH(result);
 
-	for (R_xlen_t i = 0; i < fill_length; i++) {
-		safely_set_integer(vector, length - fill_length + i, start + i);
+	SEXPTYPE working_type = ufo_unary_working_type(operator, TYPEOF(x));
+	if (working_type == NILSXP) {
+		return R_NilValue;
+	}
+
+	if (TYPEOF(result) != ufo_operator_result_type(operator, working_type)) {
+		return R_NilValue;
 	}
 
-	return vector;
+	if (result_length == 0) {
+		return result;
+	}
+
+	make_sure(chunk_size > 0, "Chunk size must be positive, but is %li", chunk_size);
+
+	operator_job_t job;
+	job.operator            = operator;
+	job.unary               = true;
+	job.working_type        = working_type;
+	job.x                   = ufo_operand_from(x);
+	job.y                   = job.x;
+	job.result_data         = (unsigned char *) DATAPTR(result);
+	job.result_element_size = __get_element_size(TYPEOF(result));
+
+	__run_operator_job(&job, result_length, chunk_size);
+	return result;
 }
 
 SEXP ufo_get_chunk(SEXP x, SEXP chunk_sexp, SEXP chunk_size_sexp, SEXP result_length_sexp) {
@@ -341,28 +649,48 @@ SEXP ufo_get_chunk(SEXP x, SEXP chunk_sexp, SEXP chunk_size_sexp, SEXP result_le
 	R_xlen_t actual_chunk_size = chunk_start_index + chunk_size >= result_length
 			                   ? result_length - chunk_start_index
 			                   : chunk_size;
+	actual_chunk_size = MAX(actual_chunk_size, 0);
 
 	SEXP chunk = PROTECT(allocVector(TYPEOF(x), actual_chunk_size));
-	for (R_xlen_t i = 0; i < actual_chunk_size; i++) { // TODO maybe regions and/or memcpy
-		R_xlen_t ti = (chunk_start_index + i) % x_length;
+
+	if (actual_chunk_size > 0) {
+		make_sure(x_length > 0, "Cannot get a chunk of an empty vector");
 
 		switch(TYPEOF(x)) {
-		case INTSXP:  safely_set_integer(chunk, i, safely_get_integer(x, ti)); break;
-		case REALSXP: safely_set_real (chunk, i, safely_get_real (x, ti)); break;
-		case LGLSXP:  safely_set_logical(chunk, i, safely_get_logical(x, ti)); break;
-		case CPLXSXP: safely_set_complex(chunk, i, safely_get_complex(x, ti)); break;
-		case STRSXP:  safely_set_string (chunk, i, safely_get_string (x, ti)); break;
-		case RAWSXP:  safely_set_raw    (chunk, i, safely_get_raw    (x, ti)); break;
-		case VECSXP:  SET_VECTOR_ELT (chunk, i, VECTOR_ELT (x, ti)); break;
-		default:      Rf_error("Cannot get a chunk of SEXP of this type");
+		case INTSXP:
+		case REALSXP:
+		case LGLSXP:
+		case CPLXSXP:
+		case RAWSXP:
+			ufo_copy_region(x, chunk_start_index, actual_chunk_size, DATAPTR(chunk));
+			break;
+
+		// Elements of these have to go through the write barrier one by one, but
+		// at least the index wraps around without a division.
+		case STRSXP:
+			for (R_xlen_t i = 0, ti = chunk_start_index % x_length; i < actual_chunk_size; i++) {
+				SET_STRING_ELT(chunk, i, STRING_ELT(x, ti));
+				ti = ti + 1 == x_length ? 0 : ti + 1;
+			}
+			break;
+
+		case VECSXP:
+			for (R_xlen_t i = 0, ti = chunk_start_index % x_length; i < actual_chunk_size; i++) {
+				SET_VECTOR_ELT(chunk, i, VECTOR_ELT(x, ti));
+				ti = ti + 1 == x_length ? 0 : ti + 1;
+			}
+			break;
+
+		default:
+			Rf_error("Cannot get a chunk of SEXP of this type");
 		}
 	}
 
 	R_xlen_t R_chunk_start_index = chunk_start_index + 1;
 	R_xlen_t R_chunk_end_index   = chunk_start_index + actual_chunk_size;
 
-	bool R_chunk_start_index_fits_in_int = R_chunk_start_index > INT_MAX;
-	bool R_chunk_end_index_fits_in_int   = R_chunk_end_index   > INT_MAX;
+	bool R_chunk_start_index_fits_in_int = R_chunk_start_index <= INT_MAX;
+	bool R_chunk_end_index_fits_in_int   = R_chunk_end_index   <= INT_MAX;
 
 	SEXP start_value;
 	if (R_chunk_start_index_fits_in_int) {
@@ -389,48 +717,6 @@ SEXP ufo_get_chunk(SEXP x, SEXP chunk_sexp, SEXP chunk_size_sexp, SEXP result_le
 	return chunk;
 }
 
-SEXP __ufo_calculate_chunk_indices(SEXP x_length_sexp, SEXP y_length_sexp, SEXP chunk_sexp, SEXP chunk_size_sexp) {
-
-	R_xlen_t x_length   = XLENGTH(x_length_sexp);
-	R_xlen_t y_length   = XLENGTH(y_length_sexp);
-	R_xlen_t chunk      = __extract_R_xlen_t_or_die(chunk_sexp);
-	R_xlen_t chunk_size = __extract_R_xlen_t_or_die(chunk_size_sexp);
-
-	bool x_is_bigger = x_length >= y_length ? x_length : y_length;
-	bool y_is_bigger = !x_is_bigger;
-
-	R_xlen_t bigger_vector_size  			= x_is_bigger ? x_length : y_length;
-	R_xlen_t smaller_vector_size 			= y_is_bigger ? x_length : y_length;
-
-	R_xlen_t bigger_chunk_beginning         = (chunk - 1) * chunk_size + 1;
-	R_xlen_t bigger_chunk_expected_ending   = bigger_chunk_beginning + chunk_size - 1;
-	R_xlen_t bigger_chunk_ending            = MIN(bigger_chunk_expected_ending, bigger_vector_size);
-	R_xlen_t actual_chunk_size              = bigger_chunk_ending - bigger_chunk_beginning + 1;
-
-	R_xlen_t smaller_chunk_beginning        = (bigger_chunk_beginning - 1) % smaller_vector_size + 1;
-	R_xlen_t smaller_chunk_expected_ending  = smaller_chunk_beginning + actual_chunk_size - 1;
-	R_xlen_t smaller_chunk_ending           = MIN(smaller_chunk_expected_ending, smaller_vector_size);
-
-	R_xlen_t smaller_chunk_has_runoff       = smaller_chunk_expected_ending > smaller_vector_size;
-	R_xlen_t smaller_chunk_runoff_beginning = 1;
-	R_xlen_t smaller_chunk_runoff_ending    = smaller_chunk_expected_ending - smaller_vector_size;
-
-	SEXP bigger_range   = PROTECT(uncompact_intrange(bigger_chunk_beginning, bigger_chunk_ending, actual_chunk_size));
-	SEXP smaller_range  = PROTECT(uncompact_intrange(smaller_chunk_beginning, smaller_chunk_ending, actual_chunk_size));
-
-	if (smaller_chunk_has_runoff) {
-		smaller_range = uncompact_intrange_fill(smaller_range, smaller_chunk_runoff_beginning, smaller_chunk_runoff_ending);
-	}
-
-	SEXP result = PROTECT(allocVector(VECSXP, 3));
-	SET_VECTOR_ELT(result, 0, x_is_bigger ? bigger_range  : smaller_range);
-	SET_VECTOR_ELT(result, 1, y_is_bigger ? bigger_range  : smaller_range);
-	SET_VECTOR_ELT(result, 2, bigger_range);
-
-	UNPROTECT(3);
-	return result;
-}
-
 //-----------------------------------------------------------------------------
 // Subscript generation
 //-----------------------------------------------------------------------------
@@ -595,6 +881,14 @@ SEXP logical_subscript(SEXP vector, SEXP subscript, int32_t min_load_count) {
 		return allocVector(INTSXP, 0);
 	}
 
+	ufo_packed_t packed_subscript;
+	if (ufo_packed_lookup(subscript, &packed_subscript)) {
+		SEXP result = ufo_packed_logical_subscript(vector, packed_subscript, min_load_count);
+		if (result != R_NilValue) {
+			return result;
+		}
+	}
+
 	R_xlen_t result_length         = logical_subscript_length(vector, subscript); // FIXME makes sure used only once
 	bool     result_vector_is_long = result_length > R_SHORT_LEN_MAX;
 	SEXP     result                = PROTECT(ufo_empty(result_vector_is_long ? REALSXP : INTSXP, result_length, false, min_load_count));
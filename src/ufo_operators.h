@@ -4,17 +4,45 @@
 #include <R.h>
 #include <Rinternals.h>
 
+#include "ufo_kernels.h"
+
+R_xlen_t ufo_vector_size_to_fit_both(SEXPTYPE x_type, SEXPTYPE y_type, R_xlen_t x_length, R_xlen_t y_length);
+R_xlen_t ufo_vector_size_to_mod_both(SEXPTYPE x_type, SEXPTYPE y_type, R_xlen_t x_length, R_xlen_t y_length);
+
+SEXPTYPE ufo_vector_type_to_fit_both(SEXPTYPE x, SEXPTYPE y);
+SEXPTYPE ufo_vector_type_to_div_both(SEXPTYPE x, SEXPTYPE y);
+SEXPTYPE ufo_vector_type_to_mod_both(SEXPTYPE x, SEXPTYPE y);
+SEXPTYPE ufo_vector_type_to_rel_both(SEXPTYPE x, SEXPTYPE y);
+SEXPTYPE ufo_vector_type_to_log_both(SEXPTYPE x, SEXPTYPE y);
+SEXPTYPE ufo_vector_type_to_neg(SEXPTYPE x);
+SEXPTYPE ufo_vector_type_to_not(SEXPTYPE x);
+SEXPTYPE ufo_vector_type_to_math(SEXPTYPE x);
+SEXPTYPE ufo_vector_type_to_abs(SEXPTYPE x);
+
+SEXPTYPE ufo_binary_working_type (ufo_operator_t operator, SEXPTYPE x, SEXPTYPE y);
+SEXPTYPE ufo_unary_working_type  (ufo_operator_t operator, SEXPTYPE x);
+SEXPTYPE ufo_operator_result_type(ufo_operator_t operator, SEXPTYPE working_type);
+ufo_operator_t ufo_as_unary_operator(ufo_operator_t operator);
+
+// Warns the same way R does when operands do not recycle evenly.
+void ufo_check_recycling(R_xlen_t result_length, R_xlen_t x_length, R_xlen_t y_length);
+
 SEXP ufo_fit_result(SEXP x, SEXP y, SEXP/*INTSXP*/ min_load_count);
 SEXP ufo_div_result(SEXP x, SEXP y, SEXP/*INTSXP*/ min_load_count);
 SEXP ufo_mod_result(SEXP x, SEXP y, SEXP/*INTSXP*/ min_load_count);
 SEXP ufo_rel_result(SEXP x, SEXP y, SEXP/*INTSXP*/ min_load_count);
 SEXP ufo_log_result(SEXP x, SEXP y, SEXP/*INTSXP*/ min_load_count);
 SEXP ufo_neg_result(SEXP x,         SEXP/*INTSXP*/ min_load_count);
+SEXP ufo_not_result(SEXP x,         SEXP/*INTSXP*/ min_load_count);
+SEXP ufo_math_result(SEXP x,        SEXP/*INTSXP*/ min_load_count);
+SEXP ufo_abs_result(SEXP x,         SEXP/*INTSXP*/ min_load_count);
+
+SEXP ufo_binary(SEXP/*STRSXP*/ operator, SEXP x, SEXP y, SEXP result, SEXP/*REALSXP*/ chunk_size);
+SEXP ufo_unary (SEXP/*STRSXP*/ operator, SEXP x,         SEXP result, SEXP/*REALSXP*/ chunk_size);
 
 SEXP ufo_subset		  (SEXP x, SEXP y,         SEXP/*INTSXP*/ min_load_count);
 SEXP ufo_subset_assign(SEXP x, SEXP y, SEXP z, SEXP/*INTSXP*/ min_load_count);
 
 SEXP ufo_subscript(SEXP vector, SEXP subscript, SEXP min_load_count);
 
-//SEXP ufo_calculate_chunk_indices(SEXP x_length_sexp, SEXP y_length_sexp, SEXP chunk_sexp, SEXP chunk_size_sexp);
 SEXP ufo_get_chunk(SEXP x, SEXP chunk, SEXP chunk_size, SEXP result_length);
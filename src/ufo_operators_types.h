@@ -10,6 +10,15 @@ typedef SEXP (*ufo_mod_result_t)   (SEXP x, SEXP y, SEXP/*INTSXP*/ min_load_coun
 typedef SEXP (*ufo_rel_result_t)   (SEXP x, SEXP y, SEXP/*INTSXP*/ min_load_count);
 typedef SEXP (*ufo_log_result_t)   (SEXP x, SEXP y, SEXP/*INTSXP*/ min_load_count);
 typedef SEXP (*ufo_neg_result_t)   (SEXP x,         SEXP/*INTSXP*/ min_load_count);
+typedef SEXP (*ufo_not_result_t)   (SEXP x,         SEXP/*INTSXP*/ min_load_count);
+
+typedef SEXP (*ufo_binary_t)       (SEXP/*STRSXP*/ operator, SEXP x, SEXP y, SEXP result, SEXP/*REALSXP*/ chunk_size);
+typedef SEXP (*ufo_unary_t)        (SEXP/*STRSXP*/ operator, SEXP x,         SEXP result, SEXP/*REALSXP*/ chunk_size);
+
+typedef SEXP (*ufo_lazy_binary_result_t)(SEXP/*STRSXP*/ operator, SEXP x, SEXP y, SEXP/*INTSXP*/ min_load_count);
+typedef SEXP (*ufo_lazy_unary_result_t) (SEXP/*STRSXP*/ operator, SEXP x,         SEXP/*INTSXP*/ min_load_count);
+
+typedef SEXP (*ufo_fused_t)        (SEXP/*VECSXP*/ tree, SEXP/*INTSXP*/ min_load_count, SEXP/*REALSXP*/ chunk_size);
 
 typedef SEXP (*ufo_subset_t)	   (SEXP x, SEXP y,         SEXP/*INTSXP*/ min_load_count);
 typedef SEXP (*ufo_mutate_t)       (SEXP x, SEXP y, SEXP z, SEXP/*INTSXP*/ min_load_count);
@@ -0,0 +1,478 @@
+#include "ufo_packed.h"
+
+#include <stdlib.h>
+#include <limits.h>
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+#include "../include/ufos.h"
+
+#include "safety_first.h"
+#include "helpers.h"
+#include "ufo_empty.h"
+#include "ufo_operators.h"
+#include "ufo_kernels.h"
+#include "ufo_chunks.h"
+#include "ufo_threads.h"
+
+#define MIN(x, y) (x >= y ? y : x)
+
+//-----------------------------------------------------------------------------
+// Packed vectors
+//-----------------------------------------------------------------------------
+
+// Packed vectors that are alive. The weak reference's key is the UFO, so the
+// key stops matching once the UFO is collected, and copies of the UFO never
+// match. Its value is the RAWSXP holding the bits. Only touched from R's
+// thread.
+typedef struct packed_entry {
+	SEXP                 weak_reference;
+	struct packed_entry *next;
+} packed_entry_t;
+
+static packed_entry_t *__packed_entries = NULL;
+
+typedef struct {
+	SEXP            bits;      // RAWSXP
+	const uint64_t *words;
+	R_xlen_t        length;
+	packed_entry_t *entry;
+} packed_data_t;
+
+bool ufo_packed_lookup(SEXP vector, ufo_packed_t *packed) {
+	if (TYPEOF(vector) != LGLSXP) {
+		return false;
+	}
+	for (packed_entry_t *entry = __packed_entries; entry != NULL; entry = entry->next) {
+		if (R_WeakRefKey(entry->weak_reference) == vector) {
+			packed->length = XLENGTH(vector);
+			packed->words = (const uint64_t *) RAW(R_WeakRefValue(entry->weak_reference));
+			return true;
+		}
+	}
+	return false;
+}
+
+void ufo_pack_logicals(const int *values, R_xlen_t length, uint64_t *words) {
+	for (R_xlen_t offset = 0, block = 0; offset < length; offset += UFO_PACKED_BLOCK_LENGTH, block++) {
+		R_xlen_t block_length = MIN(UFO_PACKED_BLOCK_LENGTH, length - offset);
+		uint64_t trues = 0;
+		uint64_t nas = 0;
+		for (R_xlen_t i = 0; i < block_length; i++) {
+			int value = values[offset + i];
+			trues |= ((uint64_t) (value != NA_LOGICAL && value != 0)) << i;
+			nas   |= ((uint64_t) (value == NA_LOGICAL)) << i;
+		}
+		words[2 * block]     = trues;
+		words[2 * block + 1] = nas;
+	}
+}
+
+// Expands the bits into R's logicals. Runs on the UFO core's thread, but only
+// reads the bits, which are kept alive by the data.
+static int32_t __populate_packed(void* user_data, uintptr_t start, uintptr_t end, unsigned char* target) {
+	packed_data_t *data = (packed_data_t *) user_data;
+	ufo_packed_t packed = { .length = data->length, .words = data->words };
+	int *out = (int *) target;
+	for (R_xlen_t i = (R_xlen_t) start; i < (R_xlen_t) end; i++) {
+		out[i - (R_xlen_t) start] = ufo_packed_get(packed, i);
+	}
+	return 0;
+}
+
+// The entry is only linked (and its weak reference only made) once the result
+// exists, so the destructor may find it still unlinked.
+static void __destroy_packed(void* user_data) {
+	packed_data_t *data = (packed_data_t *) user_data;
+
+	for (packed_entry_t **link = &__packed_entries; *link != NULL; link = &(*link)->next) {
+		if (*link == data->entry) {
+			*link = data->entry->next;
+			break;
+		}
+	}
+	if (data->entry->weak_reference != R_NilValue) {
+		R_ReleaseObject(data->entry->weak_reference);
+	}
+	free(data->entry);
+
+	R_ReleaseObject(data->bits);
+	free(data);
+}
+
+typedef struct {
+	ufo_new_t      ufo_new;
+	ufo_source_t  *source;
+} packed_construction_t;
+
+static SEXP __construct_packed(void *context) {
+	packed_construction_t *construction = (packed_construction_t *) context;
+	return construction->ufo_new(construction->source);
+}
+
+// Until ufo_new returns, nothing owns the source, so it is freed if ufo_new
+// raises an error.
+static void __discard_packed(void *context, Rboolean jump) {
+	if (!jump) {
+		return;
+	}
+	packed_construction_t *construction = (packed_construction_t *) context;
+	packed_data_t *data = (packed_data_t *) construction->source->data;
+	free(data->entry);
+	free(data);
+	free(construction->source);
+}
+
+// Wraps the bits into a read-only logical UFO. Like lazy results, the result
+// is marked as shared, so R copies it (into an ordinary logical vector)
+// rather than modify it.
+static SEXP __packed_result(SEXP/*RAWSXP*/ bits, R_xlen_t length, int32_t min_load_count) {
+	packed_construction_t construction;
+	construction.ufo_new = (ufo_new_t) R_GetCCallable("ufos", "ufo_new");
+
+	ufo_source_t* source = (ufo_source_t*) malloc(sizeof(ufo_source_t));
+	packed_data_t *data = (packed_data_t *) malloc(sizeof(packed_data_t));
+	packed_entry_t *entry = (packed_entry_t *) malloc(sizeof(packed_entry_t));
+	if (source == NULL || data == NULL || entry == NULL) {
+		free(source);
+		free(data);
+		free(entry);
+		Rf_error("Cannot allocate packed logical result");
+	}
+
+	entry->weak_reference = R_NilValue;
+	entry->next = NULL;
+
+	data->bits = bits;
+	data->words = (const uint64_t *) RAW(bits);
+	data->length = length;
+	data->entry = entry;
+
+	source->population_function = &__populate_packed;
+	source->destructor_function = &__destroy_packed;
+	source->writeback_function = NULL;
+	source->vector_type = UFO_LGL;
+	source->element_size = sizeof(int);
+	source->vector_size = length;
+	source->dimensions = NULL;
+	source->dimensions_length = 0;
+	source->min_load_count = __select_min_load_count(min_load_count, source->element_size);
+	source->read_only = true;
+	source->data = (void*) data;
+	construction.source = source;
+
+	SEXP continuation = PROTECT(R_MakeUnwindCont());
+	SEXP result = PROTECT(R_UnwindProtect(&__construct_packed, &construction, &__discard_packed, &construction,
+	                                      continuation));
+
+	// Only now does the result own the data, whose destructor releases the
+	// bits and the entry again.
+	R_PreserveObject(bits);
+	MARK_NOT_MUTABLE(result);
+
+	entry->weak_reference = R_MakeWeakRef(result, bits, R_NilValue, FALSE);
+	R_PreserveObject(entry->weak_reference);
+	entry->next = __packed_entries;
+	__packed_entries = entry;
+
+	UNPROTECT(2);
+	return result;
+}
+
+//-----------------------------------------------------------------------------
+// Operators
+//-----------------------------------------------------------------------------
+
+// Computes a logical operator chunk by chunk into packed bits. Chunks are a
+// multiple of a block long, so workers never share a word. Operands that are
+// packed themselves are combined a word at a time; anything else goes through
+// the ordinary kernels and the result is packed afterwards.
+typedef struct {
+	ufo_operator_t       operator;
+	bool                 unary;
+	SEXPTYPE             working_type;
+	R_xlen_t             length;
+	bool                 packed_operands;
+	ufo_packed_t         x_packed;
+	ufo_packed_t         y_packed;
+	ufo_operand_t        x;
+	ufo_operand_t        y;
+	uint64_t            *words;
+	int                 *values;         // chunk_length per worker
+	unsigned char       *x_scratch;
+	unsigned char       *y_scratch;
+	size_t               scratch_size;   // bytes of scratch per worker
+	R_xlen_t             chunk_length;
+	ufo_kernel_status_t *statuses;       // one per worker
+} packed_job_t;
+
+static void __combine_packed_blocks(packed_job_t *job, R_xlen_t first_block, R_xlen_t blocks) {
+	const uint64_t *x = job->x_packed.words + 2 * first_block;
+	const uint64_t *y = job->unary ? NULL : job->y_packed.words + 2 * first_block;
+	uint64_t *out = job->words + 2 * first_block;
+
+	for (R_xlen_t block = 0; block < blocks; block++) {
+		uint64_t x_true  = x[2 * block];
+		uint64_t x_false = ~x[2 * block] & ~x[2 * block + 1];
+
+		if (job->operator == UFO_OP_NOT) {
+			out[2 * block]     = x_false;
+			out[2 * block + 1] = x[2 * block + 1];
+			continue;
+		}
+
+		uint64_t y_true  = y[2 * block];
+		uint64_t y_false = ~y[2 * block] & ~y[2 * block + 1];
+		uint64_t trues   = job->operator == UFO_OP_AND ? x_true & y_true   : x_true | y_true;
+		uint64_t falses  = job->operator == UFO_OP_AND ? x_false | y_false : x_false & y_false;
+		out[2 * block]     = trues;
+		out[2 * block + 1] = ~(trues | falses);
+	}
+
+	// Bits past the end stay 0, ! would turn them on.
+	R_xlen_t last_block = ufo_packed_blocks(job->length) - 1;
+	R_xlen_t tail = job->length % UFO_PACKED_BLOCK_LENGTH;
+	if (tail != 0 && first_block + blocks - 1 == last_block) {
+		uint64_t mask = (((uint64_t) 1) << tail) - 1;
+		job->words[2 * last_block]     &= mask;
+		job->words[2 * last_block + 1] &= mask;
+	}
+}
+
+static void __compute_packed_chunk(void *context, int worker, R_xlen_t start, R_xlen_t length) {
+	packed_job_t *job = (packed_job_t *) context;
+	R_xlen_t first_block = start / UFO_PACKED_BLOCK_LENGTH;
+
+	if (job->packed_operands) {
+		__combine_packed_blocks(job, first_block, ufo_packed_blocks(length));
+		return;
+	}
+
+	ufo_kernel_status_t *status = &job->statuses[worker];
+	int *values = job->values + worker * job->chunk_length;
+
+	ufo_region_t x_region = ufo_operand_region(&job->x, job->working_type, start, length,
+	                                           job->x_scratch + worker * job->scratch_size);
+	if (job->unary) {
+		ufo_unary_kernel(job->operator, job->working_type, x_region.data, values, length, status);
+	} else {
+		ufo_region_t y_region = ufo_operand_region(&job->y, job->working_type, start, length,
+		                                           job->y_scratch + worker * job->scratch_size);
+		ufo_binary_kernel(job->operator, job->working_type, x_region, y_region, values, length, status);
+	}
+
+	ufo_pack_logicals(values, length, job->words + 2 * first_block);
+}
+
+static SEXP __run_packed_job(packed_job_t *job, int32_t min_load_count) {
+	SEXP inputs[2] = { job->x.sexp, job->y.sexp };
+	R_xlen_t chunk_size = ufo_plan_chunk_size(inputs, job->unary ? 1 : 2, 0, min_load_count, job->length);
+	chunk_size = ufo_packed_blocks(chunk_size) * UFO_PACKED_BLOCK_LENGTH;
+	job->chunk_length = MIN(chunk_size, job->length);
+
+	int threads = ufo_threads_from_option();
+	if (!job->packed_operands) {
+		ufo_operand_prepare(&job->x, job->working_type, job->length, job->chunk_length, false);
+		if (!job->unary) {
+			ufo_operand_prepare(&job->y, job->working_type, job->length, job->chunk_length, false);
+		}
+		if (ufo_operand_needs_r(&job->x) || (!job->unary && ufo_operand_needs_r(&job->y))) {
+			threads = 1;
+		}
+
+		size_t working_element_size = ufo_working_type_element_size(job->working_type);
+		job->scratch_size = job->chunk_length * working_element_size;
+		job->x_scratch = (unsigned char *) R_alloc(threads, job->scratch_size);
+		job->y_scratch = job->unary ? NULL : (unsigned char *) R_alloc(threads, job->scratch_size);
+		job->values = (int *) R_alloc(threads * job->chunk_length, sizeof(int));
+	}
+
+	job->statuses = (ufo_kernel_status_t *) R_alloc(threads, sizeof(ufo_kernel_status_t));
+	for (int i = 0; i < threads; i++) {
+		job->statuses[i].integer_overflow = false;
+		job->statuses[i].lost_accuracy = false;
+		job->statuses[i].nan_produced = false;
+	}
+
+	// The bits live in a raw UFO rather than on R's heap, so that the UFO core
+	// can write them out under memory pressure like any other vector.
+	SEXP bits = PROTECT(ufo_empty(UFO_RAW, 2 * ufo_packed_blocks(job->length) * sizeof(uint64_t), false, 0));
+	job->words = (uint64_t *) RAW(bits);
+
+	ufo_parallel_for(job->length, chunk_size, threads, &__compute_packed_chunk, job);
+
+	ufo_kernel_status_t status = { .integer_overflow = false, .lost_accuracy = false, .nan_produced = false };
+	for (int i = 0; i < threads; i++) {
+		status.integer_overflow |= job->statuses[i].integer_overflow;
+		status.lost_accuracy    |= job->statuses[i].lost_accuracy;
+		status.nan_produced     |= job->statuses[i].nan_produced;
+	}
+	ufo_kernel_status_report(status);
+
+	SEXP result = __packed_result(bits, job->length, min_load_count);
+	UNPROTECT(1);
+	return result;
+}
+
+SEXP ufo_packed_binary(SEXP/*STRSXP*/ operator_sexp, SEXP x, SEXP y, SEXP/*INTSXP*/ min_load_count) {
+	ufo_operator_t operator = __extract_operator_or_die(operator_sexp);
+	if (ufo_operator_is_arithmetic(operator)) {
+		return R_NilValue;
+	}
+
+	SEXPTYPE working_type = ufo_binary_working_type(operator, TYPEOF(x), TYPEOF(y));
+	if (working_type == NILSXP) {
+		return R_NilValue;
+	}
+
+	packed_job_t job;
+	job.operator     = operator;
+	job.unary        = false;
+	job.working_type = working_type;
+	job.x            = ufo_operand_from(x);
+	job.y            = ufo_operand_from(y);
+	job.length       = ufo_vector_size_to_fit_both(job.x.type, job.y.type, job.x.length, job.y.length);
+	if (job.length == 0) {
+		return R_NilValue;
+	}
+
+	job.packed_operands = (operator == UFO_OP_AND || operator == UFO_OP_OR)
+		&& ufo_packed_lookup(x, &job.x_packed)
+		&& ufo_packed_lookup(y, &job.y_packed)
+		&& job.x.length == job.y.length;
+
+	ufo_check_recycling(job.length, job.x.length, job.y.length);
+	return __run_packed_job(&job, __extract_int_or_die(min_load_count));
+}
+
+SEXP ufo_packed_unary(SEXP/*STRSXP*/ operator_sexp, SEXP x, SEXP/*INTSXP*/ min_load_count) {
+	ufo_operator_t operator = ufo_as_unary_operator(__extract_operator_or_die(operator_sexp));
+	if (operator != UFO_OP_NOT) {
+		return R_NilValue;
+	}
+
+	SEXPTYPE working_type = ufo_unary_working_type(operator, TYPEOF(x));
+	if (working_type == NILSXP || XLENGTH(x) == 0) {
+		return R_NilValue;
+	}
+
+	packed_job_t job;
+	job.operator        = operator;
+	job.unary           = true;
+	job.working_type    = working_type;
+	job.x               = ufo_operand_from(x);
+	job.y               = job.x;
+	job.length          = job.x.length;
+	job.packed_operands = ufo_packed_lookup(x, &job.x_packed);
+
+	return __run_packed_job(&job, __extract_int_or_die(min_load_count));
+}
+
+//-----------------------------------------------------------------------------
+// Consumers
+//-----------------------------------------------------------------------------
+
+SEXP ufo_packed_sum(SEXP x, SEXP/*LGLSXP*/ na_rm_sexp) {
+	ufo_packed_t packed;
+	if (!ufo_packed_lookup(x, &packed)) {
+		return R_NilValue;
+	}
+
+	bool na_rm = __extract_boolean_or_die(na_rm_sexp);
+	R_xlen_t blocks = ufo_packed_blocks(packed.length);
+	R_xlen_t count = 0;
+	for (R_xlen_t block = 0; block < blocks; block++) {
+		if (!na_rm && packed.words[2 * block + 1] != 0) {
+			return ScalarInteger(NA_INTEGER);
+		}
+		count += __builtin_popcountll(packed.words[2 * block]);
+	}
+
+	// Same as R, which sums logicals as integers.
+	if (count > INT_MAX) {
+		Rf_warning("integer overflow - use sum(as.numeric(.))");
+		return ScalarInteger(NA_INTEGER);
+	}
+	return ScalarInteger((int) count);
+}
+
+SEXP ufo_packed_which(SEXP x, SEXP/*INTSXP*/ min_load_count) {
+	ufo_packed_t packed;
+	if (!ufo_packed_lookup(x, &packed)) {
+		return R_NilValue;
+	}
+
+	R_xlen_t blocks = ufo_packed_blocks(packed.length);
+	R_xlen_t count = 0;
+	for (R_xlen_t block = 0; block < blocks; block++) {
+		count += __builtin_popcountll(packed.words[2 * block]);
+	}
+
+	if (count == 0) {
+		return allocVector(INTSXP, 0);
+	}
+
+	bool result_is_long = packed.length > R_SHORT_LEN_MAX;
+	SEXP result = PROTECT(ufo_empty(result_is_long ? UFO_REAL : UFO_INT, count, false,
+	                                __extract_int_or_die(min_load_count)));
+	int    *integers = result_is_long ? NULL : INTEGER(result);
+	double *reals    = result_is_long ? REAL(result) : NULL;
+
+	R_xlen_t result_index = 0;
+	for (R_xlen_t block = 0; block < blocks; block++) {
+		for (uint64_t trues = packed.words[2 * block]; trues != 0; trues &= trues - 1) {
+			R_xlen_t index = block * UFO_PACKED_BLOCK_LENGTH + __builtin_ctzll(trues) + 1;
+			if (result_is_long) reals[result_index++] = (double) index;
+			else                integers[result_index++] = (int) index;
+		}
+	}
+
+	UNPROTECT(1);
+	return result;
+}
+
+SEXP ufo_packed_logical_subscript(SEXP vector, ufo_packed_t subscript, int32_t min_load_count) {
+	R_xlen_t vector_length = XLENGTH(vector);
+	if (subscript.length < vector_length) {
+		return R_NilValue;
+	}
+
+	// Every element that is not FALSE selects an index, which is NA if the
+	// element is NA or past the end of the vector.
+	R_xlen_t blocks = ufo_packed_blocks(subscript.length);
+	R_xlen_t result_length = 0;
+	for (R_xlen_t block = 0; block < blocks; block++) {
+		result_length += __builtin_popcountll(subscript.words[2 * block] | subscript.words[2 * block + 1]);
+	}
+
+	if (result_length == 0) {
+		return allocVector(INTSXP, 0);
+	}
+
+	bool result_is_long = result_length > R_SHORT_LEN_MAX;
+	SEXP result = PROTECT(ufo_empty(result_is_long ? UFO_REAL : UFO_INT, result_length, false, min_load_count));
+	int    *integers = result_is_long ? NULL : INTEGER(result);
+	double *reals    = result_is_long ? REAL(result) : NULL;
+
+	R_xlen_t result_index = 0;
+	for (R_xlen_t block = 0; block < blocks; block++) {
+		uint64_t nas = subscript.words[2 * block + 1];
+		for (uint64_t selected = subscript.words[2 * block] | nas; selected != 0; selected &= selected - 1) {
+			int bit = __builtin_ctzll(selected);
+			R_xlen_t index = block * UFO_PACKED_BLOCK_LENGTH + bit;
+			bool na = (nas & (((uint64_t) 1) << bit)) != 0 || index >= vector_length;
+			if (result_is_long) reals[result_index++]    = na ? NA_REAL    : (double) (index + 1);
+			else                integers[result_index++] = na ? NA_INTEGER : (int) (index + 1);
+		}
+	}
+
+	UNPROTECT(1);
+	return result;
+}
+
+SEXP ufo_is_packed(SEXP x) {
+	ufo_packed_t packed;
+	return ScalarLogical(ufo_packed_lookup(x, &packed));
+}
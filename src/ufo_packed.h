@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+// Logical vectors packed into 2 bits per element. Elements are grouped into
+// blocks of 64, and every block is a pair of words: the first has the bits of
+// the elements that are TRUE, the second the bits of those that are NA.
+// Elements that are in neither are FALSE. Bits past the end of the vector are
+// always 0 in both words.
+//
+// Packed vectors are presented to R as read-only logical UFOs that expand the
+// bits into R's 4 byte logicals only when their memory is touched, so code
+// that knows about them (subscripts, ! & |, ufo_sum, ufo_which) reads the bits
+// directly and never faults the logicals in.
+#define UFO_PACKED_BLOCK_LENGTH 64
+
+typedef struct {
+	R_xlen_t        length;
+	const uint64_t *words;    // 2 per block
+} ufo_packed_t;
+
+static inline R_xlen_t ufo_packed_blocks(R_xlen_t length) {
+	return (length + UFO_PACKED_BLOCK_LENGTH - 1) / UFO_PACKED_BLOCK_LENGTH;
+}
+
+static inline int ufo_packed_get(ufo_packed_t packed, R_xlen_t index) {
+	R_xlen_t block = index / UFO_PACKED_BLOCK_LENGTH;
+	uint64_t bit = ((uint64_t) 1) << (index % UFO_PACKED_BLOCK_LENGTH);
+	if (packed.words[2 * block + 1] & bit) return NA_LOGICAL;
+	return (packed.words[2 * block] & bit) != 0;
+}
+
+// Finds the bits behind a packed logical UFO. Returns false for any other
+// vector, including copies of packed vectors, which R makes into ordinary
+// logical vectors.
+bool ufo_packed_lookup(SEXP vector, ufo_packed_t *packed);
+
+// Packs `length` logicals into the blocks starting at `words`.
+void ufo_pack_logicals(const int *values, R_xlen_t length, uint64_t *words);
+
+// Comparisons, & and | as packed results. Return NULL for other operators and
+// for operands that the native operators do not support.
+SEXP ufo_packed_binary(SEXP/*STRSXP*/ operator, SEXP x, SEXP y, SEXP/*INTSXP*/ min_load_count);
+SEXP ufo_packed_unary (SEXP/*STRSXP*/ operator, SEXP x,         SEXP/*INTSXP*/ min_load_count);
+
+// sum and which straight from the bits. Return NULL if `x` is not packed.
+SEXP ufo_packed_sum  (SEXP x, SEXP/*LGLSXP*/ na_rm);
+SEXP ufo_packed_which(SEXP x, SEXP/*INTSXP*/ min_load_count);
+
+// Indices of a vector selected by a packed logical subscript (see
+// logical_subscript). Returns NULL if the subscript is shorter than the
+// vector, which the generic implementation recycles.
+SEXP ufo_packed_logical_subscript(SEXP vector, ufo_packed_t subscript, int32_t min_load_count);
+
+SEXP ufo_is_packed(SEXP x);
@@ -0,0 +1,655 @@
+#include "ufo_quantile.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+#include "safety_first.h"
+#include "helpers.h"
+#include "ufo_chunks.h"
+#include "ufo_threads.h"
+#include "ufo_radix.h"
+
+#define MIN(x, y) (x >= y ? y : x)
+
+typedef enum {
+	UFO_QUANTILE_EXACT,
+	UFO_QUANTILE_SKETCH,
+} ufo_quantile_method_t;
+
+typedef struct {
+	const char             *name;
+	ufo_quantile_method_t   method;
+} quantile_method_name_t;
+
+static const quantile_method_name_t __quantile_method_names[] = {
+	{ "exact",  UFO_QUANTILE_EXACT  },
+	{ "sketch", UFO_QUANTILE_SKETCH },
+	{ NULL,     0                   },
+};
+
+static ufo_quantile_method_t __extract_quantile_method_or_die(SEXP/*STRSXP*/ method) {
+	if (TYPEOF(method) != STRSXP || XLENGTH(method) != 1) {
+		Rf_error("Invalid quantile method: expecting a single string, but found %s",
+		         type2char(TYPEOF(method)));
+	}
+
+	const char *name = CHAR(STRING_ELT(method, 0));
+	for (const quantile_method_name_t *entry = __quantile_method_names; entry->name != NULL; entry++) {
+		if (strcmp(entry->name, name) == 0) {
+			return entry->method;
+		}
+	}
+
+	Rf_error("Unknown quantile method: %s", name);
+	return 0; // Mollifies linters.
+}
+
+// The values of the vector, a chunk at a time.
+typedef struct {
+	SEXPTYPE        working_type;
+	ufo_operand_t   x;
+	R_xlen_t        chunk_size;
+	unsigned char  *scratch;
+	size_t          scratch_size;   // bytes of scratch per worker
+} quantile_source_t;
+
+static inline const void *__source_region(const quantile_source_t *source, int worker, R_xlen_t start,
+                                          R_xlen_t length) {
+	return ufo_operand_region(&source->x, source->working_type, start, length,
+	                          source->scratch + worker * source->scratch_size).data;
+}
+
+//-----------------------------------------------------------------------------
+// Type 7 quantiles from order statistics
+//-----------------------------------------------------------------------------
+
+typedef double (*order_statistic_t)(void *context, R_xlen_t rank);
+
+// Mirrors type 7 of quantile.default: interpolates between the order
+// statistics around (n - 1) * p. Ranks are 0-based.
+static void __type_7_quantiles(const double *probs, R_xlen_t number_of_probs, R_xlen_t n,
+                               order_statistic_t order_statistic, void *context, double *quantiles) {
+	for (R_xlen_t i = 0; i < number_of_probs; i++) {
+		if (ISNAN(probs[i]) || n == 0) {
+			quantiles[i] = NA_REAL;
+			continue;
+		}
+
+		double index = 1 + (double) (n - 1) * probs[i];
+		double lo = floor(index);
+		double hi = ceil(index);
+		double quantile = order_statistic(context, (R_xlen_t) lo - 1);
+		double upper = order_statistic(context, (R_xlen_t) hi - 1);
+		if (index > lo && upper != quantile) {
+			double h = index - lo;
+			quantile = (1 - h) * quantile + h * upper;
+		}
+		quantiles[i] = quantile;
+	}
+}
+
+// The 0-based ranks of the order statistics that type 7 quantiles at probs
+// interpolate between, without repetitions. Returns how many there are.
+static R_xlen_t __type_7_ranks(const double *probs, R_xlen_t number_of_probs, R_xlen_t n, R_xlen_t *ranks) {
+	R_xlen_t number_of_ranks = 0;
+	for (R_xlen_t i = 0; i < number_of_probs && n > 0; i++) {
+		if (ISNAN(probs[i])) {
+			continue;
+		}
+		double index = 1 + (double) (n - 1) * probs[i];
+		R_xlen_t bounds[2] = { (R_xlen_t) floor(index) - 1, (R_xlen_t) ceil(index) - 1 };
+		for (int bound = 0; bound < 2; bound++) {
+			bool seen = false;
+			for (R_xlen_t j = 0; j < number_of_ranks; j++) {
+				seen |= ranks[j] == bounds[bound];
+			}
+			if (!seen) {
+				ranks[number_of_ranks++] = bounds[bound];
+			}
+		}
+	}
+	return number_of_ranks;
+}
+
+//-----------------------------------------------------------------------------
+// Exact: radix selection
+//-----------------------------------------------------------------------------
+
+#define SELECT_BITS    8
+#define SELECT_BUCKETS (1 << SELECT_BITS)
+
+// An order statistic being selected. Its key is known to start with `prefix`,
+// which `candidates` keys do, and it is the `rank`-th of those.
+typedef struct {
+	R_xlen_t   original_rank;
+	R_xlen_t   rank;            // 0-based, among the candidates
+	uint64_t   prefix;          // the top `resolved` bits of the key
+	int        resolved;
+	R_xlen_t   candidates;
+	bool       collecting;      // few enough candidates to sort in memory
+	uint64_t  *collected;
+	R_xlen_t   collected_count;
+	bool       done;
+	uint64_t   key;             // once done
+} select_target_t;
+
+typedef struct {
+	quantile_source_t   source;
+	int                 key_bits;         // 32 for integers, 64 for doubles
+	bool                counting;         // first pass: counts missing values
+	R_xlen_t           *missing;          // one per chunk
+	select_target_t    *targets;
+	R_xlen_t            number_of_targets;
+	R_xlen_t           *histograms;       // per worker: SELECT_BUCKETS per target
+} select_job_t;
+
+// Keys the i-th value, unless it is missing.
+static inline bool __key_at(SEXPTYPE working_type, const void *values, R_xlen_t i, uint64_t *key) {
+	if (working_type == INTSXP) {
+		int value = ((const int *) values)[i];
+		*key = ufo_radix_integer_key(value);
+		return value != NA_INTEGER;
+	}
+	double value = ((const double *) values)[i];
+	*key = ufo_radix_double_key(value);
+	return !ISNAN(value);
+}
+
+static void __select_chunk(void *context, int worker, R_xlen_t start, R_xlen_t length) {
+	select_job_t *job = (select_job_t *) context;
+	const void *values = __source_region(&job->source, worker, start, length);
+	SEXPTYPE working_type = job->source.working_type;
+
+	if (job->counting) {
+		R_xlen_t missing = 0;
+		for (R_xlen_t i = 0; i < length; i++) {
+			uint64_t key;
+			missing += !__key_at(working_type, values, i, &key);
+		}
+		job->missing[start / job->source.chunk_size] = missing;
+		return;
+	}
+
+	R_xlen_t *histograms = job->histograms + worker * job->number_of_targets * SELECT_BUCKETS;
+	for (R_xlen_t i = 0; i < length; i++) {
+		uint64_t key;
+		if (!__key_at(working_type, values, i, &key)) {
+			continue;
+		}
+
+		for (R_xlen_t t = 0; t < job->number_of_targets; t++) {
+			select_target_t *target = &job->targets[t];
+			if (target->done) {
+				continue;
+			}
+			if (target->resolved > 0 && (key >> (job->key_bits - target->resolved)) != target->prefix) {
+				continue;
+			}
+			if (target->collecting) {
+				R_xlen_t position = __atomic_fetch_add(&target->collected_count, 1, __ATOMIC_RELAXED);
+				target->collected[position] = key;
+			} else {
+				int shift = job->key_bits - target->resolved - SELECT_BITS;
+				histograms[t * SELECT_BUCKETS + ((key >> shift) & (SELECT_BUCKETS - 1))]++;
+			}
+		}
+	}
+}
+
+static int __compare_keys(const void *a, const void *b) {
+	uint64_t key_a = *(const uint64_t *) a;
+	uint64_t key_b = *(const uint64_t *) b;
+	return (key_a > key_b) - (key_a < key_b);
+}
+
+// Narrows a target down to the bucket of the histograms its rank falls into.
+static void __narrow(select_job_t *job, select_target_t *target, R_xlen_t t, int threads, R_xlen_t collect_max) {
+	R_xlen_t counts[SELECT_BUCKETS];
+	for (int bucket = 0; bucket < SELECT_BUCKETS; bucket++) {
+		counts[bucket] = 0;
+		for (int worker = 0; worker < threads; worker++) {
+			counts[bucket] += job->histograms[(worker * job->number_of_targets + t) * SELECT_BUCKETS + bucket];
+		}
+	}
+
+	R_xlen_t below = 0;
+	int bucket = 0;
+	while (below + counts[bucket] <= target->rank) {
+		below += counts[bucket++];
+	}
+
+	target->rank -= below;
+	target->prefix = (target->prefix << SELECT_BITS) | (uint64_t) bucket;
+	target->resolved += SELECT_BITS;
+	target->candidates = counts[bucket];
+
+	if (target->resolved == job->key_bits) {
+		target->key = target->prefix;
+		target->done = true;
+	} else if (target->candidates <= collect_max) {
+		target->collecting = true;
+		target->collected = (uint64_t *) R_alloc(target->candidates, sizeof(uint64_t));
+	}
+}
+
+static double __selected_order_statistic(void *context, R_xlen_t rank) {
+	select_job_t *job = (select_job_t *) context;
+	for (R_xlen_t t = 0; t < job->number_of_targets; t++) {
+		if (job->targets[t].original_rank == rank) {
+			uint64_t key = job->targets[t].key;
+			return job->key_bits == 32 ? (double) ufo_radix_integer_from_key((uint32_t) key)
+			                           : ufo_radix_double_from_key(key);
+		}
+	}
+	Rf_error("Order statistic %li was not selected", rank);
+	return NA_REAL; // Mollifies linters.
+}
+
+static void __select_quantiles(quantile_source_t *source, int threads, R_xlen_t length, const double *probs,
+                               R_xlen_t number_of_probs, bool na_rm, double *quantiles) {
+	select_job_t job;
+	job.source = *source;
+	job.key_bits = source->working_type == INTSXP ? 32 : 64;
+
+	R_xlen_t number_of_chunks = (length + source->chunk_size - 1) / source->chunk_size;
+	job.missing = (R_xlen_t *) R_alloc(number_of_chunks, sizeof(R_xlen_t));
+	job.counting = true;
+	ufo_parallel_for(length, source->chunk_size, threads, &__select_chunk, &job);
+
+	R_xlen_t missing = 0;
+	for (R_xlen_t chunk = 0; chunk < number_of_chunks; chunk++) {
+		missing += job.missing[chunk];
+	}
+	if (missing > 0 && !na_rm) {
+		Rf_error("missing values and NaN's not allowed if 'na.rm' is FALSE");
+	}
+	R_xlen_t n = length - missing;
+
+	R_xlen_t *ranks = (R_xlen_t *) R_alloc(2 * number_of_probs + 1, sizeof(R_xlen_t));
+	job.number_of_targets = __type_7_ranks(probs, number_of_probs, n, ranks);
+	job.targets = (select_target_t *) R_alloc(job.number_of_targets + 1, sizeof(select_target_t));
+	job.histograms = (R_xlen_t *) R_alloc((size_t) threads * (job.number_of_targets + 1) * SELECT_BUCKETS,
+	                                      sizeof(R_xlen_t));
+
+	// Collects the candidates once they fit into a chunk.
+	R_xlen_t collect_max = MIN(source->chunk_size, length);
+	for (R_xlen_t t = 0; t < job.number_of_targets; t++) {
+		select_target_t *target = &job.targets[t];
+		target->original_rank = ranks[t];
+		target->rank = ranks[t];
+		target->prefix = 0;
+		target->resolved = 0;
+		target->candidates = n;
+		target->collecting = n <= collect_max;
+		target->collected = target->collecting ? (uint64_t *) R_alloc(n, sizeof(uint64_t)) : NULL;
+		target->done = false;
+	}
+
+	job.counting = false;
+	while (true) {
+		bool pending = false;
+		for (R_xlen_t t = 0; t < job.number_of_targets; t++) {
+			pending |= !job.targets[t].done;
+			job.targets[t].collected_count = 0;
+		}
+		if (!pending) {
+			break;
+		}
+
+		memset(job.histograms, 0, (size_t) threads * job.number_of_targets * SELECT_BUCKETS * sizeof(R_xlen_t));
+		ufo_parallel_for(length, source->chunk_size, threads, &__select_chunk, &job);
+
+		for (R_xlen_t t = 0; t < job.number_of_targets; t++) {
+			select_target_t *target = &job.targets[t];
+			if (target->done) {
+				continue;
+			}
+			if (target->collecting) {
+				qsort(target->collected, target->collected_count, sizeof(uint64_t), &__compare_keys);
+				target->key = target->collected[target->rank];
+				target->done = true;
+			} else {
+				__narrow(&job, target, t, threads, collect_max);
+			}
+		}
+	}
+
+	__type_7_quantiles(probs, number_of_probs, n, &__selected_order_statistic, &job, quantiles);
+}
+
+//-----------------------------------------------------------------------------
+// Sketch: KLL (Karnin, Lang, Liberty, 2016)
+//-----------------------------------------------------------------------------
+
+// Accuracy of the sketch: the capacity of its top level.
+#define SKETCH_K          200
+#define SKETCH_MAX_HEIGHT 64
+
+// A level of the sketch, whose values each stand for 2^level values.
+typedef struct {
+	double    *values;
+	R_xlen_t   size;
+	R_xlen_t   capacity;   // of the buffer
+} compactor_t;
+
+// Compactors keep lower levels smaller than higher ones. A compactor that
+// is full is sorted, and every other value moves up a level, standing for
+// twice as many values. Which half moves up alternates, instead of being
+// picked at random, so the sketch is deterministic.
+//
+// Sketches are updated on worker threads, so they allocate with malloc, and
+// only note that an allocation failed, for R's thread to report.
+typedef struct {
+	compactor_t   levels[SKETCH_MAX_HEIGHT];
+	int           height;
+	R_xlen_t      size;       // values kept
+	R_xlen_t      max_size;   // values kept before compressing
+	R_xlen_t      count;      // values seen
+	R_xlen_t      missing;
+	bool          odd;        // which half of the next compaction moves up
+	bool          failed;
+} sketch_t;
+
+static R_xlen_t __level_capacity(const sketch_t *sketch, int level) {
+	double capacity = ceil(SKETCH_K * pow(2.0 / 3.0, sketch->height - 1 - level));
+	return capacity < 2 ? 2 : (R_xlen_t) capacity;
+}
+
+static void __sketch_grow(sketch_t *sketch) {
+	if (sketch->height == SKETCH_MAX_HEIGHT) {
+		sketch->failed = true;
+		return;
+	}
+	sketch->height++;
+	sketch->max_size = 0;
+	for (int level = 0; level < sketch->height; level++) {
+		sketch->max_size += __level_capacity(sketch, level);
+	}
+}
+
+static void __sketch_init(sketch_t *sketch) {
+	memset(sketch, 0, sizeof(sketch_t));
+	__sketch_grow(sketch);
+}
+
+// Empties the sketch, keeping its buffers.
+static void __sketch_reset(sketch_t *sketch) {
+	for (int level = 0; level < sketch->height; level++) {
+		sketch->levels[level].size = 0;
+	}
+	sketch->height = 0;
+	sketch->size = 0;
+	sketch->count = 0;
+	sketch->missing = 0;
+	sketch->odd = false;
+	__sketch_grow(sketch);
+}
+
+static void __sketch_free(sketch_t *sketch) {
+	for (int level = 0; level < SKETCH_MAX_HEIGHT; level++) {
+		free(sketch->levels[level].values);
+	}
+}
+
+static void __compactor_push(sketch_t *sketch, compactor_t *compactor, double value) {
+	if (compactor->size == compactor->capacity) {
+		R_xlen_t capacity = compactor->capacity == 0 ? 16 : 2 * compactor->capacity;
+		double *values = (double *) realloc(compactor->values, capacity * sizeof(double));
+		if (values == NULL) {
+			sketch->failed = true;
+			return;
+		}
+		compactor->values = values;
+		compactor->capacity = capacity;
+	}
+	compactor->values[compactor->size++] = value;
+	sketch->size++;
+}
+
+static int __compare_doubles(const void *a, const void *b) {
+	double value_a = *(const double *) a;
+	double value_b = *(const double *) b;
+	return (value_a > value_b) - (value_a < value_b);
+}
+
+// Moves every other value of a level up, from the top down, so that the
+// lowest value stays behind if there is an odd number of them.
+static void __sketch_compact(sketch_t *sketch, int level) {
+	compactor_t *compactor = &sketch->levels[level];
+	qsort(compactor->values, compactor->size, sizeof(double), &__compare_doubles);
+
+	R_xlen_t size = compactor->size;
+	for (R_xlen_t i = size - 1; i >= 1; i -= 2) {
+		__compactor_push(sketch, &sketch->levels[level + 1], compactor->values[sketch->odd ? i - 1 : i]);
+	}
+	sketch->odd = !sketch->odd;
+
+	compactor->size = size % 2;
+	sketch->size -= size - compactor->size;
+}
+
+static void __sketch_compress(sketch_t *sketch) {
+	for (int level = 0; level < sketch->height && !sketch->failed; level++) {
+		if (sketch->levels[level].size < __level_capacity(sketch, level)) {
+			continue;
+		}
+		if (level + 1 == sketch->height) {
+			__sketch_grow(sketch);
+			if (sketch->failed) {
+				return;
+			}
+		}
+		__sketch_compact(sketch, level);
+		if (sketch->size < sketch->max_size) {
+			return;
+		}
+	}
+}
+
+static inline void __sketch_update(sketch_t *sketch, double value) {
+	sketch->count++;
+	__compactor_push(sketch, &sketch->levels[0], value);
+	if (sketch->size >= sketch->max_size) {
+		__sketch_compress(sketch);
+	}
+}
+
+static void __sketch_merge(sketch_t *total, const sketch_t *sketch) {
+	while (total->height < sketch->height && !total->failed) {
+		__sketch_grow(total);
+	}
+	for (int level = 0; level < sketch->height; level++) {
+		const compactor_t *compactor = &sketch->levels[level];
+		for (R_xlen_t i = 0; i < compactor->size; i++) {
+			__compactor_push(total, &total->levels[level], compactor->values[i]);
+		}
+	}
+	total->count += sketch->count;
+	total->missing += sketch->missing;
+	total->failed |= sketch->failed;
+
+	while (total->size >= total->max_size && !total->failed) {
+		__sketch_compress(total);
+	}
+}
+
+typedef struct {
+	quantile_source_t   source;
+	R_xlen_t            wave_start;
+	sketch_t           *sketches;   // one per chunk of a wave
+} sketch_job_t;
+
+static void __sketch_chunk(void *context, int worker, R_xlen_t start, R_xlen_t length) {
+	sketch_job_t *job = (sketch_job_t *) context;
+	sketch_t *sketch = &job->sketches[start / job->source.chunk_size];
+	const void *values = __source_region(&job->source, worker, job->wave_start + start, length);
+
+	if (job->source.working_type == INTSXP) {
+		for (R_xlen_t i = 0; i < length; i++) {
+			int value = ((const int *) values)[i];
+			if (value == NA_INTEGER) sketch->missing++;
+			else                     __sketch_update(sketch, (double) value);
+		}
+	} else {
+		for (R_xlen_t i = 0; i < length; i++) {
+			double value = ((const double *) values)[i];
+			if (ISNAN(value)) sketch->missing++;
+			else              __sketch_update(sketch, value);
+		}
+	}
+}
+
+// The values of a sketch in order, each with the number of values it stands
+// for, summed up.
+typedef struct {
+	double    value;
+	R_xlen_t  cumulative_weight;
+} weighted_value_t;
+
+typedef struct {
+	weighted_value_t  *values;
+	R_xlen_t           size;
+} sketch_ranks_t;
+
+static int __compare_weighted_values(const void *a, const void *b) {
+	return __compare_doubles(&((const weighted_value_t *) a)->value, &((const weighted_value_t *) b)->value);
+}
+
+static double __sketched_order_statistic(void *context, R_xlen_t rank) {
+	sketch_ranks_t *ranks = (sketch_ranks_t *) context;
+	R_xlen_t low = 0, high = ranks->size - 1;
+	while (low < high) {
+		R_xlen_t middle = low + (high - low) / 2;
+		if (ranks->values[middle].cumulative_weight > rank) high = middle;
+		else                                                low = middle + 1;
+	}
+	return ranks->values[low].value;
+}
+
+static void __sketch_quantiles(quantile_source_t *source, int threads, R_xlen_t length, const double *probs,
+                               R_xlen_t number_of_probs, bool na_rm, double *quantiles) {
+	sketch_job_t job;
+	job.source = *source;
+	job.sketches = (sketch_t *) R_alloc(threads, sizeof(sketch_t));
+	for (int i = 0; i < threads; i++) {
+		__sketch_init(&job.sketches[i]);
+	}
+	sketch_t total;
+	__sketch_init(&total);
+
+	// Chunks are sketched in waves of one per thread, and the sketches are
+	// merged in chunk order.
+	R_xlen_t wave_length = threads * source->chunk_size;
+	for (job.wave_start = 0; job.wave_start < length; job.wave_start += wave_length) {
+		R_xlen_t length_of_wave = MIN(wave_length, length - job.wave_start);
+		ufo_parallel_for(length_of_wave, source->chunk_size, threads, &__sketch_chunk, &job);
+
+		R_xlen_t chunks = (length_of_wave + source->chunk_size - 1) / source->chunk_size;
+		for (R_xlen_t chunk = 0; chunk < chunks; chunk++) {
+			__sketch_merge(&total, &job.sketches[chunk]);
+			__sketch_reset(&job.sketches[chunk]);
+		}
+		if (total.failed) {
+			break;
+		}
+	}
+
+	for (int i = 0; i < threads; i++) {
+		__sketch_free(&job.sketches[i]);
+	}
+	if (total.failed) {
+		__sketch_free(&total);
+		Rf_error("Cannot allocate memory for a quantile sketch");
+	}
+	if (total.missing > 0 && !na_rm) {
+		__sketch_free(&total);
+		Rf_error("missing values and NaN's not allowed if 'na.rm' is FALSE");
+	}
+
+	sketch_ranks_t ranks;
+	ranks.size = total.size;
+	ranks.values = (weighted_value_t *) R_alloc(total.size + 1, sizeof(weighted_value_t));
+	R_xlen_t i = 0;
+	for (int level = 0; level < total.height; level++) {
+		for (R_xlen_t j = 0; j < total.levels[level].size; j++, i++) {
+			ranks.values[i].value = total.levels[level].values[j];
+			ranks.values[i].cumulative_weight = (R_xlen_t) 1 << level;
+		}
+	}
+	__sketch_free(&total);
+
+	qsort(ranks.values, ranks.size, sizeof(weighted_value_t), &__compare_weighted_values);
+	for (i = 1; i < ranks.size; i++) {
+		ranks.values[i].cumulative_weight += ranks.values[i - 1].cumulative_weight;
+	}
+
+	__type_7_quantiles(probs, number_of_probs, total.count, &__sketched_order_statistic, &ranks, quantiles);
+}
+
+//-----------------------------------------------------------------------------
+// ufo_quantile
+//-----------------------------------------------------------------------------
+
+SEXP ufo_quantile(SEXP x, SEXP/*REALSXP*/ probs, SEXP/*STRSXP*/ method_sexp, SEXP/*LGLSXP*/ na_rm_sexp,
+                  SEXP/*REALSXP*/ chunk_size_sexp) {
+	ufo_quantile_method_t method = __extract_quantile_method_or_die(method_sexp);
+	bool na_rm = __extract_boolean_or_die(na_rm_sexp);
+	R_xlen_t chunk_size = chunk_size_sexp == R_NilValue ? 0 : __extract_R_xlen_t_or_die(chunk_size_sexp);
+	make_sure(chunk_size_sexp == R_NilValue || chunk_size > 0, "Chunk size must be positive, but is %li", chunk_size);
+	make_sure(TYPEOF(probs) == REALSXP, "Probabilities must be doubles, but are %s", type2char(TYPEOF(probs)));
+
+	R_xlen_t number_of_probs = XLENGTH(probs);
+	for (R_xlen_t i = 0; i < number_of_probs; i++) {
+		make_sure(ISNAN(REAL(probs)[i]) || (REAL(probs)[i] >= 0 && REAL(probs)[i] <= 1),
+		          "Probabilities must be between 0 and 1, but one is %f", REAL(probs)[i]);
+	}
+
+	quantile_source_t source;
+	switch (TYPEOF(x)) {
+	case LGLSXP:
+	case INTSXP:  source.working_type = INTSXP;  break;
+	case REALSXP: source.working_type = REALSXP; break;
+	default:      return R_NilValue;
+	}
+
+	source.x = ufo_operand_from(x);
+	R_xlen_t length = source.x.length;
+	SEXP result = PROTECT(allocVector(REALSXP, number_of_probs));
+	if (length == 0) {
+		for (R_xlen_t i = 0; i < number_of_probs; i++) {
+			REAL(result)[i] = NA_REAL;
+		}
+		UNPROTECT(1);
+		return result;
+	}
+
+	if (chunk_size_sexp == R_NilValue) {
+		chunk_size = ufo_plan_chunk_size(&x, 1, 0, 0, length);
+	}
+	source.chunk_size = chunk_size;
+	R_xlen_t chunk_length = MIN(chunk_size, length);
+
+	int threads = ufo_threads_from_option();
+	ufo_operand_prepare(&source.x, source.working_type, length, chunk_length, false);
+	if (ufo_operand_needs_r(&source.x)) {
+		threads = 1;
+	}
+	source.scratch_size = chunk_length * ufo_working_type_element_size(source.working_type);
+	source.scratch = (unsigned char *) R_alloc(threads, source.scratch_size);
+
+	if (method == UFO_QUANTILE_EXACT) {
+		__select_quantiles(&source, threads, length, REAL(probs), number_of_probs, na_rm, REAL(result));
+	} else {
+		__sketch_quantiles(&source, threads, length, REAL(probs), number_of_probs, na_rm, REAL(result));
+	}
+
+	UNPROTECT(1);
+	return result;
+}
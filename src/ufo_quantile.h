@@ -0,0 +1,30 @@
+#pragma once
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+// Quantiles of a logical, integer or double vector at `probs`, like base R's
+// quantile with type 7, without sorting a copy of the vector. Missing values
+// (NA and NaN) are an error unless `na_rm` is set, in which case they are
+// left out. Quantiles at NA probabilities are NA, and so are all quantiles
+// of a vector without values.
+//
+// `method` is one of:
+//  - "exact": radix selection over the chunks. Every pass streams the chunks
+//    on `ufooperators.threads` threads into per-thread histograms of the next
+//    8 bits of every selected order statistic (see ufo_radix.h for how values
+//    are keyed), narrowing it down to the values sharing a longer prefix,
+//    until few enough values share it to collect and sort them in memory.
+//    Doubles take at most 9 passes and integers 5, and usually far fewer.
+//  - "sketch": a single pass into KLL sketches, one per chunk, which are
+//    merged in chunk order, so the result does not depend on the number of
+//    threads. Each sketch keeps about 3 * SKETCH_K values, and the ranks it
+//    answers for are off by about 1.7 / SKETCH_K of the length. Short vectors
+//    are answered exactly.
+//
+// If `chunk_size` is NULL, it is planned from the vector (see
+// ufo_plan_chunk_size). Returns an ordinary double vector, or NULL for
+// vectors of other types, which the caller should hand over to base R.
+SEXP ufo_quantile(SEXP x, SEXP/*REALSXP*/ probs, SEXP/*STRSXP*/ method, SEXP/*LGLSXP*/ na_rm,
+                  SEXP/*REALSXP*/ chunk_size);
@@ -0,0 +1,126 @@
+#include "ufo_radix.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define RADIX_BITS    8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+
+// Sorts unsigned keys by their bytes, least significant first. Each pass
+// scatters the keys into buckets in order, which keeps the sort stable.
+#define __DEFINE_RADIX_PASSES(name, key_type)                                                     \
+static void name(key_type *keys, R_xlen_t *indices, key_type *key_buffer, R_xlen_t *index_buffer,\
+                 R_xlen_t length) {                                                               \
+	enum { PASSES = sizeof(key_type) };                                                           \
+	R_xlen_t counts[PASSES][RADIX_BUCKETS];                                                       \
+	memset(counts, 0, sizeof(counts));                                                            \
+	for (R_xlen_t i = 0; i < length; i++) {                                                       \
+		for (int pass = 0; pass < PASSES; pass++) {                                               \
+			counts[pass][(keys[i] >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;               \
+		}                                                                                         \
+	}                                                                                             \
+                                                                                                  \
+	key_type *from_keys = keys, *to_keys = key_buffer;                                            \
+	R_xlen_t *from_indices = indices, *to_indices = index_buffer;                                 \
+	for (int pass = 0; pass < PASSES; pass++) {                                                   \
+		int shift = pass * RADIX_BITS;                                                            \
+		if (counts[pass][(from_keys[0] >> shift) & (RADIX_BUCKETS - 1)] == length) {              \
+			continue;                                                                             \
+		}                                                                                         \
+                                                                                                  \
+		R_xlen_t offsets[RADIX_BUCKETS];                                                          \
+		R_xlen_t offset = 0;                                                                      \
+		for (int bucket = 0; bucket < RADIX_BUCKETS; bucket++) {                                  \
+			offsets[bucket] = offset;                                                             \
+			offset += counts[pass][bucket];                                                       \
+		}                                                                                         \
+                                                                                                  \
+		for (R_xlen_t i = 0; i < length; i++) {                                                   \
+			R_xlen_t target = offsets[(from_keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;           \
+			to_keys[target] = from_keys[i];                                                       \
+			if (indices != NULL) to_indices[target] = from_indices[i];                            \
+		}                                                                                         \
+                                                                                                  \
+		key_type *swap_keys = from_keys; from_keys = to_keys; to_keys = swap_keys;                \
+		R_xlen_t *swap_indices = from_indices; from_indices = to_indices; to_indices = swap_indices; \
+	}                                                                                             \
+                                                                                                  \
+	if (from_keys != keys) {                                                                      \
+		memcpy(keys, from_keys, length * sizeof(key_type));                                       \
+		if (indices != NULL) memcpy(indices, from_indices, length * sizeof(R_xlen_t));            \
+	}                                                                                             \
+}
+
+__DEFINE_RADIX_PASSES(__radix_passes_32, uint32_t)
+__DEFINE_RADIX_PASSES(__radix_passes_64, uint64_t)
+
+//-----------------------------------------------------------------------------
+// Keys: values mapped onto unsigned integers in the same order
+//-----------------------------------------------------------------------------
+
+// Decreasing order flips all the bits of the keys (see ufo_radix.h).
+static inline uint32_t __integer_key(int value, bool decreasing) {
+	uint32_t key = ufo_radix_integer_key(value);
+	return decreasing ? ~key : key;
+}
+
+static inline int __integer_from_key(uint32_t key, bool decreasing) {
+	return ufo_radix_integer_from_key(decreasing ? ~key : key);
+}
+
+static inline uint64_t __double_key(double value, bool decreasing) {
+	uint64_t key = ufo_radix_double_key(value);
+	return decreasing ? ~key : key;
+}
+
+static inline double __double_from_key(uint64_t key, bool decreasing) {
+	return ufo_radix_double_from_key(decreasing ? ~key : key);
+}
+
+//-----------------------------------------------------------------------------
+// Sorts: keys are made in place, sorted, and turned back into values
+//-----------------------------------------------------------------------------
+
+void ufo_radix_sort_integers(int *values, R_xlen_t *indices, int *value_buffer, R_xlen_t *index_buffer,
+                             R_xlen_t length, bool decreasing) {
+	if (length < 2) {
+		return;
+	}
+
+	uint32_t *keys = (uint32_t *) values;
+	for (R_xlen_t i = 0; i < length; i++) {
+		keys[i] = __integer_key(values[i], decreasing);
+	}
+
+	__radix_passes_32(keys, indices, (uint32_t *) value_buffer, index_buffer, length);
+
+	for (R_xlen_t i = 0; i < length; i++) {
+		values[i] = __integer_from_key(keys[i], decreasing);
+	}
+}
+
+void ufo_radix_sort_doubles(double *values, R_xlen_t *indices, double *value_buffer, R_xlen_t *index_buffer,
+                            R_xlen_t length, bool decreasing) {
+	if (length < 2) {
+		return;
+	}
+
+	// Doubles and their keys are the same size, so the keys replace the values
+	// in place, copied bit by bit.
+	uint64_t *keys = (uint64_t *) (void *) values;
+	for (R_xlen_t i = 0; i < length; i++) {
+		double value;
+		memcpy(&value, &keys[i], sizeof(value));
+		uint64_t key = __double_key(value, decreasing);
+		memcpy(&keys[i], &key, sizeof(key));
+	}
+
+	__radix_passes_64(keys, indices, (uint64_t *) (void *) value_buffer, index_buffer, length);
+
+	for (R_xlen_t i = 0; i < length; i++) {
+		uint64_t key;
+		memcpy(&key, &keys[i], sizeof(key));
+		double value = __double_from_key(key, decreasing);
+		memcpy(&keys[i], &value, sizeof(value));
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+// Stable LSD radix sorts of `length` values, one byte per pass, carrying
+// indices along unless they are NULL. Passes in which all keys have the same
+// byte are skipped, so narrow ranges of values take fewer passes. The buffers
+// must fit `length` elements each. Ties keep their order also when sorting in
+// decreasing order, like base R's radix order does.
+//
+// The values must not be missing (NA or NaN): callers set those aside, to put
+// them where na.last asks. Negative zeros sort as zeros (and become zeros).
+//
+// These do not use the R API, so they can run on any thread.
+void ufo_radix_sort_integers(int *values, R_xlen_t *indices, int *value_buffer, R_xlen_t *index_buffer,
+                             R_xlen_t length, bool decreasing);
+void ufo_radix_sort_doubles(double *values, R_xlen_t *indices, double *value_buffer, R_xlen_t *index_buffer,
+                            R_xlen_t length, bool decreasing);
+
+// Keys that order values as unsigned integers, in increasing order. Flipping
+// the sign bit of two's complement integers orders them as unsigned integers.
+// IEEE doubles order as unsigned integers once negative numbers have all their
+// bits flipped, and positive numbers their sign bit. Negative zeros become
+// zeros.
+static inline uint32_t ufo_radix_integer_key(int value) {
+	return (uint32_t) value ^ ((uint32_t) 1 << 31);
+}
+
+static inline int ufo_radix_integer_from_key(uint32_t key) {
+	return (int) (key ^ ((uint32_t) 1 << 31));
+}
+
+static inline uint64_t ufo_radix_double_key(double value) {
+	if (value == 0) value = 0; // -0 sorts with 0
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return (bits & ((uint64_t) 1 << 63)) ? ~bits : bits | ((uint64_t) 1 << 63);
+}
+
+static inline double ufo_radix_double_from_key(uint64_t key) {
+	uint64_t bits = (key & ((uint64_t) 1 << 63)) ? key ^ ((uint64_t) 1 << 63) : ~key;
+	double value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
@@ -0,0 +1,335 @@
+#include "ufo_reductions.h"
+
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+#include "safety_first.h"
+#include "helpers.h"
+#include "ufo_chunks.h"
+#include "ufo_threads.h"
+#include "ufo_packed.h"
+
+#define MIN(x, y) (x >= y ? y : x)
+
+typedef enum {
+	UFO_REDUCE_SUM,
+	UFO_REDUCE_PROD,
+	UFO_REDUCE_MEAN,
+	UFO_REDUCE_MIN,
+	UFO_REDUCE_MAX,
+	UFO_REDUCE_RANGE,
+} ufo_reduction_t;
+
+typedef struct {
+	const char      *name;
+	ufo_reduction_t  reduction;
+} reduction_name_t;
+
+static const reduction_name_t __reduction_names[] = {
+	{ "sum",   UFO_REDUCE_SUM   },
+	{ "prod",  UFO_REDUCE_PROD  },
+	{ "mean",  UFO_REDUCE_MEAN  },
+	{ "min",   UFO_REDUCE_MIN   },
+	{ "max",   UFO_REDUCE_MAX   },
+	{ "range", UFO_REDUCE_RANGE },
+	{ NULL,    0                },
+};
+
+static ufo_reduction_t __extract_reduction_or_die(SEXP/*STRSXP*/ reduction) {
+	if (TYPEOF(reduction) != STRSXP || XLENGTH(reduction) != 1) {
+		Rf_error("Invalid reduction: expecting a single string, but found %s",
+		         type2char(TYPEOF(reduction)));
+	}
+
+	const char *name = CHAR(STRING_ELT(reduction, 0));
+	for (const reduction_name_t *entry = __reduction_names; entry->name != NULL; entry++) {
+		if (strcmp(entry->name, name) == 0) {
+			return entry->reduction;
+		}
+	}
+
+	Rf_error("Unknown reduction: %s", name);
+	return 0; // Mollifies linters.
+}
+
+//-----------------------------------------------------------------------------
+// Partial results
+//-----------------------------------------------------------------------------
+
+// The reduction of one chunk. Integers (and logicals) are summed exactly into
+// 64 bits. Doubles are summed in long double, like R does, and additionally
+// compensated (Neumaier), so that summing chunk by chunk and then adding up
+// the chunks does not lose what a single running sum would have kept.
+// Minima and maxima of integers are exact as doubles.
+typedef struct {
+	R_xlen_t    count;          // elements that are neither NA nor NaN
+	bool        has_na;
+	bool        has_nan;        // NaN that are not NA, doubles only
+	bool        overflow;       // of the integer sum
+	int64_t     integer_sum;
+	long double sum;
+	long double compensation;
+	long double product;
+	double      minimum;
+	double      maximum;
+} partial_t;
+
+static void __partial_init(partial_t *partial) {
+	partial->count = 0;
+	partial->has_na = false;
+	partial->has_nan = false;
+	partial->overflow = false;
+	partial->integer_sum = 0;
+	partial->sum = 0;
+	partial->compensation = 0;
+	partial->product = 1;
+	partial->minimum = R_PosInf;
+	partial->maximum = R_NegInf;
+}
+
+static void __reduce_integers(ufo_reduction_t reduction, const int *values, R_xlen_t length, partial_t *partial) {
+	for (R_xlen_t i = 0; i < length; i++) {
+		int value = values[i];
+		if (value == NA_INTEGER) {
+			partial->has_na = true;
+			continue;
+		}
+		partial->count++;
+
+		switch (reduction) {
+		case UFO_REDUCE_SUM:
+		case UFO_REDUCE_MEAN:
+			partial->integer_sum += value;
+			break;
+		case UFO_REDUCE_PROD:
+			partial->product *= value;
+			break;
+		default:
+			if (value < partial->minimum) partial->minimum = value;
+			if (value > partial->maximum) partial->maximum = value;
+		}
+	}
+}
+
+static void __reduce_doubles(ufo_reduction_t reduction, const double *values, R_xlen_t length, partial_t *partial) {
+	for (R_xlen_t i = 0; i < length; i++) {
+		double value = values[i];
+		if (ISNAN(value)) {
+			if (R_IsNA(value)) partial->has_na = true;
+			else               partial->has_nan = true;
+			continue;
+		}
+		partial->count++;
+
+		switch (reduction) {
+		case UFO_REDUCE_SUM:
+		case UFO_REDUCE_MEAN:
+			ufo_add_compensated(&partial->sum, &partial->compensation, value);
+			break;
+		case UFO_REDUCE_PROD:
+			partial->product *= value;
+			break;
+		default:
+			if (value < partial->minimum) partial->minimum = value;
+			if (value > partial->maximum) partial->maximum = value;
+		}
+	}
+}
+
+// Adds a chunk's partial result to the total of the chunks before it.
+static void __combine_partials(partial_t *total, const partial_t *partial) {
+	total->count    += partial->count;
+	total->has_na   |= partial->has_na;
+	total->has_nan  |= partial->has_nan;
+	total->overflow |= partial->overflow
+	                || __builtin_add_overflow(total->integer_sum, partial->integer_sum, &total->integer_sum);
+	ufo_add_compensated(&total->sum, &total->compensation, partial->sum);
+	total->compensation += partial->compensation;
+	total->product *= partial->product;
+	if (partial->minimum < total->minimum) total->minimum = partial->minimum;
+	if (partial->maximum > total->maximum) total->maximum = partial->maximum;
+}
+
+//-----------------------------------------------------------------------------
+// Results
+//-----------------------------------------------------------------------------
+
+static const char *__reduction_name(ufo_reduction_t reduction) {
+	for (const reduction_name_t *entry = __reduction_names; entry->name != NULL; entry++) {
+		if (entry->reduction == reduction) {
+			return entry->name;
+		}
+	}
+	return "?";
+}
+
+// Min or max of a vector without any elements that count, like base R.
+static double __empty_extreme(ufo_reduction_t reduction) {
+	bool minimum = reduction == UFO_REDUCE_MIN;
+	Rf_warning("no non-missing arguments to %s; returning %s",
+	           __reduction_name(reduction), minimum ? "Inf" : "-Inf");
+	return minimum ? R_PosInf : R_NegInf;
+}
+
+static SEXP __extreme_result(ufo_reduction_t reduction, SEXPTYPE working_type, const partial_t *total, bool missing) {
+	double value = reduction == UFO_REDUCE_MIN ? total->minimum : total->maximum;
+	if (working_type == INTSXP) {
+		if (missing)           return ScalarInteger(NA_INTEGER);
+		if (total->count == 0) return ScalarReal(__empty_extreme(reduction));
+		return ScalarInteger((int) value);
+	}
+	if (missing && total->has_na) return ScalarReal(NA_REAL);
+	if (missing)                  return ScalarReal(R_NaN);
+	if (total->count == 0)        return ScalarReal(__empty_extreme(reduction));
+	return ScalarReal(value);
+}
+
+static SEXP __result(ufo_reduction_t reduction, SEXPTYPE working_type, const partial_t *total, bool na_rm) {
+	bool missing = !na_rm && (total->has_na || total->has_nan);
+	double missing_value = total->has_na ? NA_REAL : R_NaN;
+
+	switch (reduction) {
+	case UFO_REDUCE_SUM:
+		if (working_type == INTSXP) {
+			if (missing) {
+				return ScalarInteger(NA_INTEGER);
+			}
+			if (total->overflow || total->integer_sum > INT_MAX || total->integer_sum < -INT_MAX) {
+				Rf_warning("integer overflow - use sum(as.numeric(.))");
+				return ScalarInteger(NA_INTEGER);
+			}
+			return ScalarInteger((int) total->integer_sum);
+		}
+		return ScalarReal(missing ? missing_value : (double) ufo_compensated_total(total->sum, total->compensation));
+
+	case UFO_REDUCE_PROD:
+		return ScalarReal(missing ? missing_value : (double) total->product);
+
+	case UFO_REDUCE_MEAN:
+		if (missing)           return ScalarReal(missing_value);
+		if (total->count == 0) return ScalarReal(R_NaN);
+		if (working_type == INTSXP) {
+			return ScalarReal((double) ((long double) total->integer_sum / total->count));
+		}
+		return ScalarReal((double) (ufo_compensated_total(total->sum, total->compensation) / total->count));
+
+	case UFO_REDUCE_MIN:
+	case UFO_REDUCE_MAX:
+		return __extreme_result(reduction, working_type, total, missing);
+
+	case UFO_REDUCE_RANGE: {
+		SEXP minimum = PROTECT(__extreme_result(UFO_REDUCE_MIN, working_type, total, missing));
+		SEXP maximum = PROTECT(__extreme_result(UFO_REDUCE_MAX, working_type, total, missing));
+		SEXPTYPE result_type = TYPEOF(minimum) == INTSXP && TYPEOF(maximum) == INTSXP ? INTSXP : REALSXP;
+		SEXP result = PROTECT(allocVector(result_type, 2));
+		if (result_type == INTSXP) {
+			INTEGER(result)[0] = INTEGER(minimum)[0];
+			INTEGER(result)[1] = INTEGER(maximum)[0];
+		} else {
+			REAL(result)[0] = asReal(minimum);
+			REAL(result)[1] = asReal(maximum);
+		}
+		UNPROTECT(3);
+		return result;
+	}
+	}
+
+	Rf_error("Unknown reduction");
+	return R_NilValue; // Mollifies linters.
+}
+
+//-----------------------------------------------------------------------------
+// Chunked reduction
+//-----------------------------------------------------------------------------
+
+typedef struct {
+	ufo_reduction_t  reduction;
+	SEXPTYPE         working_type;
+	ufo_operand_t    x;
+	R_xlen_t         chunk_size;
+	partial_t       *partials;       // one per chunk
+	unsigned char   *scratch;
+	size_t           scratch_size;   // bytes of scratch per worker
+} reduction_job_t;
+
+static void __reduce_chunk(void *context, int worker, R_xlen_t start, R_xlen_t length) {
+	reduction_job_t *job = (reduction_job_t *) context;
+	partial_t *partial = &job->partials[start / job->chunk_size];
+	__partial_init(partial);
+
+	ufo_region_t region = ufo_operand_region(&job->x, job->working_type, start, length,
+	                                         job->scratch + worker * job->scratch_size);
+	if (job->working_type == INTSXP) {
+		__reduce_integers(job->reduction, (const int *) region.data, length, partial);
+	} else {
+		__reduce_doubles(job->reduction, (const double *) region.data, length, partial);
+	}
+}
+
+SEXP ufo_reduce(SEXP/*STRSXP*/ reduction_sexp, SEXP x, SEXP/*LGLSXP*/ na_rm_sexp, SEXP/*REALSXP*/ chunk_size_sexp) {
+	ufo_reduction_t reduction = __extract_reduction_or_die(reduction_sexp);
+	bool na_rm = __extract_boolean_or_die(na_rm_sexp);
+	R_xlen_t chunk_size = chunk_size_sexp == R_NilValue ? 0 : __extract_R_xlen_t_or_die(chunk_size_sexp);
+	make_sure(chunk_size_sexp == R_NilValue || chunk_size > 0, "Chunk size must be positive, but is %li", chunk_size);
+
+	// Packed logicals are counted straight from their bits.
+	ufo_packed_t packed;
+	if (reduction == UFO_REDUCE_SUM && ufo_packed_lookup(x, &packed)) {
+		return ufo_packed_sum(x, na_rm_sexp);
+	}
+
+	reduction_job_t job;
+	switch (TYPEOF(x)) {
+	case LGLSXP:
+	case INTSXP:  job.working_type = INTSXP;  break;
+	case REALSXP: job.working_type = REALSXP; break;
+	default:      return R_NilValue;
+	}
+
+	job.reduction = reduction;
+	job.x = ufo_operand_from(x);
+	R_xlen_t length = job.x.length;
+
+	// Empty vectors have nothing to prepare: they reduce to 0, NaN, or ±Inf
+	// with base R's warnings.
+	if (length == 0) {
+		partial_t total;
+		__partial_init(&total);
+		return __result(reduction, job.working_type, &total, na_rm);
+	}
+
+	if (chunk_size_sexp == R_NilValue) {
+		chunk_size = ufo_plan_chunk_size(&x, 1, 0, 0, length);
+	}
+	job.chunk_size = chunk_size;
+
+	R_xlen_t chunk_length = MIN(chunk_size, length);
+	R_xlen_t number_of_chunks = (length + chunk_size - 1) / chunk_size;
+
+	int threads = ufo_threads_from_option();
+	ufo_operand_prepare(&job.x, job.working_type, length, chunk_length, false);
+	if (ufo_operand_needs_r(&job.x)) {
+		threads = 1;
+	}
+
+	job.scratch_size = chunk_length * ufo_working_type_element_size(job.working_type);
+	job.scratch = (unsigned char *) R_alloc(threads, job.scratch_size);
+	job.partials = (partial_t *) R_alloc(number_of_chunks, sizeof(partial_t));
+
+	ufo_parallel_for(length, chunk_size, threads, &__reduce_chunk, &job);
+
+	partial_t total;
+	__partial_init(&total);
+	for (R_xlen_t chunk = 0; chunk < number_of_chunks; chunk++) {
+		__combine_partials(&total, &job.partials[chunk]);
+	}
+
+	return __result(reduction, job.working_type, &total, na_rm);
+}
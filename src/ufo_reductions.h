@@ -0,0 +1,35 @@
+#pragma once
+
+#include <math.h>
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+// Reduces a whole logical, integer or double vector to "sum", "prod", "mean",
+// "min", "max" or "range", the same way base R does. The vector is streamed
+// in chunks, each of which is reduced to a partial result on one of the
+// `ufooperators.threads` threads, and partial results are combined in order,
+// so the result does not depend on the number of threads. If `chunk_size` is
+// NULL, it is planned from the vector (see ufo_plan_chunk_size).
+//
+// Returns NULL for vectors of other types, which the caller should hand over
+// to base R.
+SEXP ufo_reduce(SEXP/*STRSXP*/ reduction, SEXP x, SEXP/*LGLSXP*/ na_rm, SEXP/*REALSXP*/ chunk_size);
+
+// Neumaier summation: `compensation` collects what adding `value` to `sum`
+// rounds off, and the sum is `sum` + `compensation`.
+static inline void ufo_add_compensated(long double *sum, long double *compensation, long double value) {
+	long double total = *sum + value;
+	if (fabsl(*sum) >= fabsl(value)) {
+		*compensation += (*sum - total) + value;
+	} else {
+		*compensation += (value - total) + *sum;
+	}
+	*sum = total;
+}
+
+// Infinities make the compensation NaN, but then the sum is right as it is.
+static inline long double ufo_compensated_total(long double sum, long double compensation) {
+	return isfinite(sum) ? sum + compensation : sum;
+}
@@ -0,0 +1,304 @@
+#include "ufo_rolling.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+#include "safety_first.h"
+#include "helpers.h"
+#include "ufo_empty.h"
+#include "ufo_chunks.h"
+#include "ufo_threads.h"
+
+#define MIN(x, y) (x >= y ? y : x)
+
+typedef enum {
+	UFO_ROLL_SUM,
+	UFO_ROLL_MEAN,
+	UFO_ROLL_MAX,
+	UFO_ROLL_MIN,
+} ufo_roll_t;
+
+typedef struct {
+	const char  *name;
+	ufo_roll_t   roll;
+} roll_name_t;
+
+static const roll_name_t __roll_names[] = {
+	{ "sum",  UFO_ROLL_SUM  },
+	{ "mean", UFO_ROLL_MEAN },
+	{ "max",  UFO_ROLL_MAX  },
+	{ "min",  UFO_ROLL_MIN  },
+	{ NULL,   0             },
+};
+
+static ufo_roll_t __extract_roll_or_die(SEXP/*STRSXP*/ roll) {
+	if (TYPEOF(roll) != STRSXP || XLENGTH(roll) != 1) {
+		Rf_error("Invalid rolling window operation: expecting a single string, but found %s",
+		         type2char(TYPEOF(roll)));
+	}
+
+	const char *name = CHAR(STRING_ELT(roll, 0));
+	for (const roll_name_t *entry = __roll_names; entry->name != NULL; entry++) {
+		if (strcmp(entry->name, name) == 0) {
+			return entry->roll;
+		}
+	}
+
+	Rf_error("Unknown rolling window operation: %s", name);
+	return 0; // Mollifies linters.
+}
+
+typedef struct {
+	ufo_roll_t       roll;
+	SEXPTYPE         working_type;
+	SEXPTYPE         result_type;
+	ufo_operand_t    x;
+	R_xlen_t         window;
+	bool             na_rm;
+	unsigned char   *result_data;
+	unsigned char   *scratch;
+	size_t           scratch_size;   // bytes of scratch per worker
+	R_xlen_t        *deques;         // window per worker, maxima and minima only
+} roll_job_t;
+
+//-----------------------------------------------------------------------------
+// Sums and means: a running total
+//-----------------------------------------------------------------------------
+
+// Infinities and missing values are counted rather than added, so that they
+// can leave the window again.
+typedef struct {
+	R_xlen_t     count;
+	R_xlen_t     na;
+	R_xlen_t     nan;        // NaN that are not NA, doubles only
+	R_xlen_t     positive_infinities;
+	R_xlen_t     negative_infinities;
+	int64_t      integer_sum;
+	long double  sum;
+} running_sum_t;
+
+static inline void __running_add(running_sum_t *state, SEXPTYPE working_type, const void *values, R_xlen_t i,
+                                 int sign) {
+	if (working_type == INTSXP) {
+		int value = ((const int *) values)[i];
+		if (value == NA_INTEGER) {
+			state->na += sign;
+		} else {
+			state->count += sign;
+			state->integer_sum += sign * (int64_t) value;
+		}
+		return;
+	}
+
+	double value = ((const double *) values)[i];
+	if (ISNAN(value)) {
+		if (R_IsNA(value)) state->na  += sign;
+		else               state->nan += sign;
+	} else if (value == R_PosInf) {
+		state->positive_infinities += sign;
+	} else if (value == R_NegInf) {
+		state->negative_infinities += sign;
+	} else {
+		state->count += sign;
+		state->sum += sign * (long double) value;
+	}
+}
+
+static inline double __running_result(ufo_roll_t roll, SEXPTYPE working_type, const running_sum_t *state,
+                                      bool na_rm) {
+	if (!na_rm && state->na > 0)  return NA_REAL;
+	if (!na_rm && state->nan > 0) return R_NaN;
+
+	R_xlen_t infinities = state->positive_infinities + state->negative_infinities;
+	double sum;
+	if (state->positive_infinities > 0 && state->negative_infinities > 0) sum = R_NaN;
+	else if (state->positive_infinities > 0)                              sum = R_PosInf;
+	else if (state->negative_infinities > 0)                              sum = R_NegInf;
+	else if (working_type == INTSXP)                                      sum = (double) state->integer_sum;
+	else                                                                  sum = (double) state->sum;
+
+	if (roll == UFO_ROLL_SUM) {
+		return sum;
+	}
+
+	R_xlen_t count = state->count + infinities;
+	if (count == 0)     return R_NaN;
+	if (infinities > 0) return sum;
+	long double total = working_type == INTSXP ? (long double) state->integer_sum : state->sum;
+	return (double) (total / count);
+}
+
+// Region index j is the window's newest element, and j - window its oldest
+// one's predecessor, which leaves the window.
+static void __roll_sums(roll_job_t *job, const void *values, R_xlen_t halo, R_xlen_t start, R_xlen_t length) {
+	running_sum_t state;
+	memset(&state, 0, sizeof(running_sum_t));
+	double *result = ((double *) job->result_data) + start;
+
+	for (R_xlen_t j = 0; j < halo; j++) {
+		__running_add(&state, job->working_type, values, j, 1);
+	}
+	for (R_xlen_t i = 0; i < length; i++) {
+		R_xlen_t j = halo + i;
+		__running_add(&state, job->working_type, values, j, 1);
+		if (j >= job->window) {
+			__running_add(&state, job->working_type, values, j - job->window, -1);
+		}
+		result[i] = start + i < job->window - 1 ? NA_REAL
+		          : __running_result(job->roll, job->working_type, &state, job->na_rm);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Maxima and minima: a monotonic deque
+//-----------------------------------------------------------------------------
+
+// The deque holds the region indices of the window's elements that are not
+// followed by a larger (for maxima) element, so its values decrease and its
+// front is the maximum. Every element enters and leaves it once. Missing
+// values are counted instead.
+#define __DEFINE_ROLL_EXTREMES(name, type, is_missing, is_na, na_value, nan_value, empty_maximum, empty_minimum) \
+static void name(roll_job_t *job, const type *values, R_xlen_t halo, R_xlen_t start, R_xlen_t length,     \
+                 R_xlen_t *deque, bool maximum) {                                                         \
+	type *result = ((type *) job->result_data) + start;                                                   \
+	R_xlen_t window = job->window;                                                                        \
+	R_xlen_t front = 0, size = 0;      /* a ring of `window` indices */                                   \
+	R_xlen_t na = 0, nan = 0;                                                                             \
+                                                                                                          \
+	for (R_xlen_t j = 0; j < halo + length; j++) {                                                        \
+		if (j >= window) {                                                                                \
+			type leaving = values[j - window];                                                            \
+			if (is_missing(leaving)) {                                                                    \
+				if (is_na(leaving)) na--; else nan--;                                                     \
+			} else if (size > 0 && deque[front] == j - window) {                                          \
+				front = (front + 1) % window;                                                             \
+				size--;                                                                                   \
+			}                                                                                             \
+		}                                                                                                 \
+                                                                                                          \
+		type value = values[j];                                                                           \
+		if (is_missing(value)) {                                                                          \
+			if (is_na(value)) na++; else nan++;                                                           \
+		} else {                                                                                          \
+			/* Ties replace the element in the back, which leaves sooner. */                              \
+			while (size > 0) {                                                                            \
+				type back = values[deque[(front + size - 1) % window]];                                   \
+				if (maximum ? value >= back : value <= back) size--; else break;                          \
+			}                                                                                             \
+			deque[(front + size) % window] = j;                                                           \
+			size++;                                                                                       \
+		}                                                                                                 \
+                                                                                                          \
+		if (j < halo) continue;                                                                           \
+		R_xlen_t i = j - halo;                                                                            \
+		if (start + i < window - 1)      result[i] = na_value;                                            \
+		else if (!job->na_rm && na > 0)  result[i] = na_value;                                            \
+		else if (!job->na_rm && nan > 0) result[i] = nan_value;                                           \
+		else if (size == 0)              result[i] = maximum ? empty_maximum : empty_minimum;             \
+		else                             result[i] = values[deque[front]];                                \
+	}                                                                                                     \
+}
+
+#define __INTEGER_IS_MISSING(value) ((value) == NA_INTEGER)
+#define __DOUBLE_IS_MISSING(value)  ISNAN(value)
+
+// Integers are never NaN, and integer windows without values are NA, since
+// infinities are not integers.
+__DEFINE_ROLL_EXTREMES(__roll_integer_extremes, int,    __INTEGER_IS_MISSING, __INTEGER_IS_MISSING,
+                       NA_INTEGER, NA_INTEGER, NA_INTEGER, NA_INTEGER)
+__DEFINE_ROLL_EXTREMES(__roll_double_extremes,  double, __DOUBLE_IS_MISSING,  R_IsNA,
+                       NA_REAL, R_NaN, R_NegInf, R_PosInf)
+
+//-----------------------------------------------------------------------------
+// ufo_roll
+//-----------------------------------------------------------------------------
+
+// Reads the chunk together with the halo of up to window - 1 elements before
+// it, so that every window of the chunk is complete.
+static void __roll_chunk(void *context, int worker, R_xlen_t start, R_xlen_t length) {
+	roll_job_t *job = (roll_job_t *) context;
+	R_xlen_t halo = MIN(job->window - 1, start);
+
+	ufo_region_t region = ufo_operand_region(&job->x, job->working_type, start - halo, length + halo,
+	                                         job->scratch + worker * job->scratch_size);
+
+	switch (job->roll) {
+	case UFO_ROLL_SUM:
+	case UFO_ROLL_MEAN:
+		__roll_sums(job, region.data, halo, start, length);
+		break;
+	default: {
+		R_xlen_t *deque = job->deques + worker * job->window;
+		if (job->working_type == INTSXP) {
+			__roll_integer_extremes(job, (const int *) region.data, halo, start, length, deque,
+			                        job->roll == UFO_ROLL_MAX);
+		} else {
+			__roll_double_extremes(job, (const double *) region.data, halo, start, length, deque,
+			                       job->roll == UFO_ROLL_MAX);
+		}
+	}
+	}
+}
+
+SEXP ufo_roll(SEXP/*STRSXP*/ roll_sexp, SEXP x, SEXP/*REALSXP*/ window_sexp, SEXP/*LGLSXP*/ na_rm_sexp,
+              SEXP/*INTSXP*/ min_load_count_sexp, SEXP/*REALSXP*/ chunk_size_sexp) {
+	roll_job_t job;
+	job.roll = __extract_roll_or_die(roll_sexp);
+	job.window = __extract_R_xlen_t_or_die(window_sexp);
+	make_sure(job.window > 0, "Window must be positive, but is %li", job.window);
+	job.na_rm = __extract_boolean_or_die(na_rm_sexp);
+	int32_t min_load_count = __extract_int_or_die(min_load_count_sexp);
+	R_xlen_t chunk_size = chunk_size_sexp == R_NilValue ? 0 : __extract_R_xlen_t_or_die(chunk_size_sexp);
+	make_sure(chunk_size_sexp == R_NilValue || chunk_size > 0, "Chunk size must be positive, but is %li", chunk_size);
+
+	switch (TYPEOF(x)) {
+	case LGLSXP:
+	case INTSXP:  job.working_type = INTSXP;  break;
+	case REALSXP: job.working_type = REALSXP; break;
+	default:      return R_NilValue;
+	}
+	bool sums = job.roll == UFO_ROLL_SUM || job.roll == UFO_ROLL_MEAN;
+	job.result_type = sums ? REALSXP : job.working_type;
+
+	job.x = ufo_operand_from(x);
+	R_xlen_t length = job.x.length;
+	if (length == 0) {
+		return allocVector(job.result_type, 0);
+	}
+
+	if (chunk_size_sexp == R_NilValue) {
+		chunk_size = ufo_plan_chunk_size(&x, 1, ufo_working_type_element_size(job.result_type),
+		                                 min_load_count, length);
+	}
+
+	// Chunks are read with their halos.
+	R_xlen_t halo_length = job.window - 1 >= length ? length : job.window - 1;
+	R_xlen_t region_length = chunk_size + halo_length >= length ? length : chunk_size + halo_length;
+
+	int threads = ufo_threads_from_option();
+	ufo_operand_prepare(&job.x, job.working_type, length, region_length, false);
+	if (ufo_operand_needs_r(&job.x)) {
+		threads = 1;
+	}
+
+	job.scratch_size = region_length * ufo_working_type_element_size(job.working_type);
+	job.scratch = (unsigned char *) R_alloc(threads, job.scratch_size);
+
+	// Longer windows than that are all NA, and only need as much room.
+	job.window = MIN(job.window, length + 1);
+	job.deques = sums ? NULL : (R_xlen_t *) R_alloc((size_t) threads * job.window, sizeof(R_xlen_t));
+
+	SEXP result = PROTECT(ufo_empty(job.result_type, length, false, min_load_count));
+	job.result_data = (unsigned char *) DATAPTR(result);
+
+	ufo_parallel_for(length, chunk_size, threads, &__roll_chunk, &job);
+
+	UNPROTECT(1);
+	return result;
+}
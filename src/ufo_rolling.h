@@ -0,0 +1,27 @@
+#pragma once
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+// Computes the rolling "sum", "mean", "max" or "min" of a logical, integer or
+// double vector over windows of `window` elements into a new UFO. Element i
+// of the result covers elements i - window + 1 to i, and the first window - 1
+// elements, which have no full window, are NA (like data.table's frollsum,
+// or stats::filter with sides = 1). Missing values make their windows NA (or
+// NaN), like base R's sum and max, unless `na_rm` is set, in which case they
+// are left out: empty windows then sum to 0, average to NaN, and have a max
+// (min) of -Inf (Inf), or NA for integers. Sums and means are doubles, and
+// maxima and minima keep the type of the vector (integer for logicals).
+//
+// Every chunk reads a halo of the window - 1 elements before it, so chunks
+// are independent, and are computed in parallel on `ufooperators.threads`
+// threads. Sums keep a running total, exact for integers and in long double
+// for doubles; maxima and minima keep a monotonic deque of the window. Both
+// take constant time per element. If `chunk_size` is NULL, it is planned from
+// the vector (see ufo_plan_chunk_size).
+//
+// Returns NULL for vectors of other types, which the caller should hand over
+// to base R.
+SEXP ufo_roll(SEXP/*STRSXP*/ roll, SEXP x, SEXP/*REALSXP*/ window, SEXP/*LGLSXP*/ na_rm,
+              SEXP/*INTSXP*/ min_load_count, SEXP/*REALSXP*/ chunk_size);
@@ -0,0 +1,308 @@
+#include "ufo_scans.h"
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+#include "safety_first.h"
+#include "helpers.h"
+#include "ufo_empty.h"
+#include "ufo_chunks.h"
+#include "ufo_threads.h"
+#include "ufo_reductions.h"
+
+#define MIN(x, y) (x >= y ? y : x)
+
+typedef enum {
+	UFO_SCAN_SUM,
+	UFO_SCAN_PROD,
+	UFO_SCAN_MIN,
+	UFO_SCAN_MAX,
+} ufo_scan_kind_t;
+
+typedef struct {
+	const char      *name;
+	ufo_scan_kind_t  scan;
+} scan_name_t;
+
+static const scan_name_t __scan_names[] = {
+	{ "cumsum",  UFO_SCAN_SUM  },
+	{ "cumprod", UFO_SCAN_PROD },
+	{ "cummin",  UFO_SCAN_MIN  },
+	{ "cummax",  UFO_SCAN_MAX  },
+	{ NULL,      0             },
+};
+
+static ufo_scan_kind_t __extract_scan_or_die(SEXP/*STRSXP*/ scan) {
+	if (TYPEOF(scan) != STRSXP || XLENGTH(scan) != 1) {
+		Rf_error("Invalid scan: expecting a single string, but found %s",
+		         type2char(TYPEOF(scan)));
+	}
+
+	const char *name = CHAR(STRING_ELT(scan, 0));
+	for (const scan_name_t *entry = __scan_names; entry->name != NULL; entry++) {
+		if (strcmp(entry->name, name) == 0) {
+			return entry->scan;
+		}
+	}
+
+	Rf_error("Unknown scan: %s", name);
+	return 0; // Mollifies linters.
+}
+
+//-----------------------------------------------------------------------------
+// Running values
+//-----------------------------------------------------------------------------
+
+// The running value of a scan. It is either carried from one chunk into the
+// next, or, in the first pass, it is the partial result of a single chunk
+// scanned from the identity.
+typedef struct {
+	bool        missing;        // integers: an NA (or an overflow) was reached,
+	                            // after which everything is NA
+	bool        overflow;
+	int64_t     integer;        // integer sum, minimum or maximum
+	int64_t     lowest;         // lowest and highest integer sum reached
+	int64_t     highest;        // before `missing`
+	long double sum;            // double sum, or product
+	long double compensation;
+	double      extreme;        // double minimum or maximum
+} scan_state_t;
+
+static void __scan_state_init(ufo_scan_kind_t scan, scan_state_t *state) {
+	state->missing = false;
+	state->overflow = false;
+	state->integer = scan == UFO_SCAN_MIN ? INT_MAX : scan == UFO_SCAN_MAX ? -INT_MAX : 0;
+	state->lowest = 0;
+	state->highest = 0;
+	state->sum = scan == UFO_SCAN_PROD ? 1 : 0;
+	state->compensation = 0;
+	state->extreme = scan == UFO_SCAN_MIN ? R_PosInf : R_NegInf;
+}
+
+// Like R's cummin and cummax, NA and NaN stick once they are reached.
+static inline double __running_extreme(ufo_scan_kind_t scan, double extreme, double value) {
+	if (ISNAN(value) || ISNAN(extreme)) {
+		return extreme + value;
+	}
+	if (scan == UFO_SCAN_MIN) {
+		return value < extreme ? value : extreme;
+	}
+	return value > extreme ? value : extreme;
+}
+
+// Scans a chunk, continuing from `state`, into `target`. Without a target the
+// chunk is only reduced to its partial result, and the integer sum is allowed
+// to leave the range of R's integers: only the carry into the chunk can tell
+// whether it overflows (see __combine_scan_states).
+static void __scan_integers(ufo_scan_kind_t scan, const int *x, int *target, R_xlen_t length, scan_state_t *state) {
+	for (R_xlen_t i = 0; i < length; i++) {
+		if (!state->missing) {
+			int value = x[i];
+			if (value == NA_INTEGER) {
+				state->missing = true;
+			} else if (scan == UFO_SCAN_SUM) {
+				state->integer += value;
+				if (state->integer < state->lowest)  state->lowest  = state->integer;
+				if (state->integer > state->highest) state->highest = state->integer;
+				if (target != NULL && (state->integer > INT_MAX || state->integer < -INT_MAX)) {
+					state->missing = true;
+					state->overflow = true;
+				}
+			} else if (scan == UFO_SCAN_MIN) {
+				if (value < state->integer) state->integer = value;
+			} else {
+				if (value > state->integer) state->integer = value;
+			}
+		}
+		if (target != NULL) {
+			target[i] = state->missing ? NA_INTEGER : (int) state->integer;
+		}
+	}
+}
+
+static void __scan_doubles(ufo_scan_kind_t scan, const double *x, double *target, R_xlen_t length, scan_state_t *state) {
+	for (R_xlen_t i = 0; i < length; i++) {
+		double value = x[i];
+		double running;
+		switch (scan) {
+		case UFO_SCAN_SUM:
+			ufo_add_compensated(&state->sum, &state->compensation, value);
+			running = (double) ufo_compensated_total(state->sum, state->compensation);
+			break;
+		case UFO_SCAN_PROD:
+			state->sum *= value;
+			running = (double) state->sum;
+			break;
+		default:
+			state->extreme = __running_extreme(scan, state->extreme, value);
+			running = state->extreme;
+		}
+		if (target != NULL) {
+			target[i] = running;
+		}
+	}
+}
+
+// Moves the carry past a chunk, given the chunk's partial result.
+static void __combine_scan_states(ufo_scan_kind_t scan, SEXPTYPE working_type, scan_state_t *carry, const scan_state_t *partial) {
+	if (working_type == REALSXP) {
+		switch (scan) {
+		case UFO_SCAN_SUM:
+			ufo_add_compensated(&carry->sum, &carry->compensation, partial->sum);
+			carry->compensation += partial->compensation;
+			break;
+		case UFO_SCAN_PROD:
+			carry->sum *= partial->sum;
+			break;
+		default:
+			carry->extreme = __running_extreme(scan, carry->extreme, partial->extreme);
+		}
+		return;
+	}
+
+	if (carry->missing) {
+		return;
+	}
+
+	switch (scan) {
+	case UFO_SCAN_SUM:
+		if (carry->integer + partial->highest > INT_MAX || carry->integer + partial->lowest < -INT_MAX) {
+			carry->missing = true;
+			carry->overflow = true;
+			return;
+		}
+		carry->integer += partial->integer;
+		break;
+	case UFO_SCAN_MIN:
+		if (partial->integer < carry->integer) carry->integer = partial->integer;
+		break;
+	default:
+		if (partial->integer > carry->integer) carry->integer = partial->integer;
+	}
+	carry->missing = partial->missing;
+}
+
+//-----------------------------------------------------------------------------
+// Chunked scan
+//-----------------------------------------------------------------------------
+
+typedef struct {
+	ufo_scan_kind_t  scan;
+	SEXPTYPE         working_type;
+	ufo_operand_t    x;
+	R_xlen_t         chunk_size;
+	bool             first_pass;
+	scan_state_t    *states;         // one per chunk: partial results, then carries
+	unsigned char   *result_data;
+	size_t           result_element_size;
+	unsigned char   *scratch;
+	size_t           scratch_size;   // bytes of scratch per worker
+} scan_job_t;
+
+static void __scan_chunk(scan_job_t *job, int worker, R_xlen_t start, R_xlen_t length,
+                         scan_state_t *state, bool write) {
+	ufo_region_t region = ufo_operand_region(&job->x, job->working_type, start, length,
+	                                         job->scratch + worker * job->scratch_size);
+	void *target = write ? job->result_data + start * job->result_element_size : NULL;
+	if (job->working_type == INTSXP) {
+		__scan_integers(job->scan, (const int *) region.data, (int *) target, length, state);
+	} else {
+		__scan_doubles(job->scan, (const double *) region.data, (double *) target, length, state);
+	}
+}
+
+static void __scan_chunk_in_pass(void *context, int worker, R_xlen_t start, R_xlen_t length) {
+	scan_job_t *job = (scan_job_t *) context;
+	scan_state_t *state = &job->states[start / job->chunk_size];
+	if (job->first_pass) {
+		__scan_state_init(job->scan, state);
+	}
+	__scan_chunk(job, worker, start, length, state, !job->first_pass);
+}
+
+SEXP ufo_scan(SEXP/*STRSXP*/ scan_sexp, SEXP x, SEXP/*INTSXP*/ min_load_count_sexp, SEXP/*REALSXP*/ chunk_size_sexp) {
+	ufo_scan_kind_t scan = __extract_scan_or_die(scan_sexp);
+	int32_t min_load_count = __extract_int_or_die(min_load_count_sexp);
+	R_xlen_t chunk_size = chunk_size_sexp == R_NilValue ? 0 : __extract_R_xlen_t_or_die(chunk_size_sexp);
+	make_sure(chunk_size_sexp == R_NilValue || chunk_size > 0, "Chunk size must be positive, but is %li", chunk_size);
+
+	scan_job_t job;
+	switch (TYPEOF(x)) {
+	case LGLSXP:
+	case INTSXP:  job.working_type = scan == UFO_SCAN_PROD ? REALSXP : INTSXP; break;
+	case REALSXP: job.working_type = REALSXP;                                  break;
+	default:      return R_NilValue;
+	}
+
+	job.scan = scan;
+	job.x = ufo_operand_from(x);
+	R_xlen_t length = job.x.length;
+	if (length == 0) {
+		return allocVector(job.working_type, 0);
+	}
+
+	job.result_element_size = __get_element_size(job.working_type);
+	if (chunk_size_sexp == R_NilValue) {
+		chunk_size = ufo_plan_chunk_size(&x, 1, job.result_element_size, min_load_count, length);
+	}
+	job.chunk_size = chunk_size;
+
+	R_xlen_t chunk_length = MIN(chunk_size, length);
+	R_xlen_t number_of_chunks = (length + chunk_size - 1) / chunk_size;
+
+	int threads = ufo_threads_from_option();
+	ufo_operand_prepare(&job.x, job.working_type, length, chunk_length, false);
+	if (ufo_operand_needs_r(&job.x)) {
+		threads = 1;
+	}
+
+	job.scratch_size = chunk_length * ufo_working_type_element_size(job.working_type);
+	job.scratch = (unsigned char *) R_alloc(threads, job.scratch_size);
+
+	SEXP result = PROTECT(ufo_empty(job.working_type, length, false, min_load_count));
+	job.result_data = (unsigned char *) DATAPTR(result);
+
+	bool overflow = false;
+	if (threads == 1 || number_of_chunks == 1) {
+		scan_state_t state;
+		__scan_state_init(scan, &state);
+		for (R_xlen_t start = 0; start < length; start += chunk_size) {
+			__scan_chunk(&job, 0, start, MIN(chunk_size, length - start), &state, true);
+		}
+		overflow = state.overflow;
+	} else {
+		job.states = (scan_state_t *) R_alloc(number_of_chunks, sizeof(scan_state_t));
+
+		job.first_pass = true;
+		ufo_parallel_for(length, chunk_size, threads, &__scan_chunk_in_pass, &job);
+
+		// Turns the partial results into the carries into each chunk.
+		scan_state_t carry;
+		__scan_state_init(scan, &carry);
+		for (R_xlen_t chunk = 0; chunk < number_of_chunks; chunk++) {
+			scan_state_t partial = job.states[chunk];
+			job.states[chunk] = carry;
+			__combine_scan_states(scan, job.working_type, &carry, &partial);
+		}
+
+		job.first_pass = false;
+		ufo_parallel_for(length, chunk_size, threads, &__scan_chunk_in_pass, &job);
+
+		for (R_xlen_t chunk = 0; chunk < number_of_chunks; chunk++) {
+			overflow |= job.states[chunk].overflow;
+		}
+	}
+
+	if (overflow) {
+		Rf_warning("integer overflow in 'cumsum'; use 'cumsum(as.numeric(.))'");
+	}
+
+	UNPROTECT(1);
+	return result;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+// Computes "cumsum", "cumprod", "cummin" or "cummax" of a logical, integer or
+// double vector into a new UFO, the same way base R does.
+//
+// On one thread, chunks are scanned in order and the running value is carried
+// from one chunk into the next. On more threads (`ufooperators.threads`), the
+// scan takes two passes: the first reduces every chunk to a partial result in
+// parallel, the partials are combined in order into the running value at the
+// start of each chunk, and the second pass scans the chunks in parallel from
+// there. Integer scans, cummin and cummax are exact either way; sums and
+// products of doubles are accumulated in long double (sums compensated), so
+// the two ways agree to within the last bit. If `chunk_size` is NULL, it is
+// planned from the vector (see ufo_plan_chunk_size).
+//
+// Returns NULL for vectors of other types, which the caller should hand over
+// to base R.
+SEXP ufo_scan(SEXP/*STRSXP*/ scan, SEXP x, SEXP/*INTSXP*/ min_load_count, SEXP/*REALSXP*/ chunk_size);
@@ -0,0 +1,249 @@
+#include "ufo_select.h"
+
+#include <stdbool.h>
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+#include "safety_first.h"
+#include "helpers.h"
+#include "ufo_empty.h"
+#include "ufo_operators.h"
+#include "ufo_kernels.h"
+#include "ufo_chunks.h"
+#include "ufo_threads.h"
+
+#define MIN(x, y) (x >= y ? y : x)
+
+//-----------------------------------------------------------------------------
+// Kernels: regions of `length` elements, broadcast regions are a single one
+//-----------------------------------------------------------------------------
+
+#define __STRIDE(region) ((region).broadcast ? 0 : 1)
+
+static void __ifelse_kernel(SEXPTYPE working_type, ufo_region_t test, ufo_region_t yes, ufo_region_t no,
+                            void *target, R_xlen_t length) {
+	const int *t = (const int *) test.data;
+	R_xlen_t ts = __STRIDE(test), ys = __STRIDE(yes), ns = __STRIDE(no);
+
+	switch (working_type) {
+	case LGLSXP:
+	case INTSXP: {
+		const int *y = (const int *) yes.data, *n = (const int *) no.data;
+		int *out = (int *) target;
+		for (R_xlen_t i = 0; i < length; i++) {
+			int condition = t[i * ts];
+			out[i] = condition == NA_LOGICAL ? NA_INTEGER : (condition ? y[i * ys] : n[i * ns]);
+		}
+		return;
+	}
+	case REALSXP: {
+		const double *y = (const double *) yes.data, *n = (const double *) no.data;
+		double *out = (double *) target;
+		for (R_xlen_t i = 0; i < length; i++) {
+			int condition = t[i * ts];
+			out[i] = condition == NA_LOGICAL ? NA_REAL : (condition ? y[i * ys] : n[i * ns]);
+		}
+		return;
+	}
+	case CPLXSXP: {
+		const Rcomplex *y = (const Rcomplex *) yes.data, *n = (const Rcomplex *) no.data;
+		Rcomplex *out = (Rcomplex *) target;
+		for (R_xlen_t i = 0; i < length; i++) {
+			int condition = t[i * ts];
+			if (condition == NA_LOGICAL) {
+				out[i].r = NA_REAL;
+				out[i].i = NA_REAL;
+			} else {
+				out[i] = condition ? y[i * ys] : n[i * ns];
+			}
+		}
+		return;
+	}
+	default:
+		Rf_error("No ifelse kernel for working type %s", type2char(working_type));
+	}
+}
+
+// Mirrors do_pmin: without na.rm a missing element wins, with na.rm the other
+// one does.
+#define __PMINMAX_LOOP(type, is_missing, better)                                                  \
+	do {                                                                                          \
+		const type *a = (const type *) x.data, *b = (const type *) y.data;                        \
+		type *out = (type *) target;                                                              \
+		for (R_xlen_t i = 0; i < length; i++) {                                                   \
+			type u = a[i * xs], v = b[i * ys];                                                    \
+			if (is_missing(u))      out[i] = na_rm ? v : u;                                       \
+			else if (is_missing(v)) out[i] = na_rm ? u : v;                                       \
+			else                    out[i] = better(u, v) ? u : v;                                \
+		}                                                                                         \
+	} while (0)
+
+#define __IS_NA_INTEGER(value)  ((value) == NA_INTEGER)
+#define __IS_GREATER(u, v)      ((u) > (v))
+#define __IS_LESS(u, v)         ((u) < (v))
+
+static void __pminmax_kernel(SEXPTYPE working_type, bool maximum, bool na_rm,
+                             ufo_region_t x, ufo_region_t y, void *target, R_xlen_t length) {
+	R_xlen_t xs = __STRIDE(x), ys = __STRIDE(y);
+
+	switch (working_type) {
+	case INTSXP:
+		if (maximum) __PMINMAX_LOOP(int, __IS_NA_INTEGER, __IS_GREATER);
+		else         __PMINMAX_LOOP(int, __IS_NA_INTEGER, __IS_LESS);
+		return;
+	case REALSXP:
+		if (maximum) __PMINMAX_LOOP(double, ISNAN, __IS_GREATER);
+		else         __PMINMAX_LOOP(double, ISNAN, __IS_LESS);
+		return;
+	default:
+		Rf_error("No pmin/pmax kernel for working type %s", type2char(working_type));
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Chunked selection
+//-----------------------------------------------------------------------------
+
+#define SELECT_MAX_OPERANDS 3
+
+typedef struct {
+	bool             ifelse;           // otherwise pmin or pmax
+	bool             maximum;
+	bool             na_rm;
+	SEXPTYPE         working_type;
+	int              number_of_operands;
+	ufo_operand_t    operands[SELECT_MAX_OPERANDS];
+	SEXPTYPE         operand_types[SELECT_MAX_OPERANDS];   // what the operands are read as
+	unsigned char   *result_data;
+	size_t           result_element_size;
+	unsigned char   *scratch;          // per worker, room for a chunk of every operand
+	size_t           scratch_size;     // bytes of scratch per operand per worker
+} select_job_t;
+
+static void __select_chunk(void *context, int worker, R_xlen_t start, R_xlen_t length) {
+	select_job_t *job = (select_job_t *) context;
+	unsigned char *scratch = job->scratch + worker * job->number_of_operands * job->scratch_size;
+
+	ufo_region_t regions[SELECT_MAX_OPERANDS];
+	for (int i = 0; i < job->number_of_operands; i++) {
+		regions[i] = ufo_operand_region(&job->operands[i], job->operand_types[i], start, length,
+		                                scratch + i * job->scratch_size);
+	}
+
+	void *target = job->result_data + start * job->result_element_size;
+	if (job->ifelse) {
+		__ifelse_kernel(job->working_type, regions[0], regions[1], regions[2], target, length);
+	} else {
+		__pminmax_kernel(job->working_type, job->maximum, job->na_rm, regions[0], regions[1], target, length);
+	}
+}
+
+static SEXP __run_select_job(select_job_t *job, R_xlen_t result_length,
+                             int32_t min_load_count, SEXP/*REALSXP*/ chunk_size_sexp) {
+	R_xlen_t chunk_size = chunk_size_sexp == R_NilValue ? 0 : __extract_R_xlen_t_or_die(chunk_size_sexp);
+	make_sure(chunk_size_sexp == R_NilValue || chunk_size > 0, "Chunk size must be positive, but is %li", chunk_size);
+
+	job->result_element_size = __get_element_size(job->working_type);
+	if (result_length == 0) {
+		return allocVector(job->working_type, 0);
+	}
+
+	if (chunk_size_sexp == R_NilValue) {
+		SEXP inputs[SELECT_MAX_OPERANDS];
+		for (int i = 0; i < job->number_of_operands; i++) {
+			inputs[i] = job->operands[i].sexp;
+		}
+		chunk_size = ufo_plan_chunk_size(inputs, job->number_of_operands, job->result_element_size,
+		                                 min_load_count, result_length);
+	}
+	R_xlen_t chunk_length = MIN(chunk_size, result_length);
+
+	int threads = ufo_threads_from_option();
+	size_t largest_element_size = 0;
+	for (int i = 0; i < job->number_of_operands; i++) {
+		ufo_operand_prepare(&job->operands[i], job->operand_types[i], result_length, chunk_length, false);
+		if (ufo_operand_needs_r(&job->operands[i])) {
+			threads = 1;
+		}
+		size_t element_size = ufo_working_type_element_size(job->operand_types[i]);
+		if (element_size > largest_element_size) {
+			largest_element_size = element_size;
+		}
+	}
+
+	job->scratch_size = chunk_length * largest_element_size;
+	job->scratch = (unsigned char *) R_alloc(threads * job->number_of_operands, job->scratch_size);
+
+	SEXP result = PROTECT(ufo_empty(job->working_type, result_length, false, min_load_count));
+	job->result_data = (unsigned char *) DATAPTR(result);
+
+	ufo_parallel_for(result_length, chunk_size, threads, &__select_chunk, job);
+
+	UNPROTECT(1);
+	return result;
+}
+
+static inline int __numeric_rank(SEXPTYPE type) {
+	switch (type) {
+	case LGLSXP:  return 0;
+	case INTSXP:  return 1;
+	case REALSXP: return 2;
+	case CPLXSXP: return 3;
+	default:      return -1;
+	}
+}
+
+SEXP ufo_ifelse(SEXP test, SEXP yes, SEXP no, SEXP/*INTSXP*/ min_load_count, SEXP/*REALSXP*/ chunk_size) {
+	if (__numeric_rank(TYPEOF(test)) < 0 || __numeric_rank(TYPEOF(yes)) < 0 || __numeric_rank(TYPEOF(no)) < 0) {
+		return R_NilValue;
+	}
+
+	// Empty yes or no are fine as long as they are not used, which base R
+	// finds out element by element.
+	R_xlen_t result_length = XLENGTH(test);
+	if (result_length > 0 && (XLENGTH(yes) == 0 || XLENGTH(no) == 0)) {
+		return R_NilValue;
+	}
+
+	select_job_t job;
+	job.ifelse = true;
+	job.working_type = __numeric_rank(TYPEOF(yes)) >= __numeric_rank(TYPEOF(no)) ? TYPEOF(yes) : TYPEOF(no);
+	job.number_of_operands = 3;
+	job.operands[0] = ufo_operand_from(test);
+	job.operands[1] = ufo_operand_from(yes);
+	job.operands[2] = ufo_operand_from(no);
+	job.operand_types[0] = LGLSXP;
+	job.operand_types[1] = job.working_type;
+	job.operand_types[2] = job.working_type;
+
+	return __run_select_job(&job, result_length, __extract_int_or_die(min_load_count), chunk_size);
+}
+
+SEXP ufo_pminmax(SEXP/*LGLSXP*/ maximum, SEXP x, SEXP y, SEXP/*LGLSXP*/ na_rm,
+                 SEXP/*INTSXP*/ min_load_count, SEXP/*REALSXP*/ chunk_size) {
+	int x_rank = __numeric_rank(TYPEOF(x));
+	int y_rank = __numeric_rank(TYPEOF(y));
+	if (x_rank < 0 || x_rank > 2 || y_rank < 0 || y_rank > 2) {
+		return R_NilValue;
+	}
+
+	select_job_t job;
+	job.ifelse = false;
+	job.maximum = __extract_boolean_or_die(maximum);
+	job.na_rm = __extract_boolean_or_die(na_rm);
+	job.working_type = x_rank == 2 || y_rank == 2 ? REALSXP : INTSXP;
+	job.number_of_operands = 2;
+	job.operands[0] = ufo_operand_from(x);
+	job.operands[1] = ufo_operand_from(y);
+	job.operand_types[0] = job.working_type;
+	job.operand_types[1] = job.working_type;
+
+	R_xlen_t result_length = ufo_vector_size_to_fit_both(TYPEOF(x), TYPEOF(y), XLENGTH(x), XLENGTH(y));
+	if (result_length > 0 && (result_length % XLENGTH(x) != 0 || result_length % XLENGTH(y) != 0)) {
+		Rf_warning("an argument will be fractionally recycled");
+	}
+
+	return __run_select_job(&job, result_length, __extract_int_or_die(min_load_count), chunk_size);
+}
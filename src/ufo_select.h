@@ -0,0 +1,21 @@
+#pragma once
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+// Elementwise selection between operands, computed in a single chunked pass
+// into a new UFO. Operands are recycled the same way as for operators. If
+// `chunk_size` is NULL, it is planned from the operands (see
+// ufo_plan_chunk_size). Both return NULL for operands that are not logical,
+// integer, double (or complex, for ifelse), which the caller should hand over
+// to base R.
+
+// ifelse(test, yes, no): as long as `test`, NA where `test` is NA. Unlike base
+// R, the type of the result is that of `yes` and `no` combined (but at least
+// logical), whether or not the elements of both are used.
+SEXP ufo_ifelse(SEXP test, SEXP yes, SEXP no, SEXP/*INTSXP*/ min_load_count, SEXP/*REALSXP*/ chunk_size);
+
+// pmin(x, y) or pmax(x, y) if `maximum` is set.
+SEXP ufo_pminmax(SEXP/*LGLSXP*/ maximum, SEXP x, SEXP y, SEXP/*LGLSXP*/ na_rm,
+                 SEXP/*INTSXP*/ min_load_count, SEXP/*REALSXP*/ chunk_size);
@@ -0,0 +1,244 @@
+#include "ufo_shift.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+#include "safety_first.h"
+#include "helpers.h"
+#include "ufo_empty.h"
+#include "ufo_kernels.h"
+#include "ufo_chunks.h"
+#include "ufo_threads.h"
+
+#define MIN(x, y) (x >= y ? y : x)
+#define MAX(x, y) (x >= y ? x : y)
+
+static R_xlen_t __extract_chunk_size_or_die(SEXP/*REALSXP*/ chunk_size_sexp) {
+	R_xlen_t chunk_size = chunk_size_sexp == R_NilValue ? 0 : __extract_R_xlen_t_or_die(chunk_size_sexp);
+	make_sure(chunk_size_sexp == R_NilValue || chunk_size > 0, "Chunk size must be positive, but is %li", chunk_size);
+	return chunk_size;
+}
+
+//-----------------------------------------------------------------------------
+// ufo_diff
+//-----------------------------------------------------------------------------
+
+typedef struct {
+	SEXPTYPE              working_type;
+	size_t                element_size;
+	ufo_operand_t         x;
+	R_xlen_t              lag;
+	R_xlen_t              differences;
+	unsigned char        *result_data;
+	unsigned char        *scratch;        // two buffers per worker
+	size_t                scratch_size;   // bytes of one buffer
+	ufo_kernel_status_t  *statuses;       // per worker
+} diff_job_t;
+
+// The chunk's region runs lag * differences elements past its end. Every pass
+// takes the differences of the previous one, which is lag elements shorter,
+// alternating between the two buffers, so that the last pass lands in the
+// result.
+static void __diff_chunk(void *context, int worker, R_xlen_t start, R_xlen_t length) {
+	diff_job_t *job = (diff_job_t *) context;
+	unsigned char *buffers[2] = {
+		job->scratch + (2 * worker) * job->scratch_size,
+		job->scratch + (2 * worker + 1) * job->scratch_size,
+	};
+
+	R_xlen_t region_length = length + job->lag * job->differences;
+	const unsigned char *source = (const unsigned char *) ufo_operand_region(&job->x, job->working_type,
+	                                                                         start, region_length,
+	                                                                         buffers[0]).data;
+
+	for (R_xlen_t pass = 1; pass <= job->differences; pass++) {
+		unsigned char *target = pass == job->differences ? job->result_data + start * job->element_size
+		                      : source == buffers[1]     ? buffers[0]
+		                      :                            buffers[1];
+
+		ufo_region_t later   = { .data = source + job->lag * job->element_size, .broadcast = false };
+		ufo_region_t earlier = { .data = source,                                .broadcast = false };
+		region_length -= job->lag;
+		ufo_binary_kernel(UFO_OP_SUBTRACT, job->working_type, later, earlier, target, region_length,
+		                  &job->statuses[worker]);
+		source = target;
+	}
+}
+
+SEXP ufo_diff(SEXP x, SEXP/*REALSXP*/ lag_sexp, SEXP/*REALSXP*/ differences_sexp,
+              SEXP/*INTSXP*/ min_load_count_sexp, SEXP/*REALSXP*/ chunk_size_sexp) {
+	diff_job_t job;
+	job.lag = __extract_R_xlen_t_or_die(lag_sexp);
+	job.differences = __extract_R_xlen_t_or_die(differences_sexp);
+	make_sure(job.lag > 0 && job.differences > 0,
+	          "Lag and differences must be positive, but are %li and %li", job.lag, job.differences);
+	int32_t min_load_count = __extract_int_or_die(min_load_count_sexp);
+	R_xlen_t chunk_size = __extract_chunk_size_or_die(chunk_size_sexp);
+
+	switch (TYPEOF(x)) {
+	case LGLSXP:
+	case INTSXP:  job.working_type = INTSXP;  break;
+	case REALSXP: job.working_type = REALSXP; break;
+	default:      return R_NilValue;
+	}
+	job.element_size = ufo_working_type_element_size(job.working_type);
+
+	// Like base R, vectors no longer than lag * differences have empty
+	// differences of their own type.
+	job.x = ufo_operand_from(x);
+	R_xlen_t length = job.x.length;
+	if (length == 0 || job.differences > (length - 1) / job.lag) {
+		return allocVector(TYPEOF(x), 0);
+	}
+	R_xlen_t halo_length = job.lag * job.differences;
+	R_xlen_t result_length = length - halo_length;
+
+	if (chunk_size_sexp == R_NilValue) {
+		chunk_size = ufo_plan_chunk_size(&x, 1, job.element_size, min_load_count, result_length);
+	}
+	R_xlen_t region_length = MIN(chunk_size, result_length) + halo_length;
+
+	int threads = ufo_threads_from_option();
+	ufo_operand_prepare(&job.x, job.working_type, length, region_length, false);
+	if (ufo_operand_needs_r(&job.x)) {
+		threads = 1;
+	}
+
+	job.scratch_size = region_length * job.element_size;
+	job.scratch = (unsigned char *) R_alloc(2 * threads, job.scratch_size);
+	job.statuses = (ufo_kernel_status_t *) R_alloc(threads, sizeof(ufo_kernel_status_t));
+	for (int worker = 0; worker < threads; worker++) {
+		job.statuses[worker].integer_overflow = false;
+		job.statuses[worker].lost_accuracy = false;
+		job.statuses[worker].nan_produced = false;
+	}
+
+	SEXP result = PROTECT(ufo_empty(job.working_type, result_length, false, min_load_count));
+	job.result_data = (unsigned char *) DATAPTR(result);
+
+	ufo_parallel_for(result_length, chunk_size, threads, &__diff_chunk, &job);
+
+	ufo_kernel_status_t status = { .integer_overflow = false, .lost_accuracy = false, .nan_produced = false };
+	for (int worker = 0; worker < threads; worker++) {
+		status.integer_overflow |= job.statuses[worker].integer_overflow;
+		status.lost_accuracy    |= job.statuses[worker].lost_accuracy;
+		status.nan_produced     |= job.statuses[worker].nan_produced;
+	}
+	ufo_kernel_status_report(status);
+
+	UNPROTECT(1);
+	return result;
+}
+
+//-----------------------------------------------------------------------------
+// ufo_shift
+//-----------------------------------------------------------------------------
+
+typedef struct {
+	SEXPTYPE         working_type;
+	size_t           element_size;
+	ufo_operand_t    x;
+	R_xlen_t         shift;
+	union {
+		int          integer;   // and logicals
+		double       real;
+	}                default_value;
+	unsigned char   *result_data;
+} shift_job_t;
+
+static void __fill_default(shift_job_t *job, unsigned char *target, R_xlen_t length) {
+	if (job->working_type == REALSXP) {
+		for (R_xlen_t i = 0; i < length; i++) {
+			((double *) target)[i] = job->default_value.real;
+		}
+	} else {
+		for (R_xlen_t i = 0; i < length; i++) {
+			((int *) target)[i] = job->default_value.integer;
+		}
+	}
+}
+
+// Element i of the chunk comes from element start + i - shift of x. Those of
+// them that are in x are a single region, which is read straight into the
+// result, and the rest are the default.
+static void __shift_chunk(void *context, int worker, R_xlen_t start, R_xlen_t length) {
+	shift_job_t *job = (shift_job_t *) context;
+	unsigned char *target = job->result_data + start * job->element_size;
+
+	R_xlen_t source_start = start - job->shift;
+	R_xlen_t first = MAX(source_start, 0);
+	R_xlen_t end = MIN(source_start + length, job->x.length);
+	if (end <= first) {
+		__fill_default(job, target, length);
+		return;
+	}
+
+	R_xlen_t before = first - source_start;
+	R_xlen_t count = end - first;
+	__fill_default(job, target, before);
+
+	unsigned char *copy_target = target + before * job->element_size;
+	const void *source = ufo_operand_region(&job->x, job->working_type, first, count, copy_target).data;
+	if (source != copy_target) {
+		memcpy(copy_target, source, count * job->element_size);
+	}
+
+	__fill_default(job, copy_target + count * job->element_size, length - before - count);
+}
+
+static inline int __numeric_rank(SEXPTYPE type) {
+	switch (type) {
+	case LGLSXP:  return 0;
+	case INTSXP:  return 1;
+	case REALSXP: return 2;
+	default:      return -1;
+	}
+}
+
+SEXP ufo_shift(SEXP x, SEXP/*REALSXP*/ shift_sexp, SEXP default_sexp,
+               SEXP/*INTSXP*/ min_load_count_sexp, SEXP/*REALSXP*/ chunk_size_sexp) {
+	shift_job_t job;
+	job.shift = __extract_R_xlen_t_or_die(shift_sexp);
+	int32_t min_load_count = __extract_int_or_die(min_load_count_sexp);
+	R_xlen_t chunk_size = __extract_chunk_size_or_die(chunk_size_sexp);
+
+	int x_rank = __numeric_rank(TYPEOF(x));
+	int default_rank = __numeric_rank(TYPEOF(default_sexp));
+	if (x_rank < 0 || default_rank < 0 || XLENGTH(default_sexp) != 1) {
+		return R_NilValue;
+	}
+	job.working_type = x_rank >= default_rank ? TYPEOF(x) : TYPEOF(default_sexp);
+	job.element_size = ufo_working_type_element_size(job.working_type);
+	ufo_convert_elements(TYPEOF(default_sexp), DATAPTR(default_sexp), job.working_type, &job.default_value, 1);
+
+	job.x = ufo_operand_from(x);
+	R_xlen_t length = job.x.length;
+	if (length == 0) {
+		return allocVector(job.working_type, 0);
+	}
+	// Shifting by more than the length leaves only the default.
+	if (job.shift > length)  job.shift = length;
+	if (job.shift < -length) job.shift = -length;
+
+	if (chunk_size_sexp == R_NilValue) {
+		chunk_size = ufo_plan_chunk_size(&x, 1, job.element_size, min_load_count, length);
+	}
+
+	int threads = ufo_threads_from_option();
+	ufo_operand_prepare(&job.x, job.working_type, length, MIN(chunk_size, length), false);
+	if (ufo_operand_needs_r(&job.x)) {
+		threads = 1;
+	}
+
+	SEXP result = PROTECT(ufo_empty(job.working_type, length, false, min_load_count));
+	job.result_data = (unsigned char *) DATAPTR(result);
+
+	ufo_parallel_for(length, chunk_size, threads, &__shift_chunk, &job);
+
+	UNPROTECT(1);
+	return result;
+}
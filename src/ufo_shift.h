@@ -0,0 +1,32 @@
+#pragma once
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+// Computes diff(x, lag, differences) of a logical, integer or double vector
+// into a new UFO, like base R's diff, without subsetting x into shifted
+// copies. Every chunk of the result is read together with the lag *
+// differences elements after it, and the differences are taken pass by pass
+// within the chunk, so the chunks are independent and are computed on
+// `ufooperators.threads` threads. Integers (and logicals) overflow to NA with
+// a warning, the same as `-`. If `chunk_size` is NULL, it is planned from the
+// vector (see ufo_plan_chunk_size).
+//
+// Returns NULL for vectors of other types, which the caller should hand over
+// to base R.
+SEXP ufo_diff(SEXP x, SEXP/*REALSXP*/ lag, SEXP/*REALSXP*/ differences,
+              SEXP/*INTSXP*/ min_load_count, SEXP/*REALSXP*/ chunk_size);
+
+// Shifts a logical, integer or double vector by `n` elements into a new UFO
+// of the same length: element i of the result is element i - n of x, or
+// `default` where there is no such element. A positive `n` lags x and a
+// negative one leads it (like dplyr's lag and lead). The result has the type
+// of x and `default` combined. Every chunk of the result is read from a
+// single shifted region of x, so there are no index vectors. If `chunk_size`
+// is NULL, it is planned from the vector (see ufo_plan_chunk_size).
+//
+// Returns NULL for vectors (or defaults) of other types, which the caller
+// should hand over to base R.
+SEXP ufo_shift(SEXP x, SEXP/*REALSXP*/ n, SEXP default_value,
+               SEXP/*INTSXP*/ min_load_count, SEXP/*REALSXP*/ chunk_size);
@@ -0,0 +1,445 @@
+#include "ufo_simd.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define UFO_SIMD_X86
+#include <immintrin.h>
+#endif
+
+// The kernels below produce exactly what the scalar kernels in ufo_kernels.c
+// produce, which in turn mirror arithmetic.c and relop.c:
+//
+//  - integer arithmetic yields NA_INTEGER if either operand is NA, and also
+//    if the result does not fit in (-INT_MAX, INT_MAX), in which case the
+//    overflow is reported through the status;
+//  - double arithmetic is plain IEEE arithmetic, the same as R does, so NA
+//    and NaN propagate the way they do in R (which of the two comes out of
+//    NA + NaN is unspecified in R as well);
+//  - comparisons yield NA_LOGICAL if either operand is NA (or NaN).
+
+typedef enum {
+	UFO_SIMD_NONE,
+	UFO_SIMD_SSE42,
+	UFO_SIMD_AVX2,
+} ufo_simd_level_t;
+
+static ufo_simd_level_t __simd_level = UFO_SIMD_NONE;
+
+static const char *__simd_level_names[] = {
+	[UFO_SIMD_NONE]  = "none",
+	[UFO_SIMD_SSE42] = "sse4.2",
+	[UFO_SIMD_AVX2]  = "avx2",
+};
+
+void ufo_simd_initialize(void) {
+	ufo_simd_level_t level = UFO_SIMD_NONE;
+
+#ifdef UFO_SIMD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		level = UFO_SIMD_AVX2;
+	} else if (__builtin_cpu_supports("sse4.2")) {
+		level = UFO_SIMD_SSE42;
+	}
+#endif
+
+	const char *cap = getenv("UFO_SIMD");
+	if (cap != NULL) {
+		for (ufo_simd_level_t candidate = UFO_SIMD_NONE; candidate < level; candidate++) {
+			if (strcmp(cap, __simd_level_names[candidate]) == 0) {
+				level = candidate;
+				break;
+			}
+		}
+	}
+
+	__simd_level = level;
+}
+
+const char *ufo_simd_instruction_set(void) {
+	return __simd_level_names[__simd_level];
+}
+
+SEXP ufo_simd_instruction_set_sexp(void) {
+	return mkString(ufo_simd_instruction_set());
+}
+
+#ifdef UFO_SIMD_X86
+
+//-----------------------------------------------------------------------------
+// AVX2: 8 integers or 4 doubles at a time
+//-----------------------------------------------------------------------------
+
+#define AVX2 __attribute__((target("avx2")))
+
+// Narrows a mask of 4 doubles to a mask of 4 integers.
+AVX2 static inline __m128i __avx2_narrow_mask(__m256d mask) {
+	const __m256i even = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+	return _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(_mm256_castpd_si256(mask), even));
+}
+
+// Lanes whose exact product does not fit into an integer. Products of two
+// integers are exact in doubles as long as they fit into an integer, and
+// rounding never brings a larger product back under INT_MAX.
+AVX2 static inline __m256i __avx2_times_overflows(__m256i a, __m256i b) {
+	const __m256d limit = _mm256_set1_pd((double) INT_MAX);
+	const __m256d sign  = _mm256_set1_pd(-0.0);
+
+	__m256d low  = _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(a)),
+	                             _mm256_cvtepi32_pd(_mm256_castsi256_si128(b)));
+	__m256d high = _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(a, 1)),
+	                             _mm256_cvtepi32_pd(_mm256_extracti128_si256(b, 1)));
+
+	__m128i low_mask  = __avx2_narrow_mask(_mm256_cmp_pd(_mm256_andnot_pd(sign, low),  limit, _CMP_GT_OQ));
+	__m128i high_mask = __avx2_narrow_mask(_mm256_cmp_pd(_mm256_andnot_pd(sign, high), limit, _CMP_GT_OQ));
+	return _mm256_inserti128_si256(_mm256_castsi128_si256(low_mask), high_mask, 1);
+}
+
+#define __AVX2_INTEGER_ARITHMETIC(name, compute_value, compute_overflow)                    \
+AVX2 static R_xlen_t name(const int *x, R_xlen_t xs, const int *y, R_xlen_t ys,              \
+                          int *out, R_xlen_t length, bool *overflow) {                       \
+	const __m256i x_all = _mm256_set1_epi32(x[0]);                                           \
+	const __m256i y_all = _mm256_set1_epi32(y[0]);                                           \
+	const __m256i na = _mm256_set1_epi32(NA_INTEGER);                                        \
+	__m256i overflowed = _mm256_setzero_si256();                                             \
+	R_xlen_t i = 0;                                                                          \
+	for (; i + 8 <= length; i += 8) {                                                        \
+		__m256i a = xs ? _mm256_loadu_si256((const __m256i *) (x + i)) : x_all;              \
+		__m256i b = ys ? _mm256_loadu_si256((const __m256i *) (y + i)) : y_all;              \
+		__m256i missing = _mm256_or_si256(_mm256_cmpeq_epi32(a, na), _mm256_cmpeq_epi32(b, na)); \
+		__m256i value = compute_value;                                                       \
+		__m256i invalid = _mm256_or_si256(compute_overflow, _mm256_cmpeq_epi32(value, na));  \
+		invalid = _mm256_andnot_si256(missing, invalid);                                     \
+		overflowed = _mm256_or_si256(overflowed, invalid);                                   \
+		value = _mm256_blendv_epi8(value, na, _mm256_or_si256(missing, invalid));            \
+		_mm256_storeu_si256((__m256i *) (out + i), value);                                   \
+	}                                                                                        \
+	*overflow |= !_mm256_testz_si256(overflowed, overflowed);                                \
+	return i;                                                                                \
+}
+
+// Signed overflow happened if the operands' signs allow it and the result's
+// sign differs from what it should be (Hacker's Delight 2-13).
+__AVX2_INTEGER_ARITHMETIC(__avx2_integer_plus,
+	_mm256_add_epi32(a, b),
+	_mm256_srai_epi32(_mm256_and_si256(_mm256_xor_si256(a, value), _mm256_xor_si256(b, value)), 31))
+__AVX2_INTEGER_ARITHMETIC(__avx2_integer_minus,
+	_mm256_sub_epi32(a, b),
+	_mm256_srai_epi32(_mm256_and_si256(_mm256_xor_si256(a, b), _mm256_xor_si256(a, value)), 31))
+__AVX2_INTEGER_ARITHMETIC(__avx2_integer_times,
+	_mm256_mullo_epi32(a, b),
+	__avx2_times_overflows(a, b))
+
+// Comparisons are computed as a mask which is either used as is or inverted
+// (eg. a <= b is !(a > b)).
+#define __AVX2_INTEGER_COMPARISON(name, compute_mask, inverted)                             \
+AVX2 static R_xlen_t name(const int *x, R_xlen_t xs, const int *y, R_xlen_t ys,              \
+                          int *out, R_xlen_t length) {                                       \
+	const __m256i x_all = _mm256_set1_epi32(x[0]);                                           \
+	const __m256i y_all = _mm256_set1_epi32(y[0]);                                           \
+	const __m256i na  = _mm256_set1_epi32(NA_INTEGER);                                       \
+	const __m256i one = _mm256_set1_epi32(1);                                                \
+	R_xlen_t i = 0;                                                                          \
+	for (; i + 8 <= length; i += 8) {                                                        \
+		__m256i a = xs ? _mm256_loadu_si256((const __m256i *) (x + i)) : x_all;              \
+		__m256i b = ys ? _mm256_loadu_si256((const __m256i *) (y + i)) : y_all;              \
+		__m256i missing = _mm256_or_si256(_mm256_cmpeq_epi32(a, na), _mm256_cmpeq_epi32(b, na)); \
+		__m256i mask = compute_mask;                                                         \
+		__m256i value = inverted ? _mm256_andnot_si256(mask, one) : _mm256_and_si256(mask, one); \
+		value = _mm256_blendv_epi8(value, na, missing);                                      \
+		_mm256_storeu_si256((__m256i *) (out + i), value);                                   \
+	}                                                                                        \
+	return i;                                                                                \
+}
+
+__AVX2_INTEGER_COMPARISON(__avx2_integer_less,          _mm256_cmpgt_epi32(b, a), false)
+__AVX2_INTEGER_COMPARISON(__avx2_integer_less_equal,    _mm256_cmpgt_epi32(a, b), true)
+__AVX2_INTEGER_COMPARISON(__avx2_integer_greater,       _mm256_cmpgt_epi32(a, b), false)
+__AVX2_INTEGER_COMPARISON(__avx2_integer_greater_equal, _mm256_cmpgt_epi32(b, a), true)
+__AVX2_INTEGER_COMPARISON(__avx2_integer_equal,         _mm256_cmpeq_epi32(a, b), false)
+__AVX2_INTEGER_COMPARISON(__avx2_integer_unequal,       _mm256_cmpeq_epi32(a, b), true)
+
+#define __AVX2_REAL_ARITHMETIC(name, operation)                                             \
+AVX2 static R_xlen_t name(const double *x, R_xlen_t xs, const double *y, R_xlen_t ys,        \
+                          double *out, R_xlen_t length) {                                    \
+	const __m256d x_all = _mm256_set1_pd(x[0]);                                              \
+	const __m256d y_all = _mm256_set1_pd(y[0]);                                              \
+	R_xlen_t i = 0;                                                                          \
+	for (; i + 4 <= length; i += 4) {                                                        \
+		__m256d a = xs ? _mm256_loadu_pd(x + i) : x_all;                                     \
+		__m256d b = ys ? _mm256_loadu_pd(y + i) : y_all;                                     \
+		_mm256_storeu_pd(out + i, operation(a, b));                                          \
+	}                                                                                        \
+	return i;                                                                                \
+}
+
+__AVX2_REAL_ARITHMETIC(__avx2_real_plus,   _mm256_add_pd)
+__AVX2_REAL_ARITHMETIC(__avx2_real_minus,  _mm256_sub_pd)
+__AVX2_REAL_ARITHMETIC(__avx2_real_times,  _mm256_mul_pd)
+__AVX2_REAL_ARITHMETIC(__avx2_real_divide, _mm256_div_pd)
+
+#define __AVX2_REAL_COMPARISON(name, predicate)                                             \
+AVX2 static R_xlen_t name(const double *x, R_xlen_t xs, const double *y, R_xlen_t ys,        \
+                          int *out, R_xlen_t length) {                                       \
+	const __m256d x_all = _mm256_set1_pd(x[0]);                                              \
+	const __m256d y_all = _mm256_set1_pd(y[0]);                                              \
+	const __m128i na  = _mm_set1_epi32(NA_LOGICAL);                                          \
+	const __m128i one = _mm_set1_epi32(1);                                                   \
+	R_xlen_t i = 0;                                                                          \
+	for (; i + 4 <= length; i += 4) {                                                        \
+		__m256d a = xs ? _mm256_loadu_pd(x + i) : x_all;                                     \
+		__m256d b = ys ? _mm256_loadu_pd(y + i) : y_all;                                     \
+		__m128i missing = __avx2_narrow_mask(_mm256_cmp_pd(a, b, _CMP_UNORD_Q));             \
+		__m128i mask    = __avx2_narrow_mask(_mm256_cmp_pd(a, b, predicate));                \
+		__m128i value   = _mm_blendv_epi8(_mm_and_si128(mask, one), na, missing);            \
+		_mm_storeu_si128((__m128i *) (out + i), value);                                      \
+	}                                                                                        \
+	return i;                                                                                \
+}
+
+__AVX2_REAL_COMPARISON(__avx2_real_less,          _CMP_LT_OQ)
+__AVX2_REAL_COMPARISON(__avx2_real_less_equal,    _CMP_LE_OQ)
+__AVX2_REAL_COMPARISON(__avx2_real_greater,       _CMP_GT_OQ)
+__AVX2_REAL_COMPARISON(__avx2_real_greater_equal, _CMP_GE_OQ)
+__AVX2_REAL_COMPARISON(__avx2_real_equal,         _CMP_EQ_OQ)
+__AVX2_REAL_COMPARISON(__avx2_real_unequal,       _CMP_NEQ_UQ)
+
+//-----------------------------------------------------------------------------
+// SSE4.2: 4 integers or 2 doubles at a time
+//-----------------------------------------------------------------------------
+
+#define SSE42 __attribute__((target("sse4.2")))
+
+// Narrows a mask of 2 doubles to a mask of 2 integers (in the lower half).
+SSE42 static inline __m128i __sse42_narrow_mask(__m128d mask) {
+	return _mm_shuffle_epi32(_mm_castpd_si128(mask), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+// See __avx2_times_overflows.
+SSE42 static inline __m128i __sse42_times_overflows(__m128i a, __m128i b) {
+	const __m128d limit = _mm_set1_pd((double) INT_MAX);
+	const __m128d sign  = _mm_set1_pd(-0.0);
+
+	__m128i a_high = _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 2, 3, 2));
+	__m128i b_high = _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 2, 3, 2));
+	__m128d low  = _mm_mul_pd(_mm_cvtepi32_pd(a),      _mm_cvtepi32_pd(b));
+	__m128d high = _mm_mul_pd(_mm_cvtepi32_pd(a_high), _mm_cvtepi32_pd(b_high));
+
+	__m128i low_mask  = __sse42_narrow_mask(_mm_cmpgt_pd(_mm_andnot_pd(sign, low),  limit));
+	__m128i high_mask = __sse42_narrow_mask(_mm_cmpgt_pd(_mm_andnot_pd(sign, high), limit));
+	return _mm_unpacklo_epi64(low_mask, high_mask);
+}
+
+#define __SSE42_INTEGER_ARITHMETIC(name, compute_value, compute_overflow)                   \
+SSE42 static R_xlen_t name(const int *x, R_xlen_t xs, const int *y, R_xlen_t ys,             \
+                           int *out, R_xlen_t length, bool *overflow) {                      \
+	const __m128i x_all = _mm_set1_epi32(x[0]);                                              \
+	const __m128i y_all = _mm_set1_epi32(y[0]);                                              \
+	const __m128i na = _mm_set1_epi32(NA_INTEGER);                                           \
+	__m128i overflowed = _mm_setzero_si128();                                                \
+	R_xlen_t i = 0;                                                                          \
+	for (; i + 4 <= length; i += 4) {                                                        \
+		__m128i a = xs ? _mm_loadu_si128((const __m128i *) (x + i)) : x_all;                 \
+		__m128i b = ys ? _mm_loadu_si128((const __m128i *) (y + i)) : y_all;                 \
+		__m128i missing = _mm_or_si128(_mm_cmpeq_epi32(a, na), _mm_cmpeq_epi32(b, na));      \
+		__m128i value = compute_value;                                                       \
+		__m128i invalid = _mm_or_si128(compute_overflow, _mm_cmpeq_epi32(value, na));        \
+		invalid = _mm_andnot_si128(missing, invalid);                                        \
+		overflowed = _mm_or_si128(overflowed, invalid);                                      \
+		value = _mm_blendv_epi8(value, na, _mm_or_si128(missing, invalid));                  \
+		_mm_storeu_si128((__m128i *) (out + i), value);                                      \
+	}                                                                                        \
+	*overflow |= !_mm_testz_si128(overflowed, overflowed);                                   \
+	return i;                                                                                \
+}
+
+__SSE42_INTEGER_ARITHMETIC(__sse42_integer_plus,
+	_mm_add_epi32(a, b),
+	_mm_srai_epi32(_mm_and_si128(_mm_xor_si128(a, value), _mm_xor_si128(b, value)), 31))
+__SSE42_INTEGER_ARITHMETIC(__sse42_integer_minus,
+	_mm_sub_epi32(a, b),
+	_mm_srai_epi32(_mm_and_si128(_mm_xor_si128(a, b), _mm_xor_si128(a, value)), 31))
+__SSE42_INTEGER_ARITHMETIC(__sse42_integer_times,
+	_mm_mullo_epi32(a, b),
+	__sse42_times_overflows(a, b))
+
+#define __SSE42_INTEGER_COMPARISON(name, compute_mask, inverted)                            \
+SSE42 static R_xlen_t name(const int *x, R_xlen_t xs, const int *y, R_xlen_t ys,             \
+                           int *out, R_xlen_t length) {                                      \
+	const __m128i x_all = _mm_set1_epi32(x[0]);                                              \
+	const __m128i y_all = _mm_set1_epi32(y[0]);                                              \
+	const __m128i na  = _mm_set1_epi32(NA_INTEGER);                                          \
+	const __m128i one = _mm_set1_epi32(1);                                                   \
+	R_xlen_t i = 0;                                                                          \
+	for (; i + 4 <= length; i += 4) {                                                        \
+		__m128i a = xs ? _mm_loadu_si128((const __m128i *) (x + i)) : x_all;                 \
+		__m128i b = ys ? _mm_loadu_si128((const __m128i *) (y + i)) : y_all;                 \
+		__m128i missing = _mm_or_si128(_mm_cmpeq_epi32(a, na), _mm_cmpeq_epi32(b, na));      \
+		__m128i mask = compute_mask;                                                         \
+		__m128i value = inverted ? _mm_andnot_si128(mask, one) : _mm_and_si128(mask, one);   \
+		value = _mm_blendv_epi8(value, na, missing);                                         \
+		_mm_storeu_si128((__m128i *) (out + i), value);                                      \
+	}                                                                                        \
+	return i;                                                                                \
+}
+
+__SSE42_INTEGER_COMPARISON(__sse42_integer_less,          _mm_cmpgt_epi32(b, a), false)
+__SSE42_INTEGER_COMPARISON(__sse42_integer_less_equal,    _mm_cmpgt_epi32(a, b), true)
+__SSE42_INTEGER_COMPARISON(__sse42_integer_greater,       _mm_cmpgt_epi32(a, b), false)
+__SSE42_INTEGER_COMPARISON(__sse42_integer_greater_equal, _mm_cmpgt_epi32(b, a), true)
+__SSE42_INTEGER_COMPARISON(__sse42_integer_equal,         _mm_cmpeq_epi32(a, b), false)
+__SSE42_INTEGER_COMPARISON(__sse42_integer_unequal,       _mm_cmpeq_epi32(a, b), true)
+
+#define __SSE42_REAL_ARITHMETIC(name, operation)                                            \
+SSE42 static R_xlen_t name(const double *x, R_xlen_t xs, const double *y, R_xlen_t ys,       \
+                           double *out, R_xlen_t length) {                                   \
+	const __m128d x_all = _mm_set1_pd(x[0]);                                                 \
+	const __m128d y_all = _mm_set1_pd(y[0]);                                                 \
+	R_xlen_t i = 0;                                                                          \
+	for (; i + 2 <= length; i += 2) {                                                        \
+		__m128d a = xs ? _mm_loadu_pd(x + i) : x_all;                                        \
+		__m128d b = ys ? _mm_loadu_pd(y + i) : y_all;                                        \
+		_mm_storeu_pd(out + i, operation(a, b));                                             \
+	}                                                                                        \
+	return i;                                                                                \
+}
+
+__SSE42_REAL_ARITHMETIC(__sse42_real_plus,   _mm_add_pd)
+__SSE42_REAL_ARITHMETIC(__sse42_real_minus,  _mm_sub_pd)
+__SSE42_REAL_ARITHMETIC(__sse42_real_times,  _mm_mul_pd)
+__SSE42_REAL_ARITHMETIC(__sse42_real_divide, _mm_div_pd)
+
+#define __SSE42_REAL_COMPARISON(name, comparison)                                           \
+SSE42 static R_xlen_t name(const double *x, R_xlen_t xs, const double *y, R_xlen_t ys,       \
+                           int *out, R_xlen_t length) {                                      \
+	const __m128d x_all = _mm_set1_pd(x[0]);                                                 \
+	const __m128d y_all = _mm_set1_pd(y[0]);                                                 \
+	const __m128i na  = _mm_set1_epi32(NA_LOGICAL);                                          \
+	const __m128i one = _mm_set1_epi32(1);                                                   \
+	R_xlen_t i = 0;                                                                          \
+	for (; i + 2 <= length; i += 2) {                                                        \
+		__m128d a = xs ? _mm_loadu_pd(x + i) : x_all;                                        \
+		__m128d b = ys ? _mm_loadu_pd(y + i) : y_all;                                        \
+		__m128i missing = __sse42_narrow_mask(_mm_cmpunord_pd(a, b));                        \
+		__m128i mask    = __sse42_narrow_mask(comparison(a, b));                             \
+		__m128i value   = _mm_blendv_epi8(_mm_and_si128(mask, one), na, missing);            \
+		_mm_storel_epi64((__m128i *) (out + i), value);                                      \
+	}                                                                                        \
+	return i;                                                                                \
+}
+
+__SSE42_REAL_COMPARISON(__sse42_real_less,          _mm_cmplt_pd)
+__SSE42_REAL_COMPARISON(__sse42_real_less_equal,    _mm_cmple_pd)
+__SSE42_REAL_COMPARISON(__sse42_real_greater,       _mm_cmpgt_pd)
+__SSE42_REAL_COMPARISON(__sse42_real_greater_equal, _mm_cmpge_pd)
+__SSE42_REAL_COMPARISON(__sse42_real_equal,         _mm_cmpeq_pd)
+__SSE42_REAL_COMPARISON(__sse42_real_unequal,       _mm_cmpneq_pd)
+
+//-----------------------------------------------------------------------------
+// Dispatch
+//-----------------------------------------------------------------------------
+
+typedef R_xlen_t (*__integer_arithmetic_t)(const int *, R_xlen_t, const int *, R_xlen_t, int *, R_xlen_t, bool *);
+typedef R_xlen_t (*__integer_comparison_t)(const int *, R_xlen_t, const int *, R_xlen_t, int *, R_xlen_t);
+typedef R_xlen_t (*__real_arithmetic_t)   (const double *, R_xlen_t, const double *, R_xlen_t, double *, R_xlen_t);
+typedef R_xlen_t (*__real_comparison_t)   (const double *, R_xlen_t, const double *, R_xlen_t, int *, R_xlen_t);
+
+typedef struct {
+	__integer_arithmetic_t integer_arithmetic[UFO_OP_NOT + 1];
+	__integer_comparison_t integer_comparison[UFO_OP_NOT + 1];
+	__real_arithmetic_t    real_arithmetic   [UFO_OP_NOT + 1];
+	__real_comparison_t    real_comparison   [UFO_OP_NOT + 1];
+} simd_kernels_t;
+
+#define __SIMD_KERNELS(prefix) {                                       \
+	.integer_arithmetic = {                                            \
+		[UFO_OP_ADD]           = prefix##_integer_plus,                \
+		[UFO_OP_SUBTRACT]      = prefix##_integer_minus,               \
+		[UFO_OP_MULTIPLY]      = prefix##_integer_times,               \
+	},                                                                 \
+	.integer_comparison = {                                            \
+		[UFO_OP_LESS]          = prefix##_integer_less,                \
+		[UFO_OP_LESS_EQUAL]    = prefix##_integer_less_equal,          \
+		[UFO_OP_GREATER]       = prefix##_integer_greater,             \
+		[UFO_OP_GREATER_EQUAL] = prefix##_integer_greater_equal,       \
+		[UFO_OP_EQUAL]         = prefix##_integer_equal,               \
+		[UFO_OP_UNEQUAL]       = prefix##_integer_unequal,             \
+	},                                                                 \
+	.real_arithmetic = {                                               \
+		[UFO_OP_ADD]           = prefix##_real_plus,                   \
+		[UFO_OP_SUBTRACT]      = prefix##_real_minus,                  \
+		[UFO_OP_MULTIPLY]      = prefix##_real_times,                  \
+		[UFO_OP_DIVIDE]        = prefix##_real_divide,                 \
+	},                                                                 \
+	.real_comparison = {                                               \
+		[UFO_OP_LESS]          = prefix##_real_less,                   \
+		[UFO_OP_LESS_EQUAL]    = prefix##_real_less_equal,             \
+		[UFO_OP_GREATER]       = prefix##_real_greater,                \
+		[UFO_OP_GREATER_EQUAL] = prefix##_real_greater_equal,          \
+		[UFO_OP_EQUAL]         = prefix##_real_equal,                  \
+		[UFO_OP_UNEQUAL]       = prefix##_real_unequal,                \
+	},                                                                 \
+}
+
+static const simd_kernels_t __avx2_kernels  = __SIMD_KERNELS(__avx2);
+static const simd_kernels_t __sse42_kernels = __SIMD_KERNELS(__sse42);
+
+R_xlen_t ufo_simd_binary_kernel(ufo_operator_t operator, SEXPTYPE working_type,
+                                ufo_region_t x, ufo_region_t y, void *target,
+                                R_xlen_t length, ufo_kernel_status_t *status) {
+	const simd_kernels_t *kernels;
+	switch (__simd_level) {
+	case UFO_SIMD_AVX2:  kernels = &__avx2_kernels;  break;
+	case UFO_SIMD_SSE42: kernels = &__sse42_kernels; break;
+	default:             return 0;
+	}
+
+	if (length <= 0) {
+		return 0;
+	}
+
+	// A broadcast operand is loaded once and its lanes reused for every step.
+	R_xlen_t xs = x.broadcast ? 0 : 1;
+	R_xlen_t ys = y.broadcast ? 0 : 1;
+
+	if (working_type == INTSXP) {
+		if (kernels->integer_arithmetic[operator] != NULL) {
+			bool overflow = false;
+			R_xlen_t done = kernels->integer_arithmetic[operator](x.data, xs, y.data, ys, target, length, &overflow);
+			status->integer_overflow |= overflow;
+			return done;
+		}
+		if (kernels->integer_comparison[operator] != NULL) {
+			return kernels->integer_comparison[operator](x.data, xs, y.data, ys, target, length);
+		}
+	}
+
+	if (working_type == REALSXP) {
+		if (kernels->real_arithmetic[operator] != NULL) {
+			return kernels->real_arithmetic[operator](x.data, xs, y.data, ys, target, length);
+		}
+		if (kernels->real_comparison[operator] != NULL) {
+			return kernels->real_comparison[operator](x.data, xs, y.data, ys, target, length);
+		}
+	}
+
+	return 0;
+}
+
+#else // UFO_SIMD_X86
+
+R_xlen_t ufo_simd_binary_kernel(ufo_operator_t operator, SEXPTYPE working_type,
+                                ufo_region_t x, ufo_region_t y, void *target,
+                                R_xlen_t length, ufo_kernel_status_t *status) {
+	return 0;
+}
+
+#endif // UFO_SIMD_X86
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdbool.h>
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+#include "ufo_kernels.h"
+
+// Picks the widest instruction set the CPU supports. Setting the UFO_SIMD
+// environment variable to "avx2", "sse4.2", or "none" caps the choice.
+void        ufo_simd_initialize(void);
+const char *ufo_simd_instruction_set(void);
+SEXP        ufo_simd_instruction_set_sexp(void);
+
+// Vectorized versions of the integer and double kernels for + - * / and
+// comparisons. Computes a prefix of the elements, whose length is returned,
+// and leaves the rest to the scalar kernels. Returns 0 for operators and
+// types without a vectorized version, or when SIMD is not available.
+// Broadcast operands are splat across a register once, outside the loop.
+R_xlen_t ufo_simd_binary_kernel(ufo_operator_t operator, SEXPTYPE working_type,
+                                ufo_region_t x, ufo_region_t y, void *target,
+                                R_xlen_t length, ufo_kernel_status_t *status);
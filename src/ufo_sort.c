@@ -0,0 +1,390 @@
+#include "ufo_sort.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+#include "safety_first.h"
+#include "helpers.h"
+#include "ufo_empty.h"
+#include "ufo_chunks.h"
+#include "ufo_threads.h"
+#include "ufo_radix.h"
+
+#define MIN(x, y) (x >= y ? y : x)
+
+//-----------------------------------------------------------------------------
+// Sorting runs
+//-----------------------------------------------------------------------------
+
+// Pieces of runs shorter than this are sorted by insertion before they are
+// merged.
+#define INSERTION_SORT_LENGTH 16
+
+#define __BEFORE(a, b, decreasing) ((decreasing) ? (a) > (b) : (a) < (b))
+
+#define __MOVE(to_keys, to_indices, to, from_keys, from_indices, from)                            \
+	do {                                                                                          \
+		(to_keys)[to] = (from_keys)[from];                                                        \
+		if (indices != NULL) (to_indices)[to] = (from_indices)[from];                             \
+	} while (0)
+
+// Stable merge sort of `length` keys, carrying indices along unless they are
+// NULL. The buffers must fit `length` elements each. Ties keep their order
+// also when sorting in decreasing order, like base R's radix order does.
+#define __DEFINE_MERGE_SORT(name, type)                                                           \
+static void name(type *keys, R_xlen_t *indices, type *key_buffer, R_xlen_t *index_buffer,       \
+                 R_xlen_t length, bool decreasing) {                                              \
+	for (R_xlen_t start = 0; start < length; start += INSERTION_SORT_LENGTH) {                   \
+		R_xlen_t end = MIN(start + INSERTION_SORT_LENGTH, length);                                \
+		for (R_xlen_t i = start + 1; i < end; i++) {                                              \
+			type key = keys[i];                                                                   \
+			R_xlen_t index = indices != NULL ? indices[i] : 0;                                    \
+			R_xlen_t j = i;                                                                       \
+			for (; j > start && __BEFORE(key, keys[j - 1], decreasing); j--) {                    \
+				__MOVE(keys, indices, j, keys, indices, j - 1);                                   \
+			}                                                                                     \
+			keys[j] = key;                                                                        \
+			if (indices != NULL) indices[j] = index;                                              \
+		}                                                                                         \
+	}                                                                                             \
+                                                                                                  \
+	type *from_keys = keys, *to_keys = key_buffer;                                                \
+	R_xlen_t *from_indices = indices, *to_indices = index_buffer;                                 \
+	for (R_xlen_t width = INSERTION_SORT_LENGTH; width < length; width *= 2) {                    \
+		for (R_xlen_t left = 0; left < length; left += 2 * width) {                               \
+			R_xlen_t middle = MIN(left + width, length);                                          \
+			R_xlen_t right = MIN(left + 2 * width, length);                                       \
+			R_xlen_t i = left, j = middle, k = left;                                              \
+			for (; i < middle && j < right; k++) {                                                \
+				if (__BEFORE(from_keys[j], from_keys[i], decreasing)) {                           \
+					__MOVE(to_keys, to_indices, k, from_keys, from_indices, j); j++;              \
+				} else {                                                                          \
+					__MOVE(to_keys, to_indices, k, from_keys, from_indices, i); i++;              \
+				}                                                                                 \
+			}                                                                                     \
+			for (; i < middle; i++, k++) __MOVE(to_keys, to_indices, k, from_keys, from_indices, i); \
+			for (; j < right; j++, k++)  __MOVE(to_keys, to_indices, k, from_keys, from_indices, j); \
+		}                                                                                         \
+		type *swap_keys = from_keys; from_keys = to_keys; to_keys = swap_keys;                    \
+		R_xlen_t *swap_indices = from_indices; from_indices = to_indices; to_indices = swap_indices; \
+	}                                                                                             \
+                                                                                                  \
+	if (from_keys != keys) {                                                                      \
+		memcpy(keys, from_keys, length * sizeof(type));                                           \
+		if (indices != NULL) memcpy(indices, from_indices, length * sizeof(R_xlen_t));            \
+	}                                                                                             \
+}
+
+__DEFINE_MERGE_SORT(__merge_sort_integers, int)
+__DEFINE_MERGE_SORT(__merge_sort_doubles, double)
+
+typedef enum {
+	UFO_SORT_RADIX,
+	UFO_SORT_MERGE,
+} ufo_sort_method_t;
+
+typedef struct {
+	const char        *name;
+	ufo_sort_method_t  method;
+} sort_method_name_t;
+
+static const sort_method_name_t __sort_method_names[] = {
+	{ "radix", UFO_SORT_RADIX },
+	{ "merge", UFO_SORT_MERGE },
+	{ NULL,    0              },
+};
+
+static ufo_sort_method_t __extract_sort_method_or_die(SEXP/*STRSXP*/ method) {
+	if (TYPEOF(method) != STRSXP || XLENGTH(method) != 1) {
+		Rf_error("Invalid sort method: expecting a single string, but found %s",
+		         type2char(TYPEOF(method)));
+	}
+
+	const char *name = CHAR(STRING_ELT(method, 0));
+	for (const sort_method_name_t *entry = __sort_method_names; entry->name != NULL; entry++) {
+		if (strcmp(entry->name, name) == 0) {
+			return entry->method;
+		}
+	}
+
+	Rf_error("Unknown sort method: %s", name);
+	return 0; // Mollifies linters.
+}
+
+// Radix sorts go over all 256 buckets in every pass, which does not pay off
+// for short runs.
+#define RADIX_SORT_MIN_LENGTH 256
+
+//-----------------------------------------------------------------------------
+// Chunked sort: runs, then a k-way merge
+//-----------------------------------------------------------------------------
+
+typedef struct {
+	SEXPTYPE         type;               // of x and of the runs
+	ufo_sort_method_t method;            // sorts runs
+	size_t           element_size;
+	bool             decreasing;
+	bool             ordering;           // carries indices along
+	bool             long_indices;
+	size_t           index_element_size;
+	ufo_operand_t    x;
+	R_xlen_t         length;
+	R_xlen_t         chunk_size;
+	R_xlen_t        *run_lengths;        // per chunk: elements that are not missing
+	unsigned char   *run_values;         // the runs, in intermediate UFOs
+	unsigned char   *run_indices;
+	unsigned char   *scratch;
+	size_t           scratch_size;       // bytes of scratch per worker
+} sort_job_t;
+
+static inline bool __is_missing(SEXPTYPE type, const void *values, R_xlen_t i) {
+	if (type == REALSXP) {
+		return ISNAN(((const double *) values)[i]);
+	}
+	return ((const int *) values)[i] == NA_INTEGER;
+}
+
+static inline void __set_index(unsigned char *indices, bool long_indices, R_xlen_t i, R_xlen_t index) {
+	if (long_indices) ((double *) indices)[i] = (double) index;
+	else              ((int *) indices)[i]    = (int) index;
+}
+
+// Sorts a chunk into a run: the elements that are not missing are sorted at
+// the front of the run, and missing elements follow them in their original
+// order.
+static void __sort_run(void *context, int worker, R_xlen_t start, R_xlen_t length) {
+	sort_job_t *job = (sort_job_t *) context;
+	size_t element_size = job->element_size;
+
+	// Indices go first, so that they stay aligned.
+	unsigned char *scratch = job->scratch + worker * job->scratch_size;
+	R_xlen_t *indices      = (R_xlen_t *) scratch;
+	R_xlen_t *index_buffer = indices + job->chunk_size;
+	unsigned char *keys       = (unsigned char *) (index_buffer + job->chunk_size);
+	unsigned char *key_buffer = keys + job->chunk_size * element_size;
+	unsigned char *region_scratch = key_buffer + job->chunk_size * element_size;
+
+	ufo_region_t region = ufo_operand_region(&job->x, job->type, start, length, region_scratch);
+
+	R_xlen_t present = 0;
+	for (R_xlen_t i = 0; i < length; i++) {
+		if (!__is_missing(job->type, region.data, i)) {
+			memcpy(keys + present * element_size, (const unsigned char *) region.data + i * element_size, element_size);
+			indices[present++] = start + i + 1;
+		}
+	}
+	R_xlen_t missing = present;
+	for (R_xlen_t i = 0; i < length; i++) {
+		if (__is_missing(job->type, region.data, i)) {
+			memcpy(keys + missing * element_size, (const unsigned char *) region.data + i * element_size, element_size);
+			indices[missing++] = start + i + 1;
+		}
+	}
+
+	R_xlen_t *carried_indices = job->ordering ? indices : NULL;
+	bool radix = job->method == UFO_SORT_RADIX && present >= RADIX_SORT_MIN_LENGTH;
+	if (job->type == REALSXP) {
+		if (radix) ufo_radix_sort_doubles((double *) keys, carried_indices, (double *) key_buffer, index_buffer,
+		                                  present, job->decreasing);
+		else       __merge_sort_doubles((double *) keys, carried_indices, (double *) key_buffer, index_buffer,
+		                                present, job->decreasing);
+	} else {
+		if (radix) ufo_radix_sort_integers((int *) keys, carried_indices, (int *) key_buffer, index_buffer,
+		                                   present, job->decreasing);
+		else       __merge_sort_integers((int *) keys, carried_indices, (int *) key_buffer, index_buffer,
+		                                 present, job->decreasing);
+	}
+
+	job->run_lengths[start / job->chunk_size] = present;
+	memcpy(job->run_values + start * element_size, keys, length * element_size);
+	if (job->ordering) {
+		for (R_xlen_t i = 0; i < length; i++) {
+			__set_index(job->run_indices, job->long_indices, start + i, indices[i]);
+		}
+	}
+}
+
+typedef struct {
+	R_xlen_t position;
+	R_xlen_t end;
+} run_t;
+
+// Whether the head of run a goes before the head of run b. Runs hold
+// consecutive chunks of x, so ties go to the earlier run to keep the sort
+// stable.
+static inline bool __run_before(const sort_job_t *job, const run_t *runs, R_xlen_t a, R_xlen_t b) {
+	if (job->type == REALSXP) {
+		double u = ((const double *) job->run_values)[runs[a].position];
+		double v = ((const double *) job->run_values)[runs[b].position];
+		if (u != v) return __BEFORE(u, v, job->decreasing);
+	} else {
+		int u = ((const int *) job->run_values)[runs[a].position];
+		int v = ((const int *) job->run_values)[runs[b].position];
+		if (u != v) return __BEFORE(u, v, job->decreasing);
+	}
+	return a < b;
+}
+
+static void __sift_down(const sort_job_t *job, const run_t *runs, R_xlen_t *heap, R_xlen_t size, R_xlen_t i) {
+	while (true) {
+		R_xlen_t first = i;
+		R_xlen_t left = 2 * i + 1, right = 2 * i + 2;
+		if (left < size && __run_before(job, runs, heap[left], heap[first]))   first = left;
+		if (right < size && __run_before(job, runs, heap[right], heap[first])) first = right;
+		if (first == i) return;
+		R_xlen_t swap = heap[i]; heap[i] = heap[first]; heap[first] = swap;
+		i = first;
+	}
+}
+
+// Copies element `position` of the runs into the result: its value when
+// sorting, its index when ordering.
+static inline void __emit(const sort_job_t *job, unsigned char *result, R_xlen_t *target, R_xlen_t position) {
+	if (job->ordering) {
+		memcpy(result + *target * job->index_element_size,
+		       job->run_indices + position * job->index_element_size, job->index_element_size);
+	} else {
+		memcpy(result + *target * job->element_size,
+		       job->run_values + position * job->element_size, job->element_size);
+	}
+	(*target)++;
+}
+
+static void __emit_missing(const sort_job_t *job, R_xlen_t number_of_runs, unsigned char *result, R_xlen_t *target) {
+	for (R_xlen_t run = 0; run < number_of_runs; run++) {
+		R_xlen_t start = run * job->chunk_size;
+		R_xlen_t end = MIN(start + job->chunk_size, job->length);
+		for (R_xlen_t position = start + job->run_lengths[run]; position < end; position++) {
+			__emit(job, result, target, position);
+		}
+	}
+}
+
+// Merges the sorted parts of all runs with a heap of the runs' heads.
+static void __merge_runs(const sort_job_t *job, R_xlen_t number_of_runs, unsigned char *result, R_xlen_t *target) {
+	run_t *runs = (run_t *) R_alloc(number_of_runs, sizeof(run_t));
+	R_xlen_t *heap = (R_xlen_t *) R_alloc(number_of_runs, sizeof(R_xlen_t));
+
+	R_xlen_t size = 0;
+	for (R_xlen_t run = 0; run < number_of_runs; run++) {
+		runs[run].position = run * job->chunk_size;
+		runs[run].end = runs[run].position + job->run_lengths[run];
+		if (runs[run].position < runs[run].end) {
+			heap[size++] = run;
+		}
+	}
+	for (R_xlen_t i = size / 2; i > 0; i--) {
+		__sift_down(job, runs, heap, size, i - 1);
+	}
+
+	while (size > 0) {
+		run_t *run = &runs[heap[0]];
+		__emit(job, result, target, run->position++);
+		if (run->position == run->end) {
+			heap[0] = heap[--size];
+		}
+		__sift_down(job, runs, heap, size, 0);
+	}
+}
+
+static SEXP __sort(SEXP x, bool ordering, SEXP/*LGLSXP*/ decreasing, SEXP/*LGLSXP*/ na_last_sexp,
+                   SEXP/*STRSXP*/ method, SEXP/*INTSXP*/ min_load_count_sexp, SEXP/*REALSXP*/ chunk_size_sexp) {
+	make_sure(TYPEOF(na_last_sexp) == LGLSXP && XLENGTH(na_last_sexp) == 1, "na.last must be a single logical");
+	int na_last = LOGICAL(na_last_sexp)[0];
+	int32_t min_load_count = __extract_int_or_die(min_load_count_sexp);
+	R_xlen_t chunk_size = chunk_size_sexp == R_NilValue ? 0 : __extract_R_xlen_t_or_die(chunk_size_sexp);
+	make_sure(chunk_size_sexp == R_NilValue || chunk_size > 0, "Chunk size must be positive, but is %li", chunk_size);
+
+	sort_job_t job;
+	switch (TYPEOF(x)) {
+	case LGLSXP:
+	case INTSXP:
+	case REALSXP: job.type = TYPEOF(x); break;
+	default:      return R_NilValue;
+	}
+
+	job.method = __extract_sort_method_or_die(method);
+	job.decreasing = __extract_boolean_or_die(decreasing);
+	job.ordering = ordering;
+	job.element_size = __get_element_size(job.type);
+	job.x = ufo_operand_from(x);
+	job.length = job.x.length;
+
+	// Indices are as long as x is, the same way subscripts pick theirs.
+	job.long_indices = job.length > R_SHORT_LEN_MAX;
+	job.index_element_size = job.long_indices ? sizeof(double) : sizeof(int);
+	SEXPTYPE result_type = ordering ? (job.long_indices ? REALSXP : INTSXP) : job.type;
+
+	if (job.length == 0) {
+		return allocVector(result_type, 0);
+	}
+
+	if (chunk_size_sexp == R_NilValue) {
+		chunk_size = ufo_plan_chunk_size(&x, 1, job.element_size, min_load_count, job.length);
+	}
+	job.chunk_size = MIN(chunk_size, job.length);
+	R_xlen_t number_of_runs = (job.length + job.chunk_size - 1) / job.chunk_size;
+
+	int threads = ufo_threads_from_option();
+	ufo_operand_prepare(&job.x, job.type, job.length, job.chunk_size, false);
+	if (ufo_operand_needs_r(&job.x)) {
+		threads = 1;
+	}
+
+	job.scratch_size = job.chunk_size * (2 * sizeof(R_xlen_t) + 3 * job.element_size);
+	job.scratch_size = (job.scratch_size + sizeof(R_xlen_t) - 1) / sizeof(R_xlen_t) * sizeof(R_xlen_t);
+	job.scratch = (unsigned char *) R_alloc(threads, job.scratch_size);
+	job.run_lengths = (R_xlen_t *) R_alloc(number_of_runs, sizeof(R_xlen_t));
+
+	SEXP run_values = PROTECT(ufo_empty(job.type, job.length, false, min_load_count));
+	job.run_values = (unsigned char *) DATAPTR(run_values);
+	SEXP run_indices = R_NilValue;
+	if (ordering) {
+		run_indices = ufo_empty(job.long_indices ? REALSXP : INTSXP, job.length, false, min_load_count);
+		job.run_indices = (unsigned char *) DATAPTR(run_indices);
+	}
+	PROTECT(run_indices);
+
+	ufo_parallel_for(job.length, job.chunk_size, threads, &__sort_run, &job);
+
+	R_xlen_t present = 0;
+	for (R_xlen_t run = 0; run < number_of_runs; run++) {
+		present += job.run_lengths[run];
+	}
+	R_xlen_t result_length = na_last == NA_LOGICAL ? present : job.length;
+	if (result_length == 0) {
+		UNPROTECT(2);
+		return allocVector(result_type, 0);
+	}
+
+	SEXP result = PROTECT(ufo_empty(result_type, result_length, false, min_load_count));
+	unsigned char *result_data = (unsigned char *) DATAPTR(result);
+
+	R_xlen_t target = 0;
+	if (na_last == FALSE) {
+		__emit_missing(&job, number_of_runs, result_data, &target);
+	}
+	__merge_runs(&job, number_of_runs, result_data, &target);
+	if (na_last == TRUE) {
+		__emit_missing(&job, number_of_runs, result_data, &target);
+	}
+	make_sure(target == result_length, "Sorted %li elements into a result of %li", target, result_length);
+
+	UNPROTECT(3);
+	return result;
+}
+
+SEXP ufo_sort(SEXP x, SEXP/*LGLSXP*/ decreasing, SEXP/*LGLSXP*/ na_last, SEXP/*STRSXP*/ method,
+              SEXP/*INTSXP*/ min_load_count, SEXP/*REALSXP*/ chunk_size) {
+	return __sort(x, false, decreasing, na_last, method, min_load_count, chunk_size);
+}
+
+SEXP ufo_order(SEXP x, SEXP/*LGLSXP*/ decreasing, SEXP/*LGLSXP*/ na_last, SEXP/*STRSXP*/ method,
+               SEXP/*INTSXP*/ min_load_count, SEXP/*REALSXP*/ chunk_size) {
+	return __sort(x, true, decreasing, na_last, method, min_load_count, chunk_size);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+// Sorts a logical, integer or double vector that need not fit into memory,
+// like base R's sort. The vector is cut into chunks, which are sorted into
+// runs on `ufooperators.threads` threads and written into an intermediate
+// UFO, so the UFO core can write them out under memory pressure. The runs are
+// then merged into a new UFO. `method` picks how runs are sorted: "radix"
+// (see ufo_radix.h) or "merge" (a stable merge sort). Short runs are always
+// merge sorted.
+//
+// Missing values (NA and NaN) are removed if `na_last` is NA, and otherwise
+// placed at the end (TRUE) or the beginning (FALSE) of the result, in their
+// original order. Ties are kept in their original order also when sorting in
+// decreasing order. If `chunk_size` is NULL, it is planned from the vector
+// (see ufo_plan_chunk_size).
+//
+// Returns NULL for vectors of other types, which the caller should hand over
+// to base R.
+SEXP ufo_sort(SEXP x, SEXP/*LGLSXP*/ decreasing, SEXP/*LGLSXP*/ na_last, SEXP/*STRSXP*/ method,
+              SEXP/*INTSXP*/ min_load_count, SEXP/*REALSXP*/ chunk_size);
+
+// Like ufo_sort, but returns the (1-based) indices of the elements of x in
+// sorted order, like base R's order with a single vector. The indices are
+// integers, or doubles if x is a long vector.
+SEXP ufo_order(SEXP x, SEXP/*LGLSXP*/ decreasing, SEXP/*LGLSXP*/ na_last, SEXP/*STRSXP*/ method,
+               SEXP/*INTSXP*/ min_load_count, SEXP/*REALSXP*/ chunk_size);
@@ -0,0 +1,126 @@
+#include "ufo_tabulate.h"
+
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+#include "safety_first.h"
+#include "helpers.h"
+#include "ufo_chunks.h"
+#include "ufo_threads.h"
+
+#define MIN(x, y) (x >= y ? y : x)
+
+typedef struct {
+	SEXPTYPE         working_type;
+	ufo_operand_t    x;
+	int64_t          offset;
+	R_xlen_t         nbins;
+	R_xlen_t        *histograms;     // nbins per worker
+	unsigned char   *scratch;
+	size_t           scratch_size;   // bytes of scratch per worker
+} tabulate_job_t;
+
+static void __tabulate_chunk(void *context, int worker, R_xlen_t start, R_xlen_t length) {
+	tabulate_job_t *job = (tabulate_job_t *) context;
+	R_xlen_t *histogram = job->histograms + worker * job->nbins;
+
+	ufo_region_t region = ufo_operand_region(&job->x, job->working_type, start, length,
+	                                         job->scratch + worker * job->scratch_size);
+
+	// Histograms are indexed from 0, so bin b is at b - 1.
+	if (job->working_type == INTSXP) {
+		const int *values = (const int *) region.data;
+		for (R_xlen_t i = 0; i < length; i++) {
+			if (values[i] == NA_INTEGER) continue;
+			int64_t bin = (int64_t) values[i] - job->offset;
+			if (bin >= 1 && bin <= job->nbins) histogram[bin - 1]++;
+		}
+	} else {
+		const double *values = (const double *) region.data;
+		for (R_xlen_t i = 0; i < length; i++) {
+			if (ISNAN(values[i])) continue;
+			double bin = trunc(values[i]) - (double) job->offset;
+			if (bin >= 1 && bin <= job->nbins) histogram[(R_xlen_t) bin - 1]++;
+		}
+	}
+}
+
+SEXP ufo_tabulate(SEXP x, SEXP/*REALSXP*/ offset_sexp, SEXP/*INTSXP*/ nbins_sexp, SEXP/*REALSXP*/ chunk_size_sexp) {
+	int64_t offset = (int64_t) __extract_R_xlen_t_or_die(offset_sexp);
+	int nbins = __extract_int_or_die(nbins_sexp);
+	make_sure(nbins != NA_INTEGER && nbins >= 0, "Number of bins must be non-negative, but is %i", nbins);
+	R_xlen_t chunk_size = chunk_size_sexp == R_NilValue ? 0 : __extract_R_xlen_t_or_die(chunk_size_sexp);
+	make_sure(chunk_size_sexp == R_NilValue || chunk_size > 0, "Chunk size must be positive, but is %li", chunk_size);
+
+	tabulate_job_t job;
+	switch (TYPEOF(x)) {
+	case LGLSXP:
+	case INTSXP:  job.working_type = INTSXP;  break;
+	case REALSXP: job.working_type = REALSXP; break;
+	default:      return R_NilValue;
+	}
+
+	job.x = ufo_operand_from(x);
+	job.offset = offset;
+	job.nbins = nbins;
+	R_xlen_t length = job.x.length;
+
+	// Empty vectors have nothing to prepare or count.
+	if (length == 0) {
+		SEXP result = allocVector(INTSXP, nbins);
+		memset(INTEGER(result), 0, nbins * sizeof(int));
+		return result;
+	}
+
+	if (chunk_size_sexp == R_NilValue) {
+		chunk_size = ufo_plan_chunk_size(&x, 1, 0, 0, length);
+	}
+
+	R_xlen_t chunk_length = MIN(chunk_size, length);
+
+	int threads = ufo_threads_from_option();
+	ufo_operand_prepare(&job.x, job.working_type, length, chunk_length, false);
+	if (ufo_operand_needs_r(&job.x)) {
+		threads = 1;
+	}
+
+	// A histogram per thread only pays off while it is smaller than the
+	// chunks counted into it.
+	if (nbins > chunk_length) {
+		threads = 1;
+	}
+
+	job.scratch_size = chunk_length * ufo_working_type_element_size(job.working_type);
+	job.scratch = (unsigned char *) R_alloc(threads, job.scratch_size);
+	job.histograms = (R_xlen_t *) R_alloc((size_t) threads * nbins, sizeof(R_xlen_t));
+	memset(job.histograms, 0, (size_t) threads * nbins * sizeof(R_xlen_t));
+
+	ufo_parallel_for(length, chunk_size, threads, &__tabulate_chunk, &job);
+
+	bool fits = true;
+	for (R_xlen_t bin = 0; bin < nbins; bin++) {
+		for (int worker = 1; worker < threads; worker++) {
+			job.histograms[bin] += job.histograms[worker * job.nbins + bin];
+		}
+		fits &= job.histograms[bin] <= INT_MAX;
+	}
+
+	SEXP result = PROTECT(allocVector(fits ? INTSXP : REALSXP, nbins));
+	for (R_xlen_t bin = 0; bin < nbins; bin++) {
+		if (fits) {
+			INTEGER(result)[bin] = (int) job.histograms[bin];
+		} else {
+			REAL(result)[bin] = (double) job.histograms[bin];
+		}
+	}
+
+	UNPROTECT(1);
+	return result;
+}
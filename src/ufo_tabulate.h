@@ -0,0 +1,21 @@
+#pragma once
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+// Counts how many elements of a logical, integer (or factor) or double
+// vector fall into each of `nbins` bins: an element v goes into bin
+// v - `offset` if that is between 1 and nbins, like base R's tabulate (which
+// is the same with an offset of 0). Doubles are truncated towards zero first,
+// and NAs and elements outside of the bins are not counted.
+//
+// The vector is streamed in chunks on `ufooperators.threads` threads, each
+// of which counts into a histogram of its own, and the histograms are added
+// up at the end. If `chunk_size` is NULL, it is planned from the vector (see
+// ufo_plan_chunk_size).
+//
+// Returns an ordinary integer vector of counts, or a double vector if any of
+// the counts does not fit into an integer. Returns NULL for vectors of other
+// types, which the caller should hand over to base R.
+SEXP ufo_tabulate(SEXP x, SEXP/*REALSXP*/ offset, SEXP/*INTSXP*/ nbins, SEXP/*REALSXP*/ chunk_size);
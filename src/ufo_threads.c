@@ -0,0 +1,237 @@
+#include "ufo_threads.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+#define MIN(x, y) (x >= y ? y : x)
+
+// There is no point in going wild with threads: the work is memory bound.
+#define UFO_MAX_THREADS 256
+
+// A pool of worker threads which sleep until a loop is started. The thread
+// that starts a loop takes part in it as worker 0, and the pool's threads are
+// workers 1 and up. Chunks are handed out one at a time from a shared counter.
+typedef struct {
+	pthread_mutex_t     lock;
+	pthread_cond_t      work_available;
+	pthread_cond_t      work_done;
+	pthread_t          *threads;
+	int                 size;            // number of threads in the pool
+
+	// The current loop. Protected by the lock.
+	unsigned long       generation;      // incremented for every loop
+	ufo_parallel_body_t body;
+	void               *context;
+	R_xlen_t            length;
+	R_xlen_t            chunk_size;
+	R_xlen_t            next_chunk;
+	int                 participants;    // pool threads taking part in the loop
+	int                 busy;            // pool threads still working on the loop
+	bool                shutting_down;
+} pool_t;
+
+typedef struct {
+	pool_t        *pool;
+	int            worker;
+	unsigned long  generation;   // the last loop started before this worker
+} worker_t;
+
+static pool_t __pool = {
+	.lock           = PTHREAD_MUTEX_INITIALIZER,
+	.work_available = PTHREAD_COND_INITIALIZER,
+	.work_done      = PTHREAD_COND_INITIALIZER,
+	.threads        = NULL,
+	.size           = 0,
+};
+
+// Claims chunks until there are none left. Called with the lock held, returns
+// with the lock held.
+static void __work(pool_t *pool, int worker) {
+	R_xlen_t number_of_chunks = (pool->length + pool->chunk_size - 1) / pool->chunk_size;
+
+	while (pool->next_chunk < number_of_chunks) {
+		R_xlen_t chunk = pool->next_chunk++;
+		ufo_parallel_body_t body = pool->body;
+		void *context = pool->context;
+		R_xlen_t start = chunk * pool->chunk_size;
+		R_xlen_t length = MIN(pool->chunk_size, pool->length - start);
+
+		pthread_mutex_unlock(&pool->lock);
+		body(context, worker, start, length);
+		pthread_mutex_lock(&pool->lock);
+	}
+}
+
+static void *__worker_main(void *argument) {
+	worker_t self = *((worker_t *) argument);
+	free(argument);
+
+	pool_t *pool = self.pool;
+	unsigned long seen_generation = self.generation;
+
+	pthread_mutex_lock(&pool->lock);
+	while (true) {
+		while (!pool->shutting_down && pool->generation == seen_generation) {
+			pthread_cond_wait(&pool->work_available, &pool->lock);
+		}
+		if (pool->shutting_down) {
+			break;
+		}
+		seen_generation = pool->generation;
+
+		if (self.worker > pool->participants) {
+			continue;
+		}
+
+		__work(pool, self.worker);
+		if (--pool->busy == 0) {
+			pthread_cond_signal(&pool->work_done);
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+void ufo_threads_shutdown(void) {
+	pool_t *pool = &__pool;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->shutting_down = true;
+	pthread_cond_broadcast(&pool->work_available);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (int i = 0; i < pool->size; i++) {
+		pthread_join(pool->threads[i], NULL);
+	}
+
+	free(pool->threads);
+	pool->threads = NULL;
+	pool->size = 0;
+	pool->shutting_down = false;
+}
+
+// A forked child (eg. from parallel::mclapply) inherits the pool but not its
+// threads, so it has to start from scratch.
+static void __forget_pool_after_fork(void) {
+	pthread_mutex_init(&__pool.lock, NULL);
+	pthread_cond_init(&__pool.work_available, NULL);
+	pthread_cond_init(&__pool.work_done, NULL);
+	__pool.threads = NULL;
+	__pool.size = 0;
+	__pool.shutting_down = false;
+}
+
+// Makes sure the pool has at least `size` threads. The pool only ever grows,
+// by replacing it with a larger one.
+static void __ensure_pool(int size) {
+	static bool registered_fork_handler = false;
+	pool_t *pool = &__pool;
+
+	if (pool->size >= size) {
+		return;
+	}
+
+	if (!registered_fork_handler) {
+		pthread_atfork(NULL, NULL, &__forget_pool_after_fork);
+		registered_fork_handler = true;
+	}
+
+	ufo_threads_shutdown();
+
+	pthread_t *threads = (pthread_t *) malloc(size * sizeof(pthread_t));
+	if (threads == NULL) {
+		Rf_error("Cannot allocate worker threads");
+	}
+
+	// Workers must not receive signals meant for R, eg. SIGINT, so they are
+	// started with all signals blocked.
+	sigset_t all_signals, previous_signals;
+	sigfillset(&all_signals);
+	pthread_sigmask(SIG_SETMASK, &all_signals, &previous_signals);
+
+	int started = 0;
+	for (; started < size; started++) {
+		worker_t *worker = (worker_t *) malloc(sizeof(worker_t));
+		if (worker == NULL) {
+			break;
+		}
+		worker->pool = pool;
+		worker->worker = started + 1;
+		worker->generation = pool->generation;
+		if (pthread_create(&threads[started], NULL, &__worker_main, worker) != 0) {
+			free(worker);
+			break;
+		}
+	}
+
+	pthread_sigmask(SIG_SETMASK, &previous_signals, NULL);
+
+	pool->threads = threads;
+	pool->size = started;
+
+	if (started < size) {
+		Rf_warning("Could only start %i out of %i worker threads", started, size);
+	}
+}
+
+void ufo_parallel_for(R_xlen_t length, R_xlen_t chunk_size, int threads,
+                      ufo_parallel_body_t body, void *context) {
+	if (length <= 0) {
+		return;
+	}
+
+	R_xlen_t number_of_chunks = (length + chunk_size - 1) / chunk_size;
+	int helpers = (int) MIN((R_xlen_t) threads, number_of_chunks) - 1;
+
+	if (helpers > 0) {
+		__ensure_pool(helpers);
+		helpers = MIN(helpers, __pool.size);
+	}
+
+	// Nothing to share, so no need to involve the pool.
+	if (helpers <= 0) {
+		for (R_xlen_t start = 0; start < length; start += chunk_size) {
+			body(context, 0, start, MIN(chunk_size, length - start));
+		}
+		return;
+	}
+
+	pool_t *pool = &__pool;
+	pthread_mutex_lock(&pool->lock);
+	pool->body         = body;
+	pool->context      = context;
+	pool->length       = length;
+	pool->chunk_size   = chunk_size;
+	pool->next_chunk   = 0;
+	pool->participants = helpers;
+	pool->busy         = helpers;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->work_available);
+
+	__work(pool, 0);
+
+	while (pool->busy > 0) {
+		pthread_cond_wait(&pool->work_done, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+int ufo_threads_from_option(void) {
+	SEXP option = GetOption1(install("ufooperators.threads"));
+	if (option == R_NilValue) {
+		return 1;
+	}
+
+	int threads = asInteger(option);
+	if (threads == NA_INTEGER || threads < 1) {
+		Rf_warning("Option ufooperators.threads should be a positive integer, using 1 thread");
+		return 1;
+	}
+	return MIN(threads, UFO_MAX_THREADS);
+}
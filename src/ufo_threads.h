@@ -0,0 +1,27 @@
+#pragma once
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+// Computes one chunk of a parallel loop. Runs outside of R's thread (except
+// for worker 0, which is the calling thread), so it must not use the R API.
+// `worker` identifies the thread, from 0 to the number of threads - 1, so
+// that per-thread scratch space can be indexed by it.
+typedef void (*ufo_parallel_body_t)(void *context, int worker, R_xlen_t start, R_xlen_t length);
+
+// Calls `body` for every chunk of [0, length), spreading chunks across at most
+// `threads` threads from a shared pool. Returns once all chunks are done.
+// Each chunk covers the same range regardless of how many threads there are,
+// so the results do not depend on the number of threads or on scheduling.
+//
+// Must only be called from R's thread, and never from inside a body.
+void ufo_parallel_for(R_xlen_t length, R_xlen_t chunk_size, int threads,
+                      ufo_parallel_body_t body, void *context);
+
+// Number of threads requested by the `ufooperators.threads` option, 1 by
+// default.
+int ufo_threads_from_option(void);
+
+// Stops the worker threads. Called when the package is unloaded.
+void ufo_threads_shutdown(void);
@@ -0,0 +1,130 @@
+#include "ufo_unique.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+#include "safety_first.h"
+#include "helpers.h"
+#include "ufo_empty.h"
+#include "ufo_chunks.h"
+#include "ufo_hash.h"
+
+#define MIN(x, y) (x >= y ? y : x)
+
+typedef enum {
+	UFO_UNIQUE,
+	UFO_DUPLICATED,
+	UFO_ANY_DUPLICATED,
+} ufo_deduplication_t;
+
+// Adds every element of x to the hash, in order. Duplicates are marked in
+// `duplicated` if it is not NULL, and with `stop_at_duplicate` the first
+// duplicate ends the pass. Returns the 1-based index of the first duplicate,
+// or 0 if there is none.
+static R_xlen_t __add_all(ufo_hash_t *hash, ufo_key_source_t *source, R_xlen_t chunk_size,
+                          int *duplicated, bool stop_at_duplicate) {
+	R_xlen_t first_duplicate = 0;
+	for (R_xlen_t start = 0; start < source->length; start += chunk_size) {
+		R_xlen_t length = MIN(chunk_size, source->length - start);
+		const void *keys = ufo_key_source_region(source, 0, start, length);
+		for (R_xlen_t i = 0; i < length; i++) {
+			bool added;
+			ufo_hash_add(hash, ufo_key_at(hash->type, keys, i), start + i + 1, &added);
+			if (duplicated != NULL) {
+				duplicated[start + i] = !added;
+			}
+			if (!added && first_duplicate == 0) {
+				first_duplicate = start + i + 1;
+				if (stop_at_duplicate) {
+					return first_duplicate;
+				}
+			}
+		}
+	}
+	return first_duplicate;
+}
+
+// Writes every key of the hash at its group, which is the order in which
+// the keys first occurred.
+static void __write_keys(const ufo_hash_t *hash, SEXP result) {
+	for (R_xlen_t i = 0; i < hash->size; i++) {
+		const ufo_hash_slot_t *slot = &hash->slots[i];
+		if (slot->index == 0) {
+			continue;
+		}
+		switch (hash->type) {
+		case LGLSXP:  LOGICAL(result)[slot->group] = slot->key.integer; break;
+		case INTSXP:  INTEGER(result)[slot->group] = slot->key.integer; break;
+		case REALSXP: REAL(result)[slot->group]    = slot->key.real;    break;
+		case CPLXSXP: COMPLEX(result)[slot->group] = slot->key.complex; break;
+		default:      SET_STRING_ELT(result, slot->group, slot->key.string);
+		}
+	}
+}
+
+static SEXP __deduplicate(ufo_deduplication_t operation, SEXP x, int32_t min_load_count,
+                          SEXP/*REALSXP*/ chunk_size_sexp) {
+	R_xlen_t chunk_size = chunk_size_sexp == R_NilValue ? 0 : __extract_R_xlen_t_or_die(chunk_size_sexp);
+	make_sure(chunk_size_sexp == R_NilValue || chunk_size > 0, "Chunk size must be positive, but is %li", chunk_size);
+
+	SEXPTYPE type = ufo_key_type(TYPEOF(x), TYPEOF(x));
+	if (type == NILSXP) {
+		return R_NilValue;
+	}
+
+	R_xlen_t length = XLENGTH(x);
+	if (length == 0) {
+		switch (operation) {
+		case UFO_UNIQUE:     return allocVector(type, 0);
+		case UFO_DUPLICATED: return allocVector(LGLSXP, 0);
+		default:             return ScalarInteger(0);
+		}
+	}
+
+	if (chunk_size_sexp == R_NilValue) {
+		chunk_size = ufo_plan_chunk_size(&x, 1, 0, min_load_count, length);
+	}
+	ufo_key_source_t source = ufo_key_source(x, type, MIN(chunk_size, length), 1);
+
+	ufo_hash_t hash = ufo_hash_new(type, 0, min_load_count);
+
+	SEXP result;
+	switch (operation) {
+	case UFO_UNIQUE:
+		__add_all(&hash, &source, chunk_size, NULL, false);
+		result = PROTECT(ufo_empty(type, hash.count, false, min_load_count));
+		__write_keys(&hash, result);
+		break;
+
+	case UFO_DUPLICATED:
+		result = PROTECT(ufo_empty(LGLSXP, length, false, min_load_count));
+		__add_all(&hash, &source, chunk_size, LOGICAL(result), false);
+		break;
+
+	default: {
+		R_xlen_t first_duplicate = __add_all(&hash, &source, chunk_size, NULL, true);
+		result = PROTECT(first_duplicate > INT_MAX ? ScalarReal((double) first_duplicate)
+		                                           : ScalarInteger((int) first_duplicate));
+	}
+	}
+
+	UNPROTECT(1); // result, which is above the hash
+	ufo_hash_free(&hash);
+	return result;
+}
+
+SEXP ufo_unique(SEXP x, SEXP/*INTSXP*/ min_load_count, SEXP/*REALSXP*/ chunk_size) {
+	return __deduplicate(UFO_UNIQUE, x, __extract_int_or_die(min_load_count), chunk_size);
+}
+
+SEXP ufo_duplicated(SEXP x, SEXP/*INTSXP*/ min_load_count, SEXP/*REALSXP*/ chunk_size) {
+	return __deduplicate(UFO_DUPLICATED, x, __extract_int_or_die(min_load_count), chunk_size);
+}
+
+SEXP ufo_any_duplicated(SEXP x, SEXP/*REALSXP*/ chunk_size) {
+	return __deduplicate(UFO_ANY_DUPLICATED, x, 0, chunk_size);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+// unique, duplicated and anyDuplicated of a logical, integer, double, complex
+// or string vector, like base R's (without incomparables and fromLast).
+// Elements are compared the way base R compares them (see ufo_hash.h).
+//
+// The vector is read in chunks into a hash table of its distinct elements
+// (ufo_hash), which lives in a UFO rather than on R's heap. unique writes the
+// distinct elements into a new UFO in the order they first occur, and
+// duplicated writes a new logical UFO. anyDuplicated stops at the first
+// duplicate and returns its index, or 0. If `chunk_size` is NULL, it is
+// planned from the vector (see ufo_plan_chunk_size).
+//
+// Return NULL for vectors of other types, which the caller should hand over
+// to base R.
+SEXP ufo_unique        (SEXP x, SEXP/*INTSXP*/ min_load_count, SEXP/*REALSXP*/ chunk_size);
+SEXP ufo_duplicated    (SEXP x, SEXP/*INTSXP*/ min_load_count, SEXP/*REALSXP*/ chunk_size);
+SEXP ufo_any_duplicated(SEXP x, SEXP/*REALSXP*/ chunk_size);
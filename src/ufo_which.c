@@ -0,0 +1,122 @@
+#include "ufo_which.h"
+
+#include <stdbool.h>
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+#include "safety_first.h"
+#include "helpers.h"
+#include "ufo_empty.h"
+#include "ufo_chunks.h"
+#include "ufo_threads.h"
+#include "ufo_packed.h"
+
+#define MIN(x, y) (x >= y ? y : x)
+
+typedef struct {
+	ufo_operand_t    x;
+	R_xlen_t         chunk_size;
+	bool             counting;      // first pass, otherwise writing indices
+	R_xlen_t        *offsets;       // one per chunk: counts, then offsets
+	bool             long_indices;
+	int             *integer_indices;
+	double          *real_indices;
+	unsigned char   *scratch;
+	size_t           scratch_size;  // bytes of scratch per worker
+} which_job_t;
+
+static void __which_chunk(void *context, int worker, R_xlen_t start, R_xlen_t length) {
+	which_job_t *job = (which_job_t *) context;
+	R_xlen_t chunk = start / job->chunk_size;
+
+	ufo_region_t region = ufo_operand_region(&job->x, LGLSXP, start, length,
+	                                         job->scratch + worker * job->scratch_size);
+	const int *values = (const int *) region.data;
+
+	if (job->counting) {
+		R_xlen_t count = 0;
+		for (R_xlen_t i = 0; i < length; i++) {
+			count += values[i] == TRUE;
+		}
+		job->offsets[chunk] = count;
+		return;
+	}
+
+	R_xlen_t offset = job->offsets[chunk];
+	if (job->long_indices) {
+		for (R_xlen_t i = 0; i < length; i++) {
+			if (values[i] == TRUE) job->real_indices[offset++] = (double) (start + i + 1);
+		}
+	} else {
+		for (R_xlen_t i = 0; i < length; i++) {
+			if (values[i] == TRUE) job->integer_indices[offset++] = (int) (start + i + 1);
+		}
+	}
+}
+
+SEXP ufo_which(SEXP x, SEXP/*INTSXP*/ min_load_count_sexp, SEXP/*REALSXP*/ chunk_size_sexp) {
+	int32_t min_load_count = __extract_int_or_die(min_load_count_sexp);
+	R_xlen_t chunk_size = chunk_size_sexp == R_NilValue ? 0 : __extract_R_xlen_t_or_die(chunk_size_sexp);
+	make_sure(chunk_size_sexp == R_NilValue || chunk_size > 0, "Chunk size must be positive, but is %li", chunk_size);
+
+	if (TYPEOF(x) != LGLSXP) {
+		return R_NilValue;
+	}
+
+	ufo_packed_t packed;
+	if (ufo_packed_lookup(x, &packed)) {
+		return ufo_packed_which(x, min_load_count_sexp);
+	}
+
+	which_job_t job;
+	job.x = ufo_operand_from(x);
+	R_xlen_t length = job.x.length;
+	if (length == 0) {
+		return allocVector(INTSXP, 0);
+	}
+
+	if (chunk_size_sexp == R_NilValue) {
+		chunk_size = ufo_plan_chunk_size(&x, 1, 0, min_load_count, length);
+	}
+	job.chunk_size = chunk_size;
+
+	R_xlen_t chunk_length = MIN(chunk_size, length);
+	R_xlen_t number_of_chunks = (length + chunk_size - 1) / chunk_size;
+
+	int threads = ufo_threads_from_option();
+	ufo_operand_prepare(&job.x, LGLSXP, length, chunk_length, false);
+	if (ufo_operand_needs_r(&job.x)) {
+		threads = 1;
+	}
+
+	job.scratch_size = chunk_length * sizeof(int);
+	job.scratch = (unsigned char *) R_alloc(threads, job.scratch_size);
+	job.offsets = (R_xlen_t *) R_alloc(number_of_chunks, sizeof(R_xlen_t));
+
+	job.counting = true;
+	ufo_parallel_for(length, chunk_size, threads, &__which_chunk, &job);
+
+	R_xlen_t count = 0;
+	for (R_xlen_t chunk = 0; chunk < number_of_chunks; chunk++) {
+		R_xlen_t chunk_count = job.offsets[chunk];
+		job.offsets[chunk] = count;
+		count += chunk_count;
+	}
+
+	if (count == 0) {
+		return allocVector(INTSXP, 0);
+	}
+
+	job.long_indices = length > R_SHORT_LEN_MAX;
+	SEXP result = PROTECT(ufo_empty(job.long_indices ? UFO_REAL : UFO_INT, count, false, min_load_count));
+	job.integer_indices = job.long_indices ? NULL : INTEGER(result);
+	job.real_indices    = job.long_indices ? REAL(result) : NULL;
+
+	job.counting = false;
+	ufo_parallel_for(length, chunk_size, threads, &__which_chunk, &job);
+
+	UNPROTECT(1);
+	return result;
+}
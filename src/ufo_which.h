@@ -0,0 +1,20 @@
+#pragma once
+
+#define USE_RINTERNALS
+#include <R.h>
+#include <Rinternals.h>
+
+// which(x) for a logical vector: the 1-based indices of its TRUE elements, as
+// a new UFO. The indices are integers, or doubles if the vector is too long
+// for integer indices.
+//
+// The vector is read twice, chunk by chunk: the first pass counts the TRUE
+// elements of every chunk, which gives every chunk its offset in the result,
+// and the second pass writes the indices of all chunks in parallel. Packed
+// logicals (see ufo_packed.h) are read from their bits instead. If
+// `chunk_size` is NULL, it is planned from the vector (see
+// ufo_plan_chunk_size).
+//
+// Returns NULL if `x` is not logical, which the caller should hand over to
+// base R.
+SEXP ufo_which(SEXP x, SEXP/*INTSXP*/ min_load_count, SEXP/*REALSXP*/ chunk_size);